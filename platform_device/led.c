@@ -1,5 +1,14 @@
 #include "led.h"
 
+// benchmark parameters; may be changed between runs
+static unsigned int bench_samples = LED_BENCH_SAMPLES;
+module_param(bench_samples, uint, 0644);
+MODULE_PARM_DESC(bench_samples, "Toggles per benchmark loop");
+
+static unsigned int bench_period_us = LED_BENCH_PERIOD_US;
+module_param(bench_period_us, uint, 0644);
+MODULE_PARM_DESC(bench_period_us, "Period of the hrtimer-paced benchmark loop");
+
 // register configuration functions
 static int gpio_configure(unsigned int pin, gpfsel_mode_t mode) {
     // function setup
@@ -84,6 +93,359 @@ static int gpio_clear(unsigned int pin) {
     return 0;
 }
 
+// toggle benchmark
+static const char * const led_bench_names[LED_BENCH_NUM_SERIES] = {
+    [LED_BENCH_SET] = "gpio_set",
+    [LED_BENCH_CLEAR] = "gpio_clear",
+    [LED_BENCH_HRTIMER_LATENCY] = "hrtimer_latency",
+    [LED_BENCH_HRTIMER_JITTER] = "hrtimer_jitter",
+};
+
+/**
+ * led_cycles()
+ * 
+ * Read this CPU's cycle counter. On ARM that is the PMU cycle counter (see
+ * led_cycles_enable()); get_cycles() there only counts the much slower
+ * architected timer. Differences wrap correctly in an unsigned long
+ */
+static inline unsigned long led_cycles(void) {
+#if defined(CONFIG_ARM)
+    u32 cycles;
+    asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(cycles));
+    return cycles;
+#elif defined(CONFIG_ARM64)
+    u64 cycles;
+    asm volatile("mrs %0, pmccntr_el0" : "=r"(cycles));
+    return cycles;
+#else
+    return get_cycles();
+#endif
+}
+
+/**
+ * led_cycles_enable()
+ * 
+ * Start the cycle counter on this CPU; the PMU is shared with perf, so it is only
+ * switched on, never reset or reconfigured
+ */
+static void led_cycles_enable(void) {
+#if defined(CONFIG_ARM)
+    u32 pmcr;
+    asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r"(pmcr));
+    asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r"(pmcr | 1));          // PMCR.E
+    asm volatile("mcr p15, 0, %0, c9, c12, 1" : : "r"(1u << 31));          // PMCNTENSET.C
+    isb();
+#elif defined(CONFIG_ARM64)
+    u64 pmcr;
+    asm volatile("mrs %0, pmcr_el0" : "=r"(pmcr));
+    asm volatile("msr pmcr_el0, %0" : : "r"(pmcr | 1));
+    asm volatile("msr pmcntenset_el0, %0" : : "r"(1ul << 31));
+    isb();
+#endif
+}
+
+/**
+ * led_bench_cmp()
+ * 
+ * sort() comparator for ns samples
+ */
+static int led_bench_cmp(const void *a, const void *b) {
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * led_bench_summarize()
+ * 
+ * Convert n cycle counts to ns at the run's cycle length and reduce them to the
+ * statistics of a series; sorts the samples
+ */
+static void led_bench_summarize(struct led_bench_stats *stats, u32 *samples, unsigned int n, bool cycles) {
+    // function setup
+    u64 sum = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!n) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < n; ++i) {
+        if (cycles) {
+            samples[i] = min_t(u64, div_u64((u64)samples[i] * led_bench.cycle_ps, 1000), U32_MAX);
+        }
+        sum += samples[i];
+        ++stats->hist[fls(samples[i])];
+    }
+    sort(samples, n, sizeof(*samples), led_bench_cmp, NULL);
+
+    stats->samples = n;
+    stats->min_ns = samples[0];
+    stats->avg_ns = div_u64(sum, n);
+    stats->p99_ns = samples[DIV_ROUND_UP(n * 99ull, 100) - 1];
+    stats->max_ns = samples[n - 1];
+}
+
+/**
+ * led_bench_tight()
+ * 
+ * Toggle the pin back to back with interrupts off. Each toggle is timed from
+ * before its register write until a read of GPLEV0 returns, so the write has
+ * reached the GPIO block rather than just left the CPU. Runs in chunks of
+ * LED_BENCH_CHUNK toggles, each calibrated on its own, so interrupts are never
+ * off for long
+ */
+static int led_bench_tight(unsigned int n) {
+    // function setup
+    volatile unsigned int *gpio_gplev0 = GPIO_REG(GPIO_GPLEV0_OFFSET);
+    u32 *set, *clear;
+    unsigned long flags, start, t0, t1, t2;
+    u64 ns, chunk_ps, total_ns = 0, total_cycles = 0;
+    unsigned int first, end;
+
+    set = kvmalloc_array(n, sizeof(*set), GFP_KERNEL);
+    clear = kvmalloc_array(n, sizeof(*clear), GFP_KERNEL);
+    if (!set || !clear) {
+        kvfree(set);
+        kvfree(clear);
+        return -ENOMEM;
+    }
+
+    for (first = 0; first < n; first = end) {
+        end = min(first + LED_BENCH_CHUNK, n);
+
+        local_irq_save(flags);
+        led_cycles_enable();
+        ns = ktime_get_ns();
+        start = t2 = led_cycles();
+        for (unsigned int i = first; i < end; ++i) {
+            t0 = t2;
+            gpio_set(LED_PIN);
+            (void)*gpio_gplev0;
+            t1 = led_cycles();
+            gpio_clear(LED_PIN);
+            (void)*gpio_gplev0;
+            t2 = led_cycles();
+            set[i] = t1 - t0;
+            clear[i] = t2 - t1;
+        }
+        ns = ktime_get_ns() - ns;
+        t2 -= start;
+        local_irq_restore(flags);
+
+        // convert this chunk at its own cycle length; the CPU may have changed speed
+        chunk_ps = t2 ? div64_u64(ns * 1000, t2) : 0;
+        for (unsigned int i = first; i < end; ++i) {
+            set[i] = min_t(u64, div_u64((u64)set[i] * chunk_ps, 1000), U32_MAX);
+            clear[i] = min_t(u64, div_u64((u64)clear[i] * chunk_ps, 1000), U32_MAX);
+        }
+        total_ns += ns;
+        total_cycles += t2;
+        cond_resched();
+    }
+
+    led_bench.cycle_ps = total_cycles ? div64_u64(total_ns * 1000, total_cycles) : 0;
+    led_bench_summarize(&led_bench.stats[LED_BENCH_SET], set, n, false);
+    led_bench_summarize(&led_bench.stats[LED_BENCH_CLEAR], clear, n, false);
+    kvfree(set);
+    kvfree(clear);
+    return 0;
+}
+
+/**
+ * led_bench_timer()
+ * 
+ * One paced toggle: stamp it, note how late the timer fired, and re-arm on the
+ * period grid; missed periods are counted, not made up
+ */
+static enum hrtimer_restart led_bench_timer(struct hrtimer *timer) {
+    // function setup
+    unsigned long now = led_cycles();
+    ktime_t kt = ktime_get();
+    s64 late = ktime_to_ns(ktime_sub(kt, hrtimer_get_expires(timer)));
+
+    if (led_bench.count & 1) {
+        gpio_clear(LED_PIN);
+    } else {
+        gpio_set(LED_PIN);
+    }
+    led_bench.stamps[led_bench.count] = now;
+    led_bench.late_ns[led_bench.count] = clamp_t(s64, late, 0, U32_MAX);
+    led_bench.end_ns = ktime_to_ns(kt);
+
+    if (++led_bench.count == led_bench.target) {
+        complete(&led_bench.done);
+        return HRTIMER_NORESTART;
+    }
+    led_bench.overruns += hrtimer_forward_now(timer, led_bench.period) - 1;
+    return HRTIMER_RESTART;
+}
+
+/**
+ * led_bench_hrtimer()
+ * 
+ * Toggle the pin from a hard-irq hrtimer every period_us, pinned to one CPU so
+ * every stamp comes from the same cycle counter
+ */
+static int led_bench_hrtimer(unsigned int n, unsigned int period_us) {
+    // function setup
+    unsigned long timeout = usecs_to_jiffies((u64)n * period_us) + HZ;
+    unsigned long start_cycles;
+    u64 start_ns, elapsed;
+    u32 *jitter;
+    s64 deviation;
+    int ret = 0;
+
+    led_bench.stamps = kvmalloc_array(n, sizeof(*led_bench.stamps), GFP_KERNEL);
+    led_bench.late_ns = kvmalloc_array(n, sizeof(*led_bench.late_ns), GFP_KERNEL);
+    jitter = kvmalloc_array(n, sizeof(*jitter), GFP_KERNEL);
+    if (!led_bench.stamps || !led_bench.late_ns || !jitter) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    led_bench.count = 0;
+    led_bench.target = n;
+    led_bench.overruns = 0;
+    led_bench.period = us_to_ktime(period_us);
+    reinit_completion(&led_bench.done);
+
+    // the timer fires on the CPU it was started on
+    preempt_disable();
+    led_cycles_enable();
+    start_ns = ktime_get_ns();
+    start_cycles = led_cycles();
+    hrtimer_start(&led_bench.timer, led_bench.period, HRTIMER_MODE_REL_PINNED_HARD);
+    preempt_enable();
+
+    if (!wait_for_completion_timeout(&led_bench.done, timeout)) {
+        hrtimer_cancel(&led_bench.timer);
+        LOGW("- hrtimer loop timed out after %u of %u toggles.", led_bench.count, n);
+        n = led_bench.count;
+    }
+
+    // calibrate the counter against ktime up to the last toggle, summing intervals
+    // so a 32-bit counter can wrap during long runs
+    elapsed = n ? led_bench.stamps[0] - start_cycles : 0;
+    for (unsigned int i = 1; i < n; ++i) {
+        elapsed += led_bench.stamps[i] - led_bench.stamps[i - 1];
+    }
+    led_bench.cycle_ps = elapsed ? div64_u64((led_bench.end_ns - start_ns) * 1000, elapsed) : 0;
+
+    // intervals between toggles against the period
+    for (unsigned int i = 1; i < n; ++i) {
+        deviation = (s64)div_u64((u64)(led_bench.stamps[i] - led_bench.stamps[i - 1]) * led_bench.cycle_ps, 1000) -
+            (s64)period_us * NSEC_PER_USEC;
+        jitter[i - 1] = min_t(u64, abs(deviation), U32_MAX);
+    }
+    LOG("+ %u paced toggles, %u missed periods.", n, led_bench.overruns);
+
+    led_bench_summarize(&led_bench.stats[LED_BENCH_HRTIMER_LATENCY], led_bench.late_ns, n, false);
+    led_bench_summarize(&led_bench.stats[LED_BENCH_HRTIMER_JITTER], jitter, n ? n - 1 : 0, false);
+
+out:
+    kvfree(led_bench.stamps);
+    kvfree(led_bench.late_ns);
+    kvfree(jitter);
+    led_bench.stamps = NULL;
+    led_bench.late_ns = NULL;
+    return ret;
+}
+
+/**
+ * led_bench_run_write()
+ * 
+ * debugfs led/run; "tight" or "hrtimer" runs that loop with the current
+ * parameters, then puts the LED back the way it was
+ */
+static ssize_t led_bench_run_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+    // function setup
+    char cmd[16];
+    int ret;
+
+    if (count >= sizeof(cmd)) {
+        return -EINVAL;
+    }
+    if (copy_from_user(cmd, buf, count)) {
+        return -EFAULT;
+    }
+    cmd[count] = '\0';
+    if (bench_samples == 0 || bench_samples > LED_BENCH_MAX_SAMPLES || bench_period_us == 0) {
+        LOGE("- bench_samples must be 1-%d and bench_period_us nonzero.", LED_BENCH_MAX_SAMPLES);
+        return -EINVAL;
+    }
+
+    mutex_lock(&led_bench.lock);
+    if (sysfs_streq(cmd, "tight")) {
+        ret = led_bench_tight(bench_samples);
+    } else if (sysfs_streq(cmd, "hrtimer")) {
+        ret = led_bench_hrtimer(bench_samples, bench_period_us);
+    } else {
+        ret = -EINVAL;
+    }
+    if (led_state) {
+        gpio_set(LED_PIN);
+    } else {
+        gpio_clear(LED_PIN);
+    }
+    mutex_unlock(&led_bench.lock);
+
+    return ret ? ret : count;
+}
+
+static const struct file_operations led_bench_run_fops = {
+    .owner = THIS_MODULE,
+    .write = led_bench_run_write,
+};
+
+/**
+ * led_bench_results_show()
+ * 
+ * debugfs led/results; the summary of every series, then its histogram
+ */
+static int led_bench_results_show(struct seq_file *m, void *v) {
+    // function setup
+    struct led_bench_stats *stats;
+    unsigned int peak, first, last;
+
+    mutex_lock(&led_bench.lock);
+    seq_printf(m, "%-16s %8s %10s %10s %10s %10s\n", "series", "samples", "min_ns", "avg_ns", "p99_ns", "max_ns");
+    for (int i = 0; i < LED_BENCH_NUM_SERIES; ++i) {
+        stats = &led_bench.stats[i];
+        seq_printf(m, "%-16s %8u %10u %10u %10u %10u\n", led_bench_names[i], stats->samples, stats->min_ns,
+            stats->avg_ns, stats->p99_ns, stats->max_ns);
+    }
+    seq_printf(m, "\nhrtimer overruns: %u; cycle: %llu ps\n", led_bench.overruns, led_bench.cycle_ps);
+
+    for (int i = 0; i < LED_BENCH_NUM_SERIES; ++i) {
+        stats = &led_bench.stats[i];
+        if (!stats->samples) {
+            continue;
+        }
+
+        // print from the first to the last non-empty bucket
+        peak = 0;
+        first = LED_BENCH_HIST_BUCKETS;
+        last = 0;
+        for (unsigned int b = 0; b < LED_BENCH_HIST_BUCKETS; ++b) {
+            if (stats->hist[b]) {
+                peak = max(peak, stats->hist[b]);
+                first = min(first, b);
+                last = b;
+            }
+        }
+        seq_printf(m, "\n%s (ns)\n", led_bench_names[i]);
+        for (unsigned int b = first; b <= last; ++b) {
+            seq_printf(m, "  [%10llu, %10llu) %8u |%-*.*s|\n", b ? 1ull << (b - 1) : 0, 1ull << b,
+                stats->hist[b], LED_BENCH_HIST_WIDTH, stats->hist[b] * LED_BENCH_HIST_WIDTH / peak,
+                "########################################");
+        }
+    }
+    mutex_unlock(&led_bench.lock);
+
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(led_bench_results);
+
 // File operations
 static ssize_t led_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
 {
@@ -163,12 +525,23 @@ static int led_probe(struct platform_device *pdev)
         return ret;
     }
 
+    // toggle benchmark; debugfs is optional, so failures are not fatal
+    mutex_init(&led_bench.lock);
+    init_completion(&led_bench.done);
+    hrtimer_init(&led_bench.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED_HARD);
+    led_bench.timer.function = led_bench_timer;
+    led_bench.debugfs = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("run", 0200, led_bench.debugfs, NULL, &led_bench_run_fops);
+    debugfs_create_file("results", 0444, led_bench.debugfs, NULL, &led_bench_results_fops);
+
     return 0;
 }
 
 static int led_remove(struct platform_device *pdev)
 {
     pr_info("LED platform device removed\n");
+    debugfs_remove_recursive(led_bench.debugfs);
+    hrtimer_cancel(&led_bench.timer);
     misc_deregister(&led_misc_device);
     return 0;
 }
@@ -13,6 +13,17 @@
 #include <linux/miscdevice.h>
 #include <linux/uaccess.h>
 
+#include <linux/completion.h>           // hrtimer loop completion
+#include <linux/debugfs.h>              // benchmark results
+#include <linux/hrtimer.h>              // paced toggling
+#include <linux/math64.h>               // cycle -> ns conversion
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>                 // percentiles
+#include <linux/mm.h>                   // kvmalloc
+#include <linux/sched.h>                // cond_resched()
+#include <asm/timex.h>                  // get_cycles()
+
 // local includes
 #include "log.h"
 #include "registers.h"
@@ -20,7 +31,75 @@
 // module definitions
 #define DEVICE_NAME "led"
 
+// toggle benchmark (debugfs led/run); default and maximum samples per loop, the
+// hrtimer loop's default period, toggles per interrupts-off chunk of the tight loop
+// (a few ms), and the histogram (log2 buckets of ns) bar width
+#define LED_BENCH_SAMPLES               10000
+#define LED_BENCH_MAX_SAMPLES           1000000
+#define LED_BENCH_PERIOD_US             100
+#define LED_BENCH_CHUNK                 2000
+#define LED_BENCH_HIST_BUCKETS          33
+#define LED_BENCH_HIST_WIDTH            40
+
+/**
+ * led_bench_series_t
+ * 
+ * Quantities the toggle benchmark measures: the cost of a set and of a clear in a
+ * tight loop, and for hrtimer-paced toggles the lateness after the expiry and the
+ * deviation of each toggle interval from the period
+ */
+typedef enum {
+    LED_BENCH_SET,
+    LED_BENCH_CLEAR,
+    LED_BENCH_HRTIMER_LATENCY,
+    LED_BENCH_HRTIMER_JITTER,
+    LED_BENCH_NUM_SERIES,
+} led_bench_series_t;
+
+/**
+ * struct led_bench_stats
+ * 
+ * Summary of one series; hist[k] counts samples in [2^(k-1), 2^k) ns, hist[0] the
+ * zero samples
+ */
+struct led_bench_stats {
+    unsigned int samples;
+    u32 min_ns;
+    u32 avg_ns;
+    u32 p99_ns;
+    u32 max_ns;
+    unsigned int hist[LED_BENCH_HIST_BUCKETS];
+};
+
+/**
+ * struct led_bench
+ * 
+ * Benchmark state. Toggles are timestamped with the cycle counter, which is
+ * converted to ns against ktime over the same run
+ */
+struct led_bench {
+    // serializes runs and readers
+    struct mutex lock;
+    struct dentry *debugfs;
+    struct led_bench_stats stats[LED_BENCH_NUM_SERIES];
+
+    // length of one counter cycle in the last run, in ps
+    u64 cycle_ps;
+
+    // hrtimer loop; stamps and lateness of each toggle, filled by the timer
+    struct hrtimer timer;
+    struct completion done;
+    ktime_t period;
+    unsigned long *stamps;
+    u32 *late_ns;
+    unsigned int count;
+    unsigned int target;
+    unsigned int overruns;
+    u64 end_ns;
+};
+
 // device info
 static char led_state = 0; // 0 = OFF, 1 = ON
+static struct led_bench led_bench;
 
 #endif /* _PLATFORM_DEV_H_ */
\ No newline at end of file
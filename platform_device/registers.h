@@ -65,6 +65,8 @@
 #define GPIO_GPSET1_OFFSET                  (0x00000020)
 #define GPIO_GPCLR0_OFFSET                  (0x00000028)
 #define GPIO_GPCLR1_OFFSET                  (0x0000002C)
+#define GPIO_GPLEV0_OFFSET                  (0x00000034)
+#define GPIO_GPLEV1_OFFSET                  (0x00000038)
 
 // GPFSELn
 #define GPIO_GPFSEL_SHIFT(pin)              (((pin) % (10)) * (3))
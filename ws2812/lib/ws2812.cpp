@@ -0,0 +1,293 @@
+/**
+ * libws2812
+ *
+ * See ws2812.hpp
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#include "ws2812.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace ws2812 {
+
+/**************************************************************************************
+ * HELPER FUNCTIONS
+ **************************************************************************************/
+namespace {
+
+/**
+ * fail()
+ *
+ * Throw errno as a std::system_error
+ */
+[[noreturn]] void fail(const char *what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+/**
+ * scale()
+ *
+ * c * a / 255, rounded, without a division
+ */
+constexpr std::uint8_t scale(unsigned int c, unsigned int a) noexcept {
+    unsigned int x = c * a + 128;
+    return static_cast<std::uint8_t>((x + (x >> 8)) >> 8);
+}
+
+} // namespace
+
+/**************************************************************************************
+ * CONVERTERS
+ **************************************************************************************/
+
+/**
+ * from_rgba()
+ *
+ * Composite over black: every channel is scaled by alpha
+ */
+void from_rgba(std::span<const Rgba> in, std::span<Pixel> out) noexcept {
+    // function setup
+    std::size_t n = std::min(in.size(), out.size());
+
+    for (std::size_t i = 0; i < n; ++i) {
+        out[i].red = scale(in[i].red, in[i].alpha);
+        out[i].green = scale(in[i].green, in[i].alpha);
+        out[i].blue = scale(in[i].blue, in[i].alpha);
+    }
+}
+
+/**
+ * from_hsv()
+ *
+ * Integer HSV to RGB; the hue circle is six sectors of 43 steps
+ */
+void from_hsv(std::span<const Hsv> in, std::span<Pixel> out) noexcept {
+    // function setup
+    std::size_t n = std::min(in.size(), out.size());
+
+    for (std::size_t i = 0; i < n; ++i) {
+        unsigned int h = in[i].hue, s = in[i].saturation, v = in[i].value;
+        unsigned int sector = h / 43, rem = (h - sector * 43) * 6;
+        auto p = static_cast<std::uint8_t>((v * (255 - s)) >> 8);
+        auto q = static_cast<std::uint8_t>((v * (255 - ((s * rem) >> 8))) >> 8);
+        auto t = static_cast<std::uint8_t>((v * (255 - ((s * (255 - rem)) >> 8))) >> 8);
+        auto c = static_cast<std::uint8_t>(v);
+
+        switch (s ? sector : 6) {
+            case 0: out[i] = { c, t, p }; break;
+            case 1: out[i] = { q, c, p }; break;
+            case 2: out[i] = { p, c, t }; break;
+            case 3: out[i] = { p, q, c }; break;
+            case 4: out[i] = { t, p, c }; break;
+            case 5: out[i] = { c, p, q }; break;
+            default: out[i] = { c, c, c }; break;
+        }
+    }
+}
+
+/**************************************************************************************
+ * FRAME
+ **************************************************************************************/
+Frame::Frame(std::size_t leds) : data_(std::make_unique<Pixel[]>(leds)), size_(leds) {}
+
+/**************************************************************************************
+ * STRIP
+ **************************************************************************************/
+Strip::Strip(std::size_t leds, const std::string &path) : leds_(leds) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd_ < 0) {
+        fail(path.c_str());
+    }
+}
+
+Strip::~Strip() {
+    close();
+}
+
+Strip::Strip(Strip &&other) noexcept
+    : fd_(std::exchange(other.fd_, -1)), leds_(other.leds_), map_(std::exchange(other.map_, nullptr)),
+      map_len_(std::exchange(other.map_len_, 0)) {}
+
+Strip &Strip::operator=(Strip &&other) noexcept {
+    if (this != &other) {
+        close();
+        fd_ = std::exchange(other.fd_, -1);
+        leds_ = other.leds_;
+        map_ = std::exchange(other.map_, nullptr);
+        map_len_ = std::exchange(other.map_len_, 0);
+    }
+    return *this;
+}
+
+/**
+ * close()
+ *
+ * Unmap the layer buffer and close the device
+ */
+void Strip::close() noexcept {
+    if (map_) {
+        ::munmap(map_, map_len_);
+        map_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void Strip::set_layer(const ws2812_layer_config &cfg) {
+    if (::ioctl(fd_, WS2812_IOC_SET_LAYER, &cfg)) {
+        fail("WS2812_IOC_SET_LAYER");
+    }
+}
+
+ws2812_timing Strip::timing() const {
+    // function setup
+    ws2812_timing timing{};
+
+    if (::ioctl(fd_, WS2812_IOC_GET_TIMING, &timing)) {
+        fail("WS2812_IOC_GET_TIMING");
+    }
+    return timing;
+}
+
+/**
+ * try_write()
+ *
+ * One write() of the frame; false if the driver pushed back
+ */
+bool Strip::try_write(std::span<const Pixel> pixels) {
+    // function setup
+    std::size_t len = std::min(pixels.size(), leds_) * sizeof(Pixel);
+
+    if (::write(fd_, pixels.data(), len) >= 0) {
+        return true;
+    }
+    if (errno != EAGAIN) {
+        fail("write");
+    }
+    return false;
+}
+
+void Strip::write(std::span<const Pixel> pixels) {
+    while (!try_write(pixels)) {
+        wait();
+    }
+}
+
+/**
+ * map()
+ *
+ * Map the layer's shared pixel buffer on first use
+ */
+std::span<Pixel> Strip::map() {
+    // function setup
+    std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    void *addr;
+
+    if (!map_) {
+        map_len_ = (leds_ * sizeof(Pixel) + page - 1) / page * page;
+        addr = ::mmap(nullptr, map_len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (addr == MAP_FAILED) {
+            map_len_ = 0;
+            fail("mmap");
+        }
+        map_ = static_cast<Pixel *>(addr);
+    }
+    return { map_, leds_ };
+}
+
+bool Strip::try_commit() {
+    if (!::ioctl(fd_, WS2812_IOC_COMMIT)) {
+        return true;
+    }
+    if (errno != EAGAIN) {
+        fail("WS2812_IOC_COMMIT");
+    }
+    return false;
+}
+
+void Strip::commit() {
+    while (!try_commit()) {
+        wait();
+    }
+}
+
+bool Strip::wait(int timeout_ms) const {
+    // function setup
+    struct pollfd pfd = { fd_, POLLOUT, 0 };
+    int retval;
+
+    do {
+        retval = ::poll(&pfd, 1, timeout_ms);
+    } while (retval < 0 && errno == EINTR);
+    if (retval < 0) {
+        fail("poll");
+    }
+    return retval > 0;
+}
+
+/**************************************************************************************
+ * FRAME QUEUE
+ **************************************************************************************/
+FrameQueue::FrameQueue(Strip &strip, std::size_t depth) : strip_(strip), depth_(std::max<std::size_t>(depth, 1)) {
+    free_.reserve(depth_ + 1);
+}
+
+/**
+ * acquire()
+ *
+ * A frame buffer for the strip; recycled if one is free
+ */
+Frame FrameQueue::acquire() {
+    // function setup
+    Frame frame;
+
+    if (free_.empty()) {
+        return Frame(strip_.size());
+    }
+    frame = std::move(free_.back());
+    free_.pop_back();
+    return frame;
+}
+
+void FrameQueue::push(Frame &&frame) {
+    if (queue_.size() == depth_) {
+        free_.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+        ++dropped_;
+    }
+    queue_.push_back(std::move(frame));
+}
+
+std::size_t FrameQueue::pump() {
+    // function setup
+    std::size_t submitted = 0;
+
+    while (!queue_.empty() && strip_.try_write(queue_.front().pixels())) {
+        free_.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+        ++submitted;
+    }
+    return submitted;
+}
+
+void FrameQueue::flush() {
+    while (pump(), !queue_.empty()) {
+        strip_.wait();
+    }
+}
+
+} // namespace ws2812
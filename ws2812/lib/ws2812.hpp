@@ -0,0 +1,196 @@
+#ifndef _WS2812_HPP_
+#define _WS2812_HPP_
+
+/**
+ * libws2812
+ *
+ * C++ client library for /dev/ws2812. Strip owns the device file descriptor and its
+ * mmap()ed layer buffer; Frame is a move-only pixel buffer handed around by span;
+ * FrameQueue batches frames and submits them without blocking. Converters turn RGBA
+ * and HSV pixels into the device's RGB format.
+ *
+ * Errors opening or configuring the device throw std::system_error; the driver
+ * pushing back on a frame is not an error (see Strip::try_write)
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "ws2812_ioctl.h"
+
+namespace ws2812 {
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+inline constexpr const char *default_device = "/dev/ws2812";
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+/**
+ * Pixel
+ *
+ * One LED in the device's WS2812_FORMAT_RGB layout
+ */
+struct Pixel {
+    std::uint8_t red;
+    std::uint8_t green;
+    std::uint8_t blue;
+};
+static_assert(sizeof(Pixel) == 3, "Pixel must match the driver's led_t");
+
+/**
+ * Rgba
+ *
+ * Straight (not premultiplied) alpha; converted as if drawn over black
+ */
+struct Rgba {
+    std::uint8_t red;
+    std::uint8_t green;
+    std::uint8_t blue;
+    std::uint8_t alpha;
+};
+
+/**
+ * Hsv
+ *
+ * 8-bit hue (0-255 once around the color wheel), saturation and value
+ */
+struct Hsv {
+    std::uint8_t hue;
+    std::uint8_t saturation;
+    std::uint8_t value;
+};
+
+/**************************************************************************************
+ * CONVERTERS
+ **************************************************************************************/
+// convert min(in.size(), out.size()) pixels
+void from_rgba(std::span<const Rgba> in, std::span<Pixel> out) noexcept;
+void from_hsv(std::span<const Hsv> in, std::span<Pixel> out) noexcept;
+
+/**************************************************************************************
+ * FRAME
+ **************************************************************************************/
+/**
+ * Frame
+ *
+ * Heap pixel buffer for one frame. Move-only, so a frame is filled, queued and
+ * recycled without ever being copied
+ */
+class Frame {
+public:
+    Frame() noexcept = default;
+    explicit Frame(std::size_t leds);
+
+    Frame(Frame &&) noexcept = default;
+    Frame &operator=(Frame &&) noexcept = default;
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+
+    std::span<Pixel> pixels() noexcept { return { data_.get(), size_ }; }
+    std::span<const Pixel> pixels() const noexcept { return { data_.get(), size_ }; }
+    std::size_t size() const noexcept { return size_; }
+
+private:
+    std::unique_ptr<Pixel[]> data_;
+    std::size_t size_ = 0;
+};
+
+/**************************************************************************************
+ * STRIP
+ **************************************************************************************/
+/**
+ * Strip
+ *
+ * One open layer of the device. The file is opened O_NONBLOCK: try_write() and
+ * try_commit() return false when the driver has no free frame slot, while write()
+ * and commit() wait in poll() for one, so an uncontended frame costs exactly one
+ * system call
+ */
+class Strip {
+public:
+    explicit Strip(std::size_t leds, const std::string &path = default_device);
+    ~Strip();
+
+    Strip(Strip &&other) noexcept;
+    Strip &operator=(Strip &&other) noexcept;
+    Strip(const Strip &) = delete;
+    Strip &operator=(const Strip &) = delete;
+
+    std::size_t size() const noexcept { return leds_; }
+    int fd() const noexcept { return fd_; }
+
+    // layer placement and the driver's frame timing
+    void set_layer(const ws2812_layer_config &cfg);
+    ws2812_timing timing() const;
+
+    // submit a frame of up to size() pixels
+    bool try_write(std::span<const Pixel> pixels);
+    void write(std::span<const Pixel> pixels);
+
+    // zero-copy path: draw into map(), then commit it
+    std::span<Pixel> map();
+    bool try_commit();
+    void commit();
+
+    // wait for a free frame slot; false on timeout
+    bool wait(int timeout_ms = -1) const;
+
+private:
+    void close() noexcept;
+
+    int fd_ = -1;
+    std::size_t leds_ = 0;
+    Pixel *map_ = nullptr;
+    std::size_t map_len_ = 0;
+};
+
+/**************************************************************************************
+ * FRAME QUEUE
+ **************************************************************************************/
+/**
+ * FrameQueue
+ *
+ * Batches frames for a strip. Frames come from acquire(), which recycles buffers
+ * the queue has already submitted, and go back through push(). pump() submits as
+ * many queued frames as the driver takes without blocking, so a render loop never
+ * stalls on the strip; once depth frames are waiting the oldest is dropped, since
+ * only the newest frame matters on a display
+ */
+class FrameQueue {
+public:
+    FrameQueue(Strip &strip, std::size_t depth);
+
+    Frame acquire();
+    void push(Frame &&frame);
+
+    // submit without blocking; returns the number of frames submitted
+    std::size_t pump();
+
+    // submit everything, waiting for the driver as needed
+    void flush();
+
+    std::size_t pending() const noexcept { return queue_.size(); }
+    std::size_t dropped() const noexcept { return dropped_; }
+
+private:
+    Strip &strip_;
+    std::size_t depth_;
+    std::deque<Frame> queue_;
+    std::vector<Frame> free_;
+    std::size_t dropped_ = 0;
+};
+
+} // namespace ws2812
+
+#endif /* _WS2812_HPP_ */
@@ -0,0 +1,213 @@
+#ifndef _WS2812_E131_HPP_
+#define _WS2812_E131_HPP_
+
+/**
+ * E1.31 (streaming ACN) packets
+ *
+ * Just enough of ANSI E1.31 for the bridge and its test sender: data packets of up
+ * to 512 DMX channels per universe, and universe synchronization packets. Every
+ * multi-byte field is big-endian. A universe carries 170 RGB pixels (510 channels),
+ * which map byte for byte onto the device's pixel format
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace ws2812::e131 {
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+inline constexpr std::uint16_t port = 5568;
+inline constexpr std::size_t max_channels = 512;
+inline constexpr std::size_t pixels_per_universe = 170;
+
+// root and framing layer vectors
+inline constexpr std::uint32_t vector_root_data = 0x00000004;
+inline constexpr std::uint32_t vector_root_extended = 0x00000008;
+inline constexpr std::uint32_t vector_data_packet = 0x00000002;
+inline constexpr std::uint32_t vector_extended_sync = 0x00000001;
+
+// data packet options
+inline constexpr std::uint8_t option_preview = 0x80;
+inline constexpr std::uint8_t option_terminated = 0x40;
+
+// field offsets
+inline constexpr std::size_t root_vector_offset = 18;
+inline constexpr std::size_t cid_offset = 22;
+inline constexpr std::size_t framing_offset = 38;
+inline constexpr std::size_t framing_vector_offset = 40;
+inline constexpr std::size_t source_name_offset = 44;
+inline constexpr std::size_t priority_offset = 108;
+inline constexpr std::size_t sync_address_offset = 109;
+inline constexpr std::size_t sequence_offset = 111;
+inline constexpr std::size_t options_offset = 112;
+inline constexpr std::size_t universe_offset = 113;
+inline constexpr std::size_t dmp_offset = 115;
+inline constexpr std::size_t count_offset = 123;
+inline constexpr std::size_t data_offset = 126;
+inline constexpr std::size_t sync_sequence_offset = 44;
+inline constexpr std::size_t sync_universe_offset = 45;
+
+// packet sizes
+inline constexpr std::size_t data_header_size = data_offset;
+inline constexpr std::size_t max_packet_size = data_offset + max_channels;
+inline constexpr std::size_t sync_packet_size = 49;
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+/**
+ * Packet
+ *
+ * A received packet: a universe's channels, or a sync for sync_address
+ */
+struct Packet {
+    enum class Type { invalid, data, sync } type = Type::invalid;
+    std::uint16_t universe = 0;         // data: universe; sync: the sync address
+    std::uint16_t sync_address = 0;     // data: 0 if the universe is not synchronized
+    std::uint8_t sequence = 0;
+    std::uint8_t options = 0;
+    std::span<const std::uint8_t> channels;
+};
+
+/**************************************************************************************
+ * FIELD ACCESS
+ **************************************************************************************/
+inline std::uint16_t get16(const std::uint8_t *p) { return static_cast<std::uint16_t>(p[0] << 8 | p[1]); }
+inline std::uint32_t get32(const std::uint8_t *p) {
+    return static_cast<std::uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+inline void put16(std::uint8_t *p, std::uint16_t v) {
+    p[0] = static_cast<std::uint8_t>(v >> 8);
+    p[1] = static_cast<std::uint8_t>(v);
+}
+inline void put32(std::uint8_t *p, std::uint32_t v) {
+    put16(p, static_cast<std::uint16_t>(v >> 16));
+    put16(p + 2, static_cast<std::uint16_t>(v));
+}
+
+/**************************************************************************************
+ * PACKETS
+ **************************************************************************************/
+// root layer preamble and ACN packet identifier
+inline constexpr std::uint8_t preamble[16] = {
+    0x00, 0x10, 0x00, 0x00, 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0x00, 0x00, 0x00,
+};
+
+/**
+ * parse()
+ *
+ * Classify a datagram; anything malformed is Type::invalid
+ */
+inline Packet parse(std::span<const std::uint8_t> buf) {
+    // function setup
+    Packet pkt;
+    std::size_t count;
+
+    if (buf.size() < sync_packet_size || std::memcmp(buf.data(), preamble, sizeof(preamble))) {
+        return pkt;
+    }
+
+    switch (get32(&buf[root_vector_offset])) {
+        case vector_root_data:
+            if (buf.size() < data_header_size || get32(&buf[framing_vector_offset]) != vector_data_packet ||
+                buf[dmp_offset + 2] != 0x02 || buf[data_offset - 1] != 0) {
+                return pkt;
+            }
+            count = get16(&buf[count_offset]);
+            if (!count || count - 1 > max_channels || data_offset + count - 1 > buf.size()) {
+                return pkt;
+            }
+            pkt.type = Packet::Type::data;
+            pkt.universe = get16(&buf[universe_offset]);
+            pkt.sync_address = get16(&buf[sync_address_offset]);
+            pkt.sequence = buf[sequence_offset];
+            pkt.options = buf[options_offset];
+            pkt.channels = buf.subspan(data_offset, count - 1);
+            return pkt;
+
+        case vector_root_extended:
+            if (get32(&buf[framing_vector_offset]) != vector_extended_sync) {
+                return pkt;
+            }
+            pkt.type = Packet::Type::sync;
+            pkt.universe = get16(&buf[sync_universe_offset]);
+            pkt.sequence = buf[sync_sequence_offset];
+            return pkt;
+
+        default:
+            return pkt;
+    }
+}
+
+/**
+ * build_data()
+ *
+ * Write a data packet for channels into buf (max_packet_size bytes); returns its size
+ */
+inline std::size_t build_data(std::uint8_t *buf, const std::uint8_t cid[16], const char *source,
+    std::uint16_t universe, std::uint16_t sync_address, std::uint8_t sequence,
+    std::span<const std::uint8_t> channels) {
+    // function setup
+    std::size_t size = data_offset + channels.size();
+
+    std::memset(buf, 0, data_header_size);
+    std::memcpy(buf, preamble, sizeof(preamble));
+    put16(&buf[16], static_cast<std::uint16_t>(0x7000 | (size - 16)));
+    put32(&buf[root_vector_offset], vector_root_data);
+    std::memcpy(&buf[cid_offset], cid, 16);
+
+    put16(&buf[framing_offset], static_cast<std::uint16_t>(0x7000 | (size - framing_offset)));
+    put32(&buf[framing_vector_offset], vector_data_packet);
+    std::strncpy(reinterpret_cast<char *>(&buf[source_name_offset]), source, 63);
+    buf[priority_offset] = 100;
+    put16(&buf[sync_address_offset], sync_address);
+    buf[sequence_offset] = sequence;
+    put16(&buf[universe_offset], universe);
+
+    put16(&buf[dmp_offset], static_cast<std::uint16_t>(0x7000 | (size - dmp_offset)));
+    buf[dmp_offset + 2] = 0x02;
+    buf[dmp_offset + 3] = 0xa1;
+    put16(&buf[dmp_offset + 6], 0x0001);
+    put16(&buf[count_offset], static_cast<std::uint16_t>(channels.size() + 1));
+    std::memcpy(&buf[data_offset], channels.data(), channels.size());
+    return size;
+}
+
+/**
+ * build_sync()
+ *
+ * Write a sync packet into buf (sync_packet_size bytes); returns its size
+ */
+inline std::size_t build_sync(std::uint8_t *buf, const std::uint8_t cid[16], std::uint16_t sync_address,
+    std::uint8_t sequence) {
+    std::memset(buf, 0, sync_packet_size);
+    std::memcpy(buf, preamble, sizeof(preamble));
+    put16(&buf[16], static_cast<std::uint16_t>(0x7000 | (sync_packet_size - 16)));
+    put32(&buf[root_vector_offset], vector_root_extended);
+    std::memcpy(&buf[cid_offset], cid, 16);
+    put16(&buf[framing_offset], static_cast<std::uint16_t>(0x7000 | (sync_packet_size - framing_offset)));
+    put32(&buf[framing_vector_offset], vector_extended_sync);
+    buf[sync_sequence_offset] = sequence;
+    put16(&buf[sync_universe_offset], sync_address);
+    return sync_packet_size;
+}
+
+/**
+ * multicast_group()
+ *
+ * IPv4 multicast group of a universe, 239.255.hi.lo, in host byte order
+ */
+inline std::uint32_t multicast_group(std::uint16_t universe) {
+    return 0xefff0000u | universe;
+}
+
+} // namespace ws2812::e131
+
+#endif /* _WS2812_E131_HPP_ */
@@ -0,0 +1,365 @@
+/**
+ * ws2812_sacn_bridge
+ *
+ * E1.31 (sACN) to /dev/ws2812 bridge. Universes are received in batches with
+ * recvmmsg() and their channels copied straight into the layer's mmap()ed pixel
+ * buffer, universe u covering LEDs (u - first) * 170 onwards. The frame is
+ * committed when a sync packet for its sync address arrives, or, for universes
+ * sent without synchronization, once every universe of the strip has arrived.
+ *
+ * Once a second it reports receive-to-latch latency: from the kernel receive
+ * timestamp of a frame's first packet to its commit, and to the latch that follows
+ * one frame period later (a streaming chain can add up to one more period while the
+ * DMA finishes its current pass)
+ *
+ * usage: ws2812_sacn_bridge [-d device] [-l leds] [-u first_universe] [-p port]
+ *                           [-b batch] [-m] [-t]
+ *
+ *      -l          LEDs to drive (default: the whole strip)
+ *      -m          join the universes' multicast groups
+ *      -t          test mode: no device; frames go to a private buffer, so the bridge
+ *                  can be exercised over loopback with ws2812_sacn_send
+ */
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ws2812.hpp"
+#include "ws2812_e131.hpp"
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define DEFAULT_BATCH                       32
+#define MAX_UNIVERSES                       64
+#define TEST_LEDS                           (4 * ws2812::e131::pixels_per_universe)
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+/**
+ * struct slot
+ *
+ * One recvmmsg() buffer with room for the receive timestamp
+ */
+struct slot {
+    std::uint8_t data[ws2812::e131::max_packet_size];
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct timespec))];
+    struct iovec iov;
+};
+
+/**
+ * struct stats
+ *
+ * Counters and latencies (ns) for one report interval
+ */
+struct stats {
+    unsigned long packets = 0;
+    unsigned long frames = 0;
+    unsigned long dropped = 0;
+    std::vector<std::int64_t> latency;
+};
+
+/**************************************************************************************
+ * GLOBALS
+ **************************************************************************************/
+static volatile std::sig_atomic_t stop;
+
+/**************************************************************************************
+ * HELPER FUNCTIONS
+ **************************************************************************************/
+
+/**
+ * on_signal()
+ *
+ * SIGINT/SIGTERM handler; ends the receive loop
+ */
+static void on_signal(int) {
+    stop = 1;
+}
+
+/**
+ * to_ns()
+ *
+ * timespec in nanoseconds
+ */
+static std::int64_t to_ns(const struct timespec &ts) {
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * now_ns()
+ *
+ * CLOCK_REALTIME, which receive timestamps are taken on, in nanoseconds
+ */
+static std::int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return to_ns(ts);
+}
+
+/**
+ * rx_ns()
+ *
+ * Kernel receive timestamp of a message, or now if it has none
+ */
+static std::int64_t rx_ns(struct msghdr &hdr) {
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&hdr); c; c = CMSG_NXTHDR(&hdr, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return to_ns(ts);
+        }
+    }
+    return now_ns();
+}
+
+/**
+ * percentile_us()
+ *
+ * Nearest-rank percentile of nanosecond samples, in microseconds; reorders them
+ */
+static double percentile_us(std::vector<std::int64_t> &ns, double p) {
+    std::size_t rank = static_cast<std::size_t>(p / 100.0 * ns.size() + 0.5);
+    auto nth = ns.begin() + static_cast<std::ptrdiff_t>(rank ? rank - 1 : 0);
+
+    std::nth_element(ns.begin(), nth, ns.end());
+    return *nth / 1000.0;
+}
+
+/**
+ * report()
+ *
+ * One interval's counters and latency percentiles
+ */
+static void report(struct stats &s, std::int64_t frame_ns) {
+    double p50, p99, max;
+
+    if (s.latency.empty()) {
+        std::fprintf(stderr, "frames 0, packets %lu, dropped %lu\n", s.packets, s.dropped);
+    } else {
+        p50 = percentile_us(s.latency, 50);
+        p99 = percentile_us(s.latency, 99);
+        max = *std::max_element(s.latency.begin(), s.latency.end()) / 1000.0;
+        std::fprintf(stderr, "frames %lu, packets %lu, dropped %lu; receive to commit p50 %.1f p99 %.1f "
+            "max %.1f us, to latch p50 %.1f p99 %.1f us\n", s.frames, s.packets, s.dropped, p50, p99, max,
+            p50 + frame_ns / 1000.0, p99 + frame_ns / 1000.0);
+    }
+    s = stats{};
+}
+
+/**
+ * open_socket()
+ *
+ * UDP socket on port with receive timestamps, a one second receive timeout so the
+ * loop can report while idle, and optionally the universes' multicast groups
+ */
+static int open_socket(std::uint16_t port, bool multicast, std::uint16_t first, unsigned int universes) {
+    // function setup
+    struct sockaddr_in addr = {};
+    struct timeval timeout = { 1, 0 };
+    struct ip_mreq mreq = {};
+    int fd, one = 1;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::perror("socket");
+        return -1;
+    }
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ||
+        bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))) {
+        std::perror("socket setup");
+        close(fd);
+        return -1;
+    }
+
+    for (unsigned int i = 0; multicast && i < universes; ++i) {
+        mreq.imr_multiaddr.s_addr = htonl(ws2812::e131::multicast_group(static_cast<std::uint16_t>(first + i)));
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq))) {
+            std::perror("IP_ADD_MEMBERSHIP");
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/**************************************************************************************
+ * MAIN
+ **************************************************************************************/
+int main(int argc, char *argv[]) {
+    // function setup
+    const char *device = ws2812::default_device;
+    unsigned int leds = 0, batch = DEFAULT_BATCH, universes;
+    std::uint16_t first = 1, port = ws2812::e131::port, pending_sync = 0;
+    bool multicast = false, test = false;
+    std::unique_ptr<ws2812::Strip> strip;
+    std::vector<ws2812::Pixel> test_frame;
+    std::span<ws2812::Pixel> frame;
+    std::int64_t frame_ns = 0, first_rx = 0, next_report;
+    std::uint64_t all, received = 0;
+    std::vector<int> last_sequence;
+    struct stats s;
+    int opt, fd, n;
+
+    while ((opt = getopt(argc, argv, "d:l:u:p:b:mt")) != -1) {
+        switch (opt) {
+            case 'd': device = optarg; break;
+            case 'l': leds = std::strtoul(optarg, nullptr, 0); break;
+            case 'u': first = static_cast<std::uint16_t>(std::strtoul(optarg, nullptr, 0)); break;
+            case 'p': port = static_cast<std::uint16_t>(std::strtoul(optarg, nullptr, 0)); break;
+            case 'b': batch = std::strtoul(optarg, nullptr, 0); break;
+            case 'm': multicast = true; break;
+            case 't': test = true; break;
+            default:
+                std::fprintf(stderr, "usage: %s [-d device] [-l leds] [-u first_universe] [-p port] [-b batch] "
+                    "[-m] [-t]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    // frame memory: the device's shared layer buffer, or a private one for testing
+    try {
+        if (test) {
+            leds = leds ? leds : TEST_LEDS;
+            test_frame.resize(leds);
+            frame = test_frame;
+        } else {
+            ws2812::Strip probe(1, device);
+            ws2812_timing timing = probe.timing();
+            leds = leds ? std::min(leds, timing.num_leds) : timing.num_leds;
+            frame_ns = timing.frame_ns;
+            strip = std::make_unique<ws2812::Strip>(leds, device);
+            frame = strip->map();
+        }
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    universes = (leds + ws2812::e131::pixels_per_universe - 1) / ws2812::e131::pixels_per_universe;
+    if (!leds || universes > MAX_UNIVERSES || !batch || first == 0 || first + universes > 64000) {
+        std::fprintf(stderr, "invalid setup: %u LEDs (%u universes from %u), batch %u\n", leds, universes, first,
+            batch);
+        return 2;
+    }
+    all = universes == 64 ? ~0ull : (1ull << universes) - 1;
+    last_sequence.assign(universes, -1);
+
+    fd = open_socket(port, multicast, first, universes);
+    if (fd < 0) {
+        return 1;
+    }
+
+    // receive buffers
+    std::vector<struct slot> slots(batch);
+    std::vector<struct mmsghdr> msgs(batch);
+    for (unsigned int i = 0; i < batch; ++i) {
+        slots[i].iov = { slots[i].data, sizeof(slots[i].data) };
+        msgs[i].msg_hdr.msg_iov = &slots[i].iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = slots[i].control;
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::fprintf(stderr, "bridging universes %u-%u on port %u to %u LEDs%s\n", first, first + universes - 1, port,
+        leds, test ? " (test mode)" : "");
+
+    next_report = now_ns() + 1000000000;
+    while (!stop) {
+        for (unsigned int i = 0; i < batch; ++i) {
+            msgs[i].msg_hdr.msg_controllen = sizeof(slots[i].control);
+        }
+        n = recvmmsg(fd, msgs.data(), batch, MSG_WAITFORONE, nullptr);
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            std::perror("recvmmsg");
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            ws2812::e131::Packet pkt = ws2812::e131::parse({ slots[i].data, msgs[i].msg_len });
+            bool commit = false;
+            ++s.packets;
+
+            if (pkt.type == ws2812::e131::Packet::Type::data) {
+                unsigned int u = pkt.universe - first;
+                int delta;
+
+                if (pkt.universe < first || u >= universes ||
+                    (pkt.options & (ws2812::e131::option_preview | ws2812::e131::option_terminated))) {
+                    continue;
+                }
+
+                // E1.31 6.7.2: drop packets up to 20 behind the last one
+                delta = static_cast<std::int8_t>(pkt.sequence - last_sequence[u]);
+                if (last_sequence[u] >= 0 && delta <= 0 && delta > -20) {
+                    ++s.dropped;
+                    continue;
+                }
+                last_sequence[u] = pkt.sequence;
+
+                // scatter straight into the frame
+                std::size_t offset = u * ws2812::e131::pixels_per_universe * sizeof(ws2812::Pixel);
+                std::size_t bytes = std::min(pkt.channels.size(), frame.size_bytes() - offset);
+                std::memcpy(reinterpret_cast<std::uint8_t *>(frame.data()) + offset, pkt.channels.data(), bytes);
+
+                if (!received) {
+                    first_rx = rx_ns(msgs[i].msg_hdr);
+                }
+                received |= 1ull << u;
+                pending_sync = pkt.sync_address;
+                commit = !pkt.sync_address && received == all;
+            } else if (pkt.type == ws2812::e131::Packet::Type::sync) {
+                commit = received && pkt.universe == pending_sync;
+            } else {
+                ++s.dropped;
+            }
+
+            if (commit) {
+                try {
+                    if (strip) {
+                        strip->commit();
+                    }
+                } catch (const std::exception &e) {
+                    std::fprintf(stderr, "%s\n", e.what());
+                    stop = 1;
+                    break;
+                }
+                s.latency.push_back(now_ns() - first_rx);
+                ++s.frames;
+                received = 0;
+            }
+        }
+
+        if (now_ns() >= next_report) {
+            report(s, frame_ns);
+            next_report += 1000000000;
+        }
+    }
+
+    report(s, frame_ns);
+    close(fd);
+    return 0;
+}
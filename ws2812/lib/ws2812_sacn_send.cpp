@@ -0,0 +1,149 @@
+/**
+ * ws2812_sacn_send
+ *
+ * Test sender for ws2812_sacn_bridge: streams a moving rainbow as E1.31 universes,
+ * every universe of a frame (and its sync packet) in one sendmmsg() call. Together
+ * with the bridge's test mode it exercises the whole path over loopback:
+ *
+ *      ws2812_sacn_bridge -t &
+ *      ws2812_sacn_send -n 1000
+ *
+ * usage: ws2812_sacn_send [-h host] [-p port] [-u first_universe] [-l leds] [-f fps]
+ *                         [-n frames] [-s sync_address] [-m]
+ *
+ *      -n          frames to send (default 0: until interrupted)
+ *      -s          synchronize every frame on this universe (default 0: unsynchronized)
+ *      -m          send each universe to its multicast group instead of host
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ws2812.hpp"
+#include "ws2812_e131.hpp"
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define DEFAULT_HOST                        "127.0.0.1"
+#define DEFAULT_FPS                         100
+#define TEST_LEDS                           (4 * ws2812::e131::pixels_per_universe)
+#define SOURCE_NAME                         "ws2812_sacn_send"
+
+/**************************************************************************************
+ * MAIN
+ **************************************************************************************/
+int main(int argc, char *argv[]) {
+    // function setup
+    const char *host = DEFAULT_HOST;
+    unsigned int leds = TEST_LEDS, fps = DEFAULT_FPS, frames = 0, universes, sent = 0;
+    std::uint16_t first = 1, port = ws2812::e131::port, sync = 0;
+    const std::uint8_t cid[16] = { 'w', 's', '2', '8', '1', '2' };
+    bool multicast = false;
+    std::uint8_t sequence = 0;
+    struct sockaddr_in unicast = {};
+    struct timespec next;
+    int opt, fd;
+
+    while ((opt = getopt(argc, argv, "h:p:u:l:f:n:s:m")) != -1) {
+        switch (opt) {
+            case 'h': host = optarg; break;
+            case 'p': port = static_cast<std::uint16_t>(std::strtoul(optarg, nullptr, 0)); break;
+            case 'u': first = static_cast<std::uint16_t>(std::strtoul(optarg, nullptr, 0)); break;
+            case 'l': leds = std::strtoul(optarg, nullptr, 0); break;
+            case 'f': fps = std::strtoul(optarg, nullptr, 0); break;
+            case 'n': frames = std::strtoul(optarg, nullptr, 0); break;
+            case 's': sync = static_cast<std::uint16_t>(std::strtoul(optarg, nullptr, 0)); break;
+            case 'm': multicast = true; break;
+            default:
+                std::fprintf(stderr, "usage: %s [-h host] [-p port] [-u first_universe] [-l leds] [-f fps] "
+                    "[-n frames] [-s sync_address] [-m]\n", argv[0]);
+                return 2;
+        }
+    }
+    unicast.sin_family = AF_INET;
+    unicast.sin_port = htons(port);
+    if (!leds || !fps || !first || inet_pton(AF_INET, host, &unicast.sin_addr) != 1) {
+        std::fprintf(stderr, "invalid setup: %u LEDs at %u fps from universe %u to %s\n", leds, fps, first, host);
+        return 2;
+    }
+    universes = (leds + ws2812::e131::pixels_per_universe - 1) / ws2812::e131::pixels_per_universe;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::perror("socket");
+        return 1;
+    }
+
+    // one message per universe plus the sync packet; the buffers are reused every frame
+    std::vector<ws2812::Hsv> hsv(leds);
+    std::vector<ws2812::Pixel> pixels(leds);
+    std::vector<std::vector<std::uint8_t>> packets(universes + 1,
+        std::vector<std::uint8_t>(ws2812::e131::max_packet_size));
+    std::vector<struct sockaddr_in> addrs(universes + 1, unicast);
+    std::vector<struct iovec> iovs(universes + 1);
+    std::vector<struct mmsghdr> msgs(universes + 1);
+    for (unsigned int i = 0; i <= universes; ++i) {
+        std::uint16_t u = static_cast<std::uint16_t>(i < universes ? first + i : sync);
+        if (multicast) {
+            addrs[i].sin_addr.s_addr = htonl(ws2812::e131::multicast_group(u));
+        }
+        iovs[i].iov_base = packets[i].data();
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!frames || sent < frames) {
+        // draw
+        for (unsigned int i = 0; i < leds; ++i) {
+            hsv[i] = { static_cast<std::uint8_t>(sent * 2 + i * 256 / leds), 255, 64 };
+        }
+        ws2812::from_hsv(hsv, pixels);
+
+        // packetize
+        for (unsigned int i = 0; i < universes; ++i) {
+            std::size_t offset = i * ws2812::e131::pixels_per_universe;
+            std::size_t count = std::min<std::size_t>(ws2812::e131::pixels_per_universe, leds - offset);
+            iovs[i].iov_len = ws2812::e131::build_data(packets[i].data(), cid, SOURCE_NAME,
+                static_cast<std::uint16_t>(first + i), sync, sequence,
+                { reinterpret_cast<const std::uint8_t *>(&pixels[offset]), count * sizeof(ws2812::Pixel) });
+        }
+        iovs[universes].iov_len = ws2812::e131::build_sync(packets[universes].data(), cid, sync, sequence);
+        ++sequence;
+
+        for (unsigned int done = 0, total = universes + (sync ? 1 : 0); done < total; ) {
+            int n = sendmmsg(fd, &msgs[done], total - done, 0);
+            if (n < 0) {
+                std::perror("sendmmsg");
+                return 1;
+            }
+            done += static_cast<unsigned int>(n);
+        }
+        ++sent;
+
+        // pace on absolute deadlines so the rate does not drift
+        next.tv_nsec += 1000000000 / fps;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            ++next.tv_sec;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) == EINTR) {
+        }
+    }
+
+    std::printf("sent %u frames of %u universes%s\n", sent, universes, sync ? " with sync" : "");
+    close(fd);
+    return 0;
+}
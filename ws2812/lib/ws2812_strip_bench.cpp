@@ -0,0 +1,210 @@
+/**
+ * ws2812_strip_bench
+ *
+ * Per-frame cost of libws2812 against the raw system calls it wraps, run on the
+ * target (or against /dev/null on a host, which times the library and syscall
+ * overhead without a driver). Every frame changes every LED. Writes one CSV row per
+ * method:
+ *
+ *      raw_write       - write() of the frame on a plain file descriptor
+ *      strip_write     - Strip::write()
+ *      queue           - FrameQueue acquire(), fill, push() and pump()
+ *      raw_commit      - WS2812_IOC_COMMIT after drawing into the mapping
+ *      strip_commit    - Strip::map() and Strip::commit()
+ *      rgba, hsv       - converting one frame into the device format
+ *
+ * overhead_ns is the difference to the raw call; mapping rows are skipped where
+ * the device cannot be mapped
+ *
+ * usage: ws2812_strip_bench [-d device] [-n frames] [-l leds]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ws2812.hpp"
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define DEFAULT_FRAMES                      10000
+#define DEFAULT_LEDS                        150
+#define WARMUP_FRAMES                       100
+
+/**************************************************************************************
+ * GLOBALS
+ **************************************************************************************/
+// keeps the converter loops from being optimized away
+static volatile std::uint8_t sink;
+
+/**************************************************************************************
+ * HELPER FUNCTIONS
+ **************************************************************************************/
+
+/**
+ * color()
+ *
+ * Color of LED i in frame f; shifts every frame so every LED changes
+ */
+static ws2812::Pixel color(unsigned int f, unsigned int i) {
+    return { static_cast<std::uint8_t>((f + i) * 7), static_cast<std::uint8_t>((f + i) * 13 + 85),
+        static_cast<std::uint8_t>((f + i) * 29 + 170) };
+}
+
+/**
+ * fill()
+ *
+ * Draw frame f
+ */
+static void fill(std::span<ws2812::Pixel> pixels, unsigned int f) {
+    for (unsigned int i = 0; i < pixels.size(); ++i) {
+        pixels[i] = color(f, i);
+    }
+}
+
+/**
+ * time_ns()
+ *
+ * Average nanoseconds per call of frame(f) over frames calls, after a warmup
+ */
+static double time_ns(unsigned int frames, const std::function<void(unsigned int)> &frame) {
+    for (unsigned int f = 0; f < WARMUP_FRAMES; ++f) {
+        frame(f);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int f = 0; f < frames; ++f) {
+        frame(f);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / frames;
+}
+
+/**
+ * report()
+ *
+ * One CSV row
+ */
+static void report(const char *method, unsigned int leds, unsigned int frames, double ns, double raw_ns) {
+    std::printf("%s,%u,%u,%.1f,%.1f\n", method, leds, frames, ns, raw_ns ? ns - raw_ns : 0.0);
+}
+
+/**************************************************************************************
+ * MAIN
+ **************************************************************************************/
+int main(int argc, char *argv[]) {
+    // function setup
+    const char *device = ws2812::default_device;
+    unsigned int frames = DEFAULT_FRAMES, leds = DEFAULT_LEDS;
+    std::vector<ws2812::Pixel> pixels;
+    std::vector<ws2812::Rgba> rgba;
+    std::vector<ws2812::Hsv> hsv;
+    double raw_ns;
+    int opt, fd;
+
+    while ((opt = getopt(argc, argv, "d:n:l:")) != -1) {
+        switch (opt) {
+            case 'd': device = optarg; break;
+            case 'n': frames = std::strtoul(optarg, nullptr, 0); break;
+            case 'l': leds = std::strtoul(optarg, nullptr, 0); break;
+            default:
+                std::fprintf(stderr, "usage: %s [-d device] [-n frames] [-l leds]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (!frames || !leds) {
+        std::fprintf(stderr, "need at least one frame and one LED\n");
+        return 2;
+    }
+
+    pixels.resize(leds);
+    rgba.resize(leds);
+    hsv.resize(leds);
+    std::printf("method,leds,frames,ns_per_frame,overhead_ns\n");
+
+    try {
+        // write path
+        fd = open(device, O_RDWR);
+        if (fd < 0) {
+            std::perror(device);
+            return 1;
+        }
+        raw_ns = time_ns(frames, [&](unsigned int f) {
+            fill(pixels, f);
+            if (write(fd, pixels.data(), leds * sizeof(ws2812::Pixel)) < 0) {
+                throw std::system_error(errno, std::generic_category(), "write");
+            }
+        });
+        report("raw_write", leds, frames, raw_ns, 0);
+
+        ws2812::Strip strip(leds, device);
+        report("strip_write", leds, frames, time_ns(frames, [&](unsigned int f) {
+            fill(pixels, f);
+            strip.write(pixels);
+        }), raw_ns);
+
+        ws2812::FrameQueue queue(strip, 2);
+        report("queue", leds, frames, time_ns(frames, [&](unsigned int f) {
+            ws2812::Frame frame = queue.acquire();
+            fill(frame.pixels(), f);
+            queue.push(std::move(frame));
+            queue.pump();
+        }), raw_ns);
+        queue.flush();
+
+        // mapping path
+        void *map = mmap(nullptr, static_cast<std::size_t>(sysconf(_SC_PAGESIZE)), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED || leds * sizeof(ws2812::Pixel) > static_cast<std::size_t>(sysconf(_SC_PAGESIZE))) {
+            std::fprintf(stderr, "mapping not available on %s; skipping commit rows\n", device);
+        } else {
+            std::span<ws2812::Pixel> raw_map(static_cast<ws2812::Pixel *>(map), leds);
+            raw_ns = time_ns(frames, [&](unsigned int f) {
+                fill(raw_map, f);
+                if (ioctl(fd, WS2812_IOC_COMMIT)) {
+                    throw std::system_error(errno, std::generic_category(), "WS2812_IOC_COMMIT");
+                }
+            });
+            report("raw_commit", leds, frames, raw_ns, 0);
+
+            std::span<ws2812::Pixel> strip_map = strip.map();
+            report("strip_commit", leds, frames, time_ns(frames, [&](unsigned int f) {
+                fill(strip_map, f);
+                strip.commit();
+            }), raw_ns);
+            munmap(map, static_cast<std::size_t>(sysconf(_SC_PAGESIZE)));
+        }
+        close(fd);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    // converters
+    for (unsigned int i = 0; i < leds; ++i) {
+        rgba[i] = { static_cast<std::uint8_t>(i * 7), static_cast<std::uint8_t>(i * 13),
+            static_cast<std::uint8_t>(i * 29), static_cast<std::uint8_t>(i * 3) };
+        hsv[i] = { static_cast<std::uint8_t>(i), 255, 128 };
+    }
+    report("rgba", leds, frames, time_ns(frames, [&](unsigned int f) {
+        rgba[f % leds].alpha = static_cast<std::uint8_t>(f);
+        ws2812::from_rgba(rgba, pixels);
+        sink = pixels[f % leds].red;
+    }), 0);
+    report("hsv", leds, frames, time_ns(frames, [&](unsigned int f) {
+        hsv[f % leds].hue = static_cast<std::uint8_t>(f);
+        ws2812::from_hsv(hsv, pixels);
+        sink = pixels[f % leds].red;
+    }), 0);
+    return 0;
+}
@@ -0,0 +1,381 @@
+/**
+ * encode_bench
+ *
+ * Host/target microbenchmark for the pixel -> PWM word encoders. Every implementation
+ * built for this CPU is first checked bit-for-bit against the scalar reference, then
+ * timed over a range of strip lengths, on random pixels and on solid bars (where the
+ * run-length encoder used for RLE frames is timed too). The remap column is the
+ * matrix layout path, encoding through a serpentine wiring table. The multi-strip
+ * transposes used by the parallel GPIO output are checked the same way, for every
+ * strip count, and timed at WS2812_MAX_STRIPS strips (ns per LED of every strip).
+ *
+ * usage: encode_bench [-i iterations] [leds ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../ws2812_encode.h"
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define DEFAULT_ITERATIONS                  2000
+#define VERIFY_MAX_LEDS                     67
+#define BAR_LEDS                            10
+#define REMAP_MAX_LEDS                      65536
+#define REMAP_ROW_LEDS                      16
+
+/**************************************************************************************
+ * GLOBALS
+ **************************************************************************************/
+// wiring table used by the remap column; identity while verifying
+static uint16_t remap_table[REMAP_MAX_LEDS];
+
+/**************************************************************************************
+ * HELPER FUNCTIONS
+ **************************************************************************************/
+
+/**
+ * now_ns()
+ *
+ * Monotonic timestamp in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * fill_random()
+ *
+ * Fill a strip with pseudo-random colors (fixed seed, so runs are comparable)
+ */
+static void fill_random(led_t *leds, size_t n, unsigned int seed) {
+    srand(seed);
+    for (size_t i = 0; i < n; ++i) {
+        leds[i].red = (uint8_t)rand();
+        leds[i].green = (uint8_t)rand();
+        leds[i].blue = (uint8_t)rand();
+    }
+}
+
+/**
+ * fill_bars()
+ *
+ * Fill a strip with solid bars of BAR_LEDS LEDs
+ */
+static void fill_bars(led_t *leds, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        leds[i].red = (uint8_t)((i / BAR_LEDS) * 40);
+        leds[i].green = (uint8_t)((i / BAR_LEDS) * 90);
+        leds[i].blue = (uint8_t)((i / BAR_LEDS) * 15);
+    }
+}
+
+/**
+ * fill_remap()
+ *
+ * Identity wiring, or serpentine rows of REMAP_ROW_LEDS
+ */
+static void fill_remap(int serpentine) {
+    for (size_t i = 0; i < REMAP_MAX_LEDS; ++i) {
+        size_t row = i / REMAP_ROW_LEDS, col = i % REMAP_ROW_LEDS;
+        remap_table[i] = (uint16_t)(serpentine && (row & 1) ? row * REMAP_ROW_LEDS + REMAP_ROW_LEDS - 1 - col : i);
+    }
+}
+
+/**
+ * encode_remap()
+ *
+ * ws2812_encode_remap() through remap_table, in the implementation signature
+ */
+static void encode_remap(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n) {
+    ws2812_encode_remap(enc, out, leds, remap_table, n);
+}
+
+/**
+ * verify()
+ *
+ * Compare an implementation against the scalar reference for every length up to
+ * VERIFY_MAX_LEDS (covers the vector body and every tail length), with random,
+ * all-zero, all-one and solid bar patterns. Also checks nothing is written past
+ * the end.
+ */
+static int verify(const struct ws2812_encoder *enc, const struct ws2812_encode_impl *impl) {
+    // function setup
+    led_t leds[VERIFY_MAX_LEDS];
+    uint32_t expect[VERIFY_MAX_LEDS * WS2812_WORDS_PER_LED + 1];
+    uint32_t got[VERIFY_MAX_LEDS * WS2812_WORDS_PER_LED + 1];
+    size_t words;
+
+    for (int pattern = 0; pattern < 4; ++pattern) {
+        if (pattern == 0) {
+            fill_random(leds, VERIFY_MAX_LEDS, 1);
+        } else if (pattern == 3) {
+            fill_bars(leds, VERIFY_MAX_LEDS);
+        } else {
+            memset(leds, pattern == 1 ? 0x00 : 0xFF, sizeof(leds));
+        }
+
+        for (size_t n = 0; n <= VERIFY_MAX_LEDS; ++n) {
+            words = n * WS2812_WORDS_PER_LED;
+            memset(expect, 0xA5, sizeof(expect));
+            memset(got, 0xA5, sizeof(got));
+            ws2812_encode_scalar(enc, expect, leds, n);
+            impl->encode(enc, got, leds, n);
+            if (memcmp(expect, got, (words + 1) * sizeof(uint32_t))) {
+                for (size_t w = 0; w <= words; ++w) {
+                    if (expect[w] != got[w]) {
+                        fprintf(stderr, "%s: mismatch (pattern %d, %zu leds) at word %zu: 0x%08X != 0x%08X\n",
+                            impl->name, pattern, n, w, got[w], expect[w]);
+                        break;
+                    }
+                }
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * verify_transpose()
+ *
+ * Compare a multi-strip transpose against the scalar reference for every strip
+ * count and every length up to VERIFY_MAX_LEDS, at two GPIO shifts
+ */
+static int verify_transpose(const struct ws2812_transpose_impl *impl) {
+    // function setup
+    static led_t leds[WS2812_MAX_STRIPS * VERIFY_MAX_LEDS];
+    static uint32_t expect[VERIFY_MAX_LEDS * WS2812_WORDS_PER_LED + 1];
+    static uint32_t got[VERIFY_MAX_LEDS * WS2812_WORDS_PER_LED + 1];
+    static const unsigned int shifts[] = { 0, 12 };
+
+    fill_random(leds, WS2812_MAX_STRIPS * VERIFY_MAX_LEDS, 3);
+    for (unsigned int strips = 1; strips <= WS2812_MAX_STRIPS; ++strips) {
+        for (size_t sh = 0; sh < sizeof(shifts) / sizeof(shifts[0]); ++sh) {
+            for (size_t n = 0; n <= VERIFY_MAX_LEDS; ++n) {
+                memset(expect, 0xA5, sizeof(expect));
+                memset(got, 0xA5, sizeof(got));
+                ws2812_transpose_scalar(expect, leds, VERIFY_MAX_LEDS, strips, n, shifts[sh]);
+                impl->transpose(got, leds, VERIFY_MAX_LEDS, strips, n, shifts[sh]);
+                for (size_t w = 0; w <= n * WS2812_WORDS_PER_LED; ++w) {
+                    if (expect[w] != got[w]) {
+                        fprintf(stderr, "%s: mismatch (%u strips, shift %u, %zu leds) at word %zu: 0x%08X != 0x%08X\n",
+                            impl->name, strips, shifts[sh], n, w, got[w], expect[w]);
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * bench_transpose()
+ *
+ * Time one transpose on WS2812_MAX_STRIPS strips of n LEDs; returns ns per LED
+ */
+static double bench_transpose(const struct ws2812_transpose_impl *impl, uint32_t *out, const led_t *leds, size_t n,
+    int iterations) {
+    // function setup
+    uint64_t start, elapsed;
+
+    for (int i = 0; i < iterations / 10 + 1; ++i) {
+        impl->transpose(out, leds, n, WS2812_MAX_STRIPS, n, 0);
+    }
+
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        impl->transpose(out, leds, n, WS2812_MAX_STRIPS, n, 0);
+        __asm__ __volatile__("" : : "r"(out) : "memory");
+    }
+    elapsed = now_ns() - start;
+
+    return (double)elapsed / ((double)iterations * (double)n * WS2812_MAX_STRIPS);
+}
+
+/**
+ * bench()
+ *
+ * Time one implementation on a strip of n LEDs; returns ns per LED
+ */
+static double bench(const struct ws2812_encoder *enc, const struct ws2812_encode_impl *impl,
+                    uint32_t *out, const led_t *leds, size_t n, int iterations) {
+    // function setup
+    uint64_t start, elapsed;
+
+    // warm up caches and branch predictors
+    for (int i = 0; i < iterations / 10 + 1; ++i) {
+        impl->encode(enc, out, leds, n);
+    }
+
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        impl->encode(enc, out, leds, n);
+        __asm__ __volatile__("" : : "r"(out) : "memory");
+    }
+    elapsed = now_ns() - start;
+
+    return (double)elapsed / ((double)iterations * (double)n);
+}
+
+/**************************************************************************************
+ * MAIN
+ **************************************************************************************/
+int main(int argc, char **argv) {
+    // function setup
+    static const size_t default_leds[] = { 16, 100, 300, 1000, 4096 };
+    static struct ws2812_encoder enc;
+    static const struct ws2812_encode_impl runs_impl = { .name = "runs", .encode = ws2812_encode_runs };
+    static const struct ws2812_encode_impl remap_impl = { .name = "remap", .encode = encode_remap };
+    const struct ws2812_encode_impl *impl;
+    const struct ws2812_transpose_impl *timpl;
+    size_t led_counts[32];
+    int num_counts = 0;
+    int iterations = DEFAULT_ITERATIONS;
+    int failed = 0;
+    int opt;
+
+    // parse arguments
+    while ((opt = getopt(argc, argv, "i:h")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i iterations] [leds ...]\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    for (; optind < argc && num_counts < 32; ++optind) {
+        led_counts[num_counts++] = strtoul(argv[optind], NULL, 0);
+        if (led_counts[num_counts - 1] > REMAP_MAX_LEDS) {
+            fprintf(stderr, "at most %d leds\n", REMAP_MAX_LEDS);
+            return 1;
+        }
+    }
+    if (num_counts == 0) {
+        for (size_t i = 0; i < sizeof(default_leds) / sizeof(default_leds[0]); ++i) {
+            led_counts[num_counts++] = default_leds[i];
+        }
+    }
+
+    ws2812_encoder_init(&enc, WS2812_T0H_TICKS, WS2812_T1H_TICKS);
+    printf("default implementation: %s\n", enc.name);
+
+    // verify every implementation against the reference first
+    for (impl = &ws2812_encode_impls[0]; impl->name; ++impl) {
+        if (!ws2812_encode_impl_usable(impl)) {
+            printf("%-8s skipped (not supported by this CPU)\n", impl->name);
+            continue;
+        }
+        if (verify(&enc, impl)) {
+            failed = 1;
+        } else {
+            printf("%-8s bit-exact\n", impl->name);
+        }
+    }
+    if (failed) {
+        return 1;
+    }
+
+    // the run-length encoder is checked the same way
+    if (verify(&enc, &runs_impl)) {
+        return 1;
+    }
+    printf("%-8s bit-exact\n", runs_impl.name);
+
+    // so is the remap path, through an identity table
+    fill_remap(0);
+    if (verify(&enc, &remap_impl)) {
+        return 1;
+    }
+    printf("%-8s bit-exact\n", remap_impl.name);
+    fill_remap(1);
+
+    // and every multi-strip transpose
+    for (timpl = &ws2812_transpose_impls[1]; timpl->name; ++timpl) {
+        if (verify_transpose(timpl)) {
+            return 1;
+        }
+        printf("%-8s transpose bit-exact\n", timpl->name);
+    }
+
+    // time every implementation, on random pixels and then on solid bars
+    for (int pattern = 0; pattern < 2; ++pattern) {
+        printf("\n%s\n%8s", pattern ? "solid bars" : "random pixels", "leds");
+        for (impl = &ws2812_encode_impls[0]; impl->name; ++impl) {
+            if (ws2812_encode_impl_usable(impl)) {
+                printf(" %10s", impl->name);
+            }
+        }
+        printf(" %10s %10s   (ns/LED)\n", runs_impl.name, remap_impl.name);
+
+        for (int c = 0; c < num_counts; ++c) {
+            size_t n = led_counts[c];
+            led_t *leds = malloc(n * sizeof(*leds));
+            uint32_t *out = malloc(n * WS2812_WORDS_PER_LED * sizeof(*out));
+            if (!leds || !out || n == 0) {
+                fprintf(stderr, "cannot benchmark %zu leds\n", n);
+                free(leds);
+                free(out);
+                return 1;
+            }
+            if (pattern) {
+                fill_bars(leds, n);
+            } else {
+                fill_random(leds, n, 2);
+            }
+
+            printf("%8zu", n);
+            for (impl = &ws2812_encode_impls[0]; impl->name; ++impl) {
+                if (ws2812_encode_impl_usable(impl)) {
+                    printf(" %10.2f", bench(&enc, impl, out, leds, n, iterations));
+                }
+            }
+            printf(" %10.2f", bench(&enc, &runs_impl, out, leds, n, iterations));
+            printf(" %10.2f\n", bench(&enc, &remap_impl, out, leds, n, iterations));
+
+            free(leds);
+            free(out);
+        }
+    }
+
+    // multi-strip transposes, on random pixels
+    printf("\n%u strips\n%8s", WS2812_MAX_STRIPS, "leds");
+    for (timpl = &ws2812_transpose_impls[0]; timpl->name; ++timpl) {
+        printf(" %10s", timpl->name);
+    }
+    printf("   (ns/LED)\n");
+    for (int c = 0; c < num_counts; ++c) {
+        size_t n = led_counts[c];
+        led_t *leds = malloc(n * WS2812_MAX_STRIPS * sizeof(*leds));
+        uint32_t *out = malloc(n * WS2812_WORDS_PER_LED * sizeof(*out));
+        if (!leds || !out) {
+            fprintf(stderr, "cannot benchmark %zu leds\n", n);
+            free(leds);
+            free(out);
+            return 1;
+        }
+        fill_random(leds, n * WS2812_MAX_STRIPS, 4);
+
+        printf("%8zu", n);
+        for (timpl = &ws2812_transpose_impls[0]; timpl->name; ++timpl) {
+            printf(" %10.2f", bench_transpose(timpl, out, leds, n, iterations));
+        }
+        printf("\n");
+
+        free(leds);
+        free(out);
+    }
+
+    return 0;
+}
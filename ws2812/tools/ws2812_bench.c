@@ -0,0 +1,465 @@
+/**
+ * ws2812_bench
+ *
+ * Throughput/latency benchmark for /dev/ws2812, run on the target. Sweeps strip
+ * length, write format and submission method, pushing frames that change every LED
+ * so every segment is re-encoded, and writes one CSV row per combination:
+ *
+ *      syscall latency percentiles, achieved fps, CPU time per frame, and the
+ *      driver's own frame timing report (WS2812_IOC_GET_TIMING)
+ *
+ * Submission methods:
+ *      write   - blocking write() of the whole frame
+ *      mmap    - draw into the mmap()ed layer buffer, then WS2812_IOC_COMMIT (RGB only)
+ *      queued  - O_NONBLOCK write(), waiting in poll() for POLLOUT when the driver
+ *                pushes back
+ *
+ * usage: ws2812_bench [-d device] [-n frames] [-l leds,...] [-f formats] [-m methods]
+ *                     [-t label] [-o file.csv]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../ws2812_encode.h"
+#include "../ws2812_ioctl.h"
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define DEFAULT_DEVICE                      "/dev/ws2812"
+#define DEFAULT_FRAMES                      500
+#define WARMUP_FRAMES                       10
+#define MAX_LEDS                            4096
+#define MAX_SWEEP                           32
+#define RUN_LEDS                            5
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+typedef enum {
+    METHOD_WRITE,
+    METHOD_MMAP,
+    METHOD_QUEUED,
+} method_t;
+
+/**
+ * struct bench_config
+ *
+ * One point of the sweep
+ */
+struct bench_config {
+    unsigned int leds;
+    __u32 format;
+    method_t method;
+};
+
+/**
+ * struct bench_result
+ *
+ * Measurements for one point of the sweep; latencies in microseconds
+ */
+struct bench_result {
+    unsigned int frames;
+    double fps;
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double max_us;
+    double cpu_us_per_frame;
+    struct ws2812_timing timing;
+};
+
+/**************************************************************************************
+ * GLOBALS
+ **************************************************************************************/
+static const char *format_names[] = { "rgb", "rle", "indexed" };
+static const char *method_names[] = { "write", "mmap", "queued" };
+
+/**************************************************************************************
+ * HELPER FUNCTIONS
+ **************************************************************************************/
+
+/**
+ * now_ns()
+ *
+ * Monotonic timestamp in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * cpu_us()
+ *
+ * User plus system CPU time consumed by this process, in microseconds
+ */
+static double cpu_us(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/**
+ * lookup()
+ *
+ * Index of name in a table of names, or -1
+ */
+static int lookup(const char *name, const char **names, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (!strcmp(name, names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * compare_u64()
+ *
+ * qsort() comparator for latencies
+ */
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * percentile_us()
+ *
+ * Nearest-rank percentile of sorted nanosecond samples, in microseconds
+ */
+static double percentile_us(const uint64_t *sorted, unsigned int n, double p) {
+    unsigned int rank = (unsigned int)(p / 100.0 * n + 0.5);
+    return sorted[rank ? rank - 1 : 0] / 1000.0;
+}
+
+/**
+ * color()
+ *
+ * Color of LED i in frame f; shifts every frame so every LED changes
+ */
+static led_t color(unsigned int f, unsigned int i) {
+    led_t led = {
+        .red = (uint8_t)((f + i) * 7),
+        .green = (uint8_t)((f + i) * 13 + 85),
+        .blue = (uint8_t)((f + i) * 29 + 170),
+    };
+    return led;
+}
+
+/**
+ * build_frame()
+ *
+ * Fill buf with frame f in the given format; returns the number of bytes to write
+ */
+static size_t build_frame(void *buf, __u32 format, unsigned int leds, unsigned int f) {
+    // function setup
+    led_t *pixels = buf;
+    struct ws2812_rle_run *runs = buf;
+    uint8_t *indices = buf;
+    unsigned int n = 0;
+
+    switch (format) {
+        case WS2812_FORMAT_RLE:
+            // solid bars that change color every frame
+            for (unsigned int i = 0; i < leds; i += RUN_LEDS, ++n) {
+                led_t c = color(f, i / RUN_LEDS);
+                runs[n].count = (__u8)(leds - i < RUN_LEDS ? leds - i : RUN_LEDS);
+                runs[n].red = c.red;
+                runs[n].green = c.green;
+                runs[n].blue = c.blue;
+            }
+            return n * sizeof(*runs);
+
+        case WS2812_FORMAT_INDEXED:
+            for (unsigned int i = 0; i < leds; ++i) {
+                indices[i] = (uint8_t)(f + i);
+            }
+            return leds;
+
+        default:
+            for (unsigned int i = 0; i < leds; ++i) {
+                pixels[i] = color(f, i);
+            }
+            return leds * sizeof(*pixels);
+    }
+}
+
+/**
+ * submit()
+ *
+ * Push one frame with the given method
+ */
+static int submit(int fd, method_t method, const void *buf, size_t len) {
+    // function setup
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    ssize_t written;
+
+    switch (method) {
+        case METHOD_MMAP:
+            return ioctl(fd, WS2812_IOC_COMMIT);
+
+        case METHOD_QUEUED:
+            for (;;) {
+                written = write(fd, buf, len);
+                if (written >= 0 || errno != EAGAIN) {
+                    break;
+                }
+                if (poll(&pfd, 1, -1) < 0) {
+                    return -1;
+                }
+            }
+            return written == (ssize_t)len ? 0 : -1;
+
+        default:
+            return write(fd, buf, len) == (ssize_t)len ? 0 : -1;
+    }
+}
+
+/**
+ * run()
+ *
+ * Benchmark one configuration; returns 1 if the combination is not supported
+ */
+static int run(const char *device, const struct bench_config *cfg, unsigned int frames, struct bench_result *result) {
+    // function setup
+    struct ws2812_layer_config layer = { .num_leds = cfg->leds, .alpha = 255, .blend = WS2812_BLEND_OVER };
+    static struct ws2812_palette palette;
+    static uint8_t frame[MAX_LEDS * sizeof(led_t)];
+    uint64_t *latency = NULL;
+    led_t *map = MAP_FAILED;
+    size_t map_len = 0, len = 0;
+    uint64_t start = 0, elapsed;
+    double cpu_start = 0;
+    int retval = -1;
+    int fd;
+
+    // mmap always takes RGB pixels
+    if (cfg->method == METHOD_MMAP && cfg->format != WS2812_FORMAT_RGB) {
+        return 1;
+    }
+
+    fd = open(device, O_RDWR | (cfg->method == METHOD_QUEUED ? O_NONBLOCK : 0));
+    if (fd < 0) {
+        perror(device);
+        return -1;
+    }
+
+    // one full-strip layer per run
+    if (ioctl(fd, WS2812_IOC_SET_LAYER, &layer) || ioctl(fd, WS2812_IOC_SET_FORMAT, &cfg->format)) {
+        perror("layer setup");
+        goto out;
+    }
+    if (cfg->format == WS2812_FORMAT_INDEXED) {
+        palette.first = 0;
+        palette.count = WS2812_PALETTE_SIZE;
+        for (unsigned int i = 0; i < WS2812_PALETTE_SIZE; ++i) {
+            led_t c = color(0, i);
+            palette.entries[i].red = c.red;
+            palette.entries[i].green = c.green;
+            palette.entries[i].blue = c.blue;
+        }
+        if (ioctl(fd, WS2812_IOC_SET_PALETTE, &palette)) {
+            perror("WS2812_IOC_SET_PALETTE");
+            goto out;
+        }
+    }
+    if (cfg->method == METHOD_MMAP) {
+        map_len = (size_t)sysconf(_SC_PAGESIZE);
+        map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            goto out;
+        }
+        if (cfg->leds * sizeof(led_t) > map_len) {
+            retval = 1;
+            goto out;
+        }
+    }
+
+    latency = calloc(frames, sizeof(*latency));
+    if (!latency) {
+        goto out;
+    }
+
+    // warm up, then measure
+    for (unsigned int f = 0; f < WARMUP_FRAMES + frames; ++f) {
+        if (f == WARMUP_FRAMES) {
+            cpu_start = cpu_us();
+            start = now_ns();
+        }
+
+        len = build_frame(cfg->method == METHOD_MMAP ? (void *)map : frame, cfg->format, cfg->leds, f);
+
+        elapsed = now_ns();
+        if (submit(fd, cfg->method, frame, len)) {
+            perror(method_names[cfg->method]);
+            goto out;
+        }
+        if (f >= WARMUP_FRAMES) {
+            latency[f - WARMUP_FRAMES] = now_ns() - elapsed;
+        }
+    }
+    elapsed = now_ns() - start;
+    result->cpu_us_per_frame = (cpu_us() - cpu_start) / frames;
+
+    if (ioctl(fd, WS2812_IOC_GET_TIMING, &result->timing)) {
+        memset(&result->timing, 0, sizeof(result->timing));
+    }
+
+    // summarize
+    qsort(latency, frames, sizeof(*latency), compare_u64);
+    result->frames = frames;
+    result->fps = frames * 1e9 / elapsed;
+    result->p50_us = percentile_us(latency, frames, 50);
+    result->p90_us = percentile_us(latency, frames, 90);
+    result->p99_us = percentile_us(latency, frames, 99);
+    result->max_us = latency[frames - 1] / 1000.0;
+    retval = 0;
+
+out:
+    free(latency);
+    if (map != MAP_FAILED) {
+        munmap(map, map_len);
+    }
+    close(fd);
+    return retval;
+}
+
+/**
+ * parse_list()
+ *
+ * Split a comma-separated list into a table of names (or numbers when names is NULL)
+ */
+static int parse_list(char *arg, const char **names, int count, unsigned int *out) {
+    // function setup
+    int n = 0;
+    int index;
+
+    for (char *tok = strtok(arg, ","); tok && n < MAX_SWEEP; tok = strtok(NULL, ",")) {
+        if (!names) {
+            out[n++] = strtoul(tok, NULL, 0);
+            continue;
+        }
+        index = lookup(tok, names, count);
+        if (index < 0) {
+            fprintf(stderr, "unknown value \"%s\"\n", tok);
+            return -1;
+        }
+        out[n++] = index;
+    }
+
+    return n;
+}
+
+/**************************************************************************************
+ * MAIN
+ **************************************************************************************/
+int main(int argc, char **argv) {
+    // function setup
+    const char *device = DEFAULT_DEVICE;
+    const char *label = "";
+    unsigned int frames = DEFAULT_FRAMES;
+    unsigned int leds[MAX_SWEEP] = { 10, 50, 100 };
+    unsigned int formats[MAX_SWEEP] = { WS2812_FORMAT_RGB, WS2812_FORMAT_RLE, WS2812_FORMAT_INDEXED };
+    unsigned int methods[MAX_SWEEP] = { METHOD_WRITE, METHOD_MMAP, METHOD_QUEUED };
+    int num_leds = 3, num_formats = 3, num_methods = 3;
+    struct bench_config cfg;
+    struct bench_result result;
+    FILE *csv = stdout;
+    int failed = 0;
+    int opt;
+
+    // parse arguments
+    while ((opt = getopt(argc, argv, "d:n:l:f:m:t:o:h")) != -1) {
+        switch (opt) {
+            case 'd':
+                device = optarg;
+                break;
+            case 'n':
+                frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'l':
+                num_leds = parse_list(optarg, NULL, 0, leds);
+                break;
+            case 'f':
+                num_formats = parse_list(optarg, format_names, 3, formats);
+                break;
+            case 'm':
+                num_methods = parse_list(optarg, method_names, 3, methods);
+                break;
+            case 't':
+                label = optarg;
+                break;
+            case 'o':
+                csv = fopen(optarg, "w");
+                if (!csv) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d device] [-n frames] [-l leds,...] [-f rgb,rle,indexed]\n"
+                    "       [-m write,mmap,queued] [-t label] [-o file.csv]\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (num_leds <= 0 || num_formats <= 0 || num_methods <= 0 || frames == 0) {
+        fprintf(stderr, "nothing to run\n");
+        return 1;
+    }
+
+    fprintf(csv, "label,leds,format,method,frames,fps,p50_us,p90_us,p99_us,max_us,cpu_us_per_frame,"
+        "strip_leds,frame_ns,latch_ns,max_fps,driver_fps\n");
+
+    // sweep
+    for (int l = 0; l < num_leds; ++l) {
+        for (int f = 0; f < num_formats; ++f) {
+            for (int m = 0; m < num_methods; ++m) {
+                cfg.leds = leds[l];
+                cfg.format = formats[f];
+                cfg.method = methods[m];
+                if (cfg.leds == 0 || cfg.leds > MAX_LEDS) {
+                    fprintf(stderr, "skipping %u leds\n", cfg.leds);
+                    continue;
+                }
+
+                switch (run(device, &cfg, frames, &result)) {
+                    case 0:
+                        break;
+                    case 1:
+                        continue;
+                    default:
+                        fprintf(stderr, "%u leds, %s, %s failed\n", cfg.leds, format_names[cfg.format],
+                            method_names[cfg.method]);
+                        failed = 1;
+                        continue;
+                }
+
+                fprintf(csv, "%s,%u,%s,%s,%u,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%u,%u,%u,%.3f,%.3f\n",
+                    label, cfg.leds, format_names[cfg.format], method_names[cfg.method], result.frames,
+                    result.fps, result.p50_us, result.p90_us, result.p99_us, result.max_us,
+                    result.cpu_us_per_frame, result.timing.num_leds, result.timing.frame_ns,
+                    result.timing.latch_ns, result.timing.max_fps_milli / 1000.0,
+                    result.timing.achieved_fps_milli / 1000.0);
+                fflush(csv);
+            }
+        }
+    }
+
+    if (csv != stdout) {
+        fclose(csv);
+    }
+    return failed;
+}
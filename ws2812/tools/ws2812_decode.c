@@ -0,0 +1,564 @@
+/**
+ * ws2812_decode
+ *
+ * Replays a DMA dump (see ws2812_dump.h) the way the PWM would play it: walks the
+ * control block chain from first_cb, turns every FIFO word into a HIGH/LOW pulse
+ * using the PWM clock and range, checks each pulse against the chip's high and low
+ * times and the reset (latch) time, and decodes the bits back into GRB pixels.
+ *
+ * With -s it needs no hardware at all: every encoder built for this CPU is used to
+ * produce a dump laid out like the driver's (segment blocks plus a latch block),
+ * which is then decoded and compared with the input pixels.
+ *
+ * usage: ws2812_decode [-v] [-t tolerance_ns] [-e expected.rgb] dump.bin
+ *        ws2812_decode -s [-t tolerance_ns]
+ *
+ * Dumps come from the driver with
+ *        cat /sys/kernel/debug/ws2812/dma > dump.bin
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../ws2812_encode.h"
+#include "../ws2812_dump.h"
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+// WS2812-family bit period and the datasheet tolerance on every high/low time
+#define BIT_NS                              1250
+#define DEFAULT_TOLERANCE_NS                150
+
+// self test layout
+#define SELFTEST_CLOCK_HZ                   80000000
+#define SELFTEST_CB_ADDR                    0x00001000
+#define SELFTEST_BUFFER_ADDR                0x00100000
+#define SELFTEST_SEGMENT_LEDS               10
+#define SELFTEST_T0H_NS                     400
+#define SELFTEST_T1H_NS                     800
+#define SELFTEST_RESET_NS                   280000
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+/**
+ * struct dump_view
+ *
+ * A parsed dump; points into the loaded file
+ */
+struct dump_view {
+    const struct ws2812_dump_header *hdr;
+    const struct ws2812_dump_cb *cbs;
+    const uint8_t *buffer;
+};
+
+/**
+ * struct decoder
+ *
+ * Pulse-by-pulse decoder state. A pulse is one non-zero word's HIGH time plus all
+ * the LOW time that follows it, including any all-LOW (zero) words after it
+ */
+struct decoder {
+    // timing
+    const struct ws2812_dump_header *hdr;
+    double tick_ns;
+    double tolerance_ns;
+
+    // pending pulse
+    int have_pulse;
+    double high_ns;
+    double low_ns;
+
+    // current frame
+    unsigned int bits;
+    uint8_t grb[WS2812_BYTES_PER_LED];
+
+    // results
+    led_t *pixels;
+    size_t num_pixels;
+    size_t max_pixels;
+    unsigned int frames;
+    unsigned int errors;
+    double margin_ns;
+    double latch_ns;
+    int verbose;
+};
+
+/**************************************************************************************
+ * DECODER
+ **************************************************************************************/
+
+/**
+ * decode_error()
+ *
+ * Report a timing or framing error; only the first few are printed
+ */
+static void decode_error(struct decoder *dec, const char *what, double value_ns) {
+    if (dec->errors++ < 10) {
+        fprintf(stderr, "bit %u of frame %u: %s (%.1f ns)\n", dec->bits, dec->frames, what, value_ns);
+    }
+}
+
+/**
+ * end_frame()
+ *
+ * A latch was seen; the bits so far form a frame
+ */
+static void end_frame(struct decoder *dec) {
+    if (dec->bits % (WS2812_WORDS_PER_LED)) {
+        decode_error(dec, "frame is not a whole number of LEDs", dec->bits);
+    }
+    if (dec->verbose) {
+        printf("frame %u: %u bits, latch %.1f ns\n", dec->frames, dec->bits, dec->low_ns);
+    }
+    if (dec->frames == 0 || dec->low_ns < dec->latch_ns) {
+        dec->latch_ns = dec->low_ns;
+    }
+    dec->bits = 0;
+    ++dec->frames;
+}
+
+/**
+ * check_time()
+ *
+ * Check a measured time against its nominal value and track the worst margin
+ */
+static int check_time(struct decoder *dec, double measured, double nominal) {
+    // function setup
+    double margin = dec->tolerance_ns - (measured > nominal ? measured - nominal : nominal - measured);
+
+    if (margin < dec->margin_ns) {
+        dec->margin_ns = margin;
+    }
+    return margin >= 0;
+}
+
+/**
+ * finish_pulse()
+ *
+ * Classify the pending pulse as a 0 or 1 bit by its high time, check its low time
+ * (or, if it is followed by a reset, the reset time), and shift it into the frame
+ */
+static void finish_pulse(struct decoder *dec) {
+    // function setup
+    const struct ws2812_dump_header *hdr = dec->hdr;
+    int one, latch;
+    double nominal_high;
+
+    if (!dec->have_pulse) {
+        return;
+    }
+    dec->have_pulse = 0;
+    one = (dec->high_ns - hdr->t0h_ns) > (hdr->t1h_ns - dec->high_ns);
+    nominal_high = one ? hdr->t1h_ns : hdr->t0h_ns;
+    latch = dec->low_ns >= hdr->reset_ns;
+
+    // timing
+    if (!check_time(dec, dec->high_ns, nominal_high)) {
+        decode_error(dec, one ? "T1H out of tolerance" : "T0H out of tolerance", dec->high_ns);
+    }
+    if (!latch && !check_time(dec, dec->low_ns, BIT_NS - nominal_high)) {
+        decode_error(dec, dec->low_ns > BIT_NS ? "LOW gap too long for a bit, too short for a reset" :
+            (one ? "T1L out of tolerance" : "T0L out of tolerance"), dec->low_ns);
+    }
+
+    // shift in, MSB first; every 3 bytes is one LED in GRB order
+    dec->grb[(dec->bits / WS2812_BITS_PER_BYTE) % WS2812_BYTES_PER_LED] =
+        (uint8_t)(dec->grb[(dec->bits / WS2812_BITS_PER_BYTE) % WS2812_BYTES_PER_LED] << 1) | one;
+    ++dec->bits;
+    if (dec->bits % WS2812_WORDS_PER_LED == 0) {
+        if (dec->num_pixels == dec->max_pixels) {
+            dec->max_pixels = dec->max_pixels ? 2 * dec->max_pixels : 256;
+            dec->pixels = realloc(dec->pixels, dec->max_pixels * sizeof(led_t));
+            if (!dec->pixels) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        dec->pixels[dec->num_pixels].green = dec->grb[0];
+        dec->pixels[dec->num_pixels].red = dec->grb[1];
+        dec->pixels[dec->num_pixels].blue = dec->grb[2];
+        ++dec->num_pixels;
+    }
+
+    if (latch) {
+        end_frame(dec);
+    }
+}
+
+/**
+ * decode_word()
+ *
+ * Play one FIFO word; in M/S mode the line is HIGH for word ticks, then LOW for the
+ * rest of the range
+ */
+static void decode_word(struct decoder *dec, uint32_t word) {
+    // function setup
+    double period_ns = dec->hdr->pwm_range * dec->tick_ns;
+
+    if (word > dec->hdr->pwm_range) {
+        decode_error(dec, "word exceeds the PWM range; line never goes LOW", word);
+        word = dec->hdr->pwm_range;
+    }
+
+    // an all-LOW word extends the LOW time of the pending pulse
+    if (word == 0) {
+        if (dec->have_pulse) {
+            dec->low_ns += period_ns;
+        }
+        return;
+    }
+
+    finish_pulse(dec);
+    dec->have_pulse = 1;
+    dec->high_ns = word * dec->tick_ns;
+    dec->low_ns = period_ns - dec->high_ns;
+}
+
+/**
+ * parse_dump()
+ *
+ * Validate a dump and point a view into it
+ */
+static int parse_dump(const uint8_t *data, size_t len, struct dump_view *view) {
+    // function setup
+    const struct ws2812_dump_header *hdr = (const struct ws2812_dump_header *)data;
+
+    if (len < sizeof(*hdr) || hdr->magic != WS2812_DUMP_MAGIC || hdr->version != WS2812_DUMP_VERSION) {
+        fprintf(stderr, "not a ws2812 DMA dump\n");
+        return -1;
+    }
+    if (len < sizeof(*hdr) + hdr->num_cbs * sizeof(struct ws2812_dump_cb) + hdr->buffer_len) {
+        fprintf(stderr, "truncated dump\n");
+        return -1;
+    }
+    if (!hdr->pwm_clock_hz || !hdr->pwm_range || hdr->t1h_ns <= hdr->t0h_ns) {
+        fprintf(stderr, "invalid timing in dump header\n");
+        return -1;
+    }
+
+    view->hdr = hdr;
+    view->cbs = (const struct ws2812_dump_cb *)(data + sizeof(*hdr));
+    view->buffer = data + sizeof(*hdr) + hdr->num_cbs * sizeof(struct ws2812_dump_cb);
+    return 0;
+}
+
+/**
+ * walk()
+ *
+ * Play one pass of the control block chain through the decoder; a pass ends when
+ * the chain loops back to first_cb or ends with a nextconbk of 0
+ */
+static int walk(const struct dump_view *view, struct decoder *dec) {
+    // function setup
+    const struct ws2812_dump_header *hdr = view->hdr;
+    uint32_t addr = hdr->first_cb;
+    const struct ws2812_dump_cb *cb;
+    uint32_t offset, words;
+
+    for (unsigned int steps = 0; ; ++steps) {
+        // locate the block
+        if (addr < hdr->cb_addr || (addr - hdr->cb_addr) % sizeof(*cb) ||
+            (addr - hdr->cb_addr) / sizeof(*cb) >= hdr->num_cbs || steps >= hdr->num_cbs) {
+            fprintf(stderr, "control block address 0x%08X is outside the chain\n", addr);
+            return -1;
+        }
+        cb = &view->cbs[(addr - hdr->cb_addr) / sizeof(*cb)];
+
+        // locate its source
+        words = cb->txfr_len / sizeof(uint32_t);
+        offset = cb->source_ad - hdr->buffer_addr;
+        if (cb->source_ad < hdr->buffer_addr || cb->txfr_len % sizeof(uint32_t) ||
+            offset + ((cb->ti & WS2812_DUMP_TI_SRCINC) ? cb->txfr_len : sizeof(uint32_t)) > hdr->buffer_len) {
+            fprintf(stderr, "control block at 0x%08X reads outside the buffer\n", addr);
+            return -1;
+        }
+        if (dec->verbose) {
+            printf("cb 0x%08X: %u words from 0x%08X%s\n", addr, words, cb->source_ad,
+                (cb->ti & WS2812_DUMP_TI_SRCINC) ? "" : " (repeated)");
+        }
+
+        // play it
+        for (uint32_t i = 0; i < words; ++i) {
+            uint32_t word;
+            memcpy(&word, view->buffer + offset + ((cb->ti & WS2812_DUMP_TI_SRCINC) ? i * sizeof(word) : 0), sizeof(word));
+            decode_word(dec, word);
+        }
+
+        addr = cb->nextconbk;
+        if (addr == 0 || addr == hdr->first_cb) {
+            break;
+        }
+    }
+
+    // the pass must leave the line LOW for a reset, or the next pass (or whatever
+    // the line does next) runs into this frame
+    finish_pulse(dec);
+    if (dec->bits) {
+        decode_error(dec, "chain ends without a reset", dec->low_ns);
+        end_frame(dec);
+    }
+
+    return 0;
+}
+
+/**
+ * decode_dump()
+ *
+ * Decode one pass of a dump; returns the number of errors, or -1 if the dump is
+ * unusable
+ */
+static int decode_dump(const uint8_t *data, size_t len, double tolerance_ns, int verbose, struct decoder *dec) {
+    // function setup
+    struct dump_view view;
+
+    if (parse_dump(data, len, &view)) {
+        return -1;
+    }
+
+    memset(dec, 0, sizeof(*dec));
+    dec->hdr = view.hdr;
+    dec->tick_ns = 1e9 / view.hdr->pwm_clock_hz;
+    dec->tolerance_ns = tolerance_ns;
+    dec->margin_ns = tolerance_ns;
+    dec->verbose = verbose;
+
+    if (walk(&view, dec)) {
+        return -1;
+    }
+    return dec->errors;
+}
+
+/**************************************************************************************
+ * SELF TEST
+ **************************************************************************************/
+
+/**
+ * build_dump()
+ *
+ * Encode n LEDs with one implementation into a dump laid out like the driver's
+ * chain: one block per segment, then a latch block repeating a zero word
+ */
+static uint8_t *build_dump(const struct ws2812_encoder *enc, ws2812_encode_fn encode,
+                           const led_t *leds, size_t n, int latch, size_t *len) {
+    // function setup
+    unsigned int num_segments = (n + SELFTEST_SEGMENT_LEDS - 1) / SELFTEST_SEGMENT_LEDS;
+    unsigned int num_cbs = num_segments + (latch ? 1 : 0);
+    size_t buffer_len = (n * WS2812_WORDS_PER_LED + 1) * sizeof(uint32_t);
+    struct ws2812_dump_header *hdr;
+    struct ws2812_dump_cb *cbs;
+    uint32_t *buffer;
+    uint8_t *data;
+
+    *len = sizeof(*hdr) + num_cbs * sizeof(*cbs) + buffer_len;
+    data = calloc(1, *len);
+    if (!data) {
+        return NULL;
+    }
+    hdr = (struct ws2812_dump_header *)data;
+    cbs = (struct ws2812_dump_cb *)(data + sizeof(*hdr));
+    buffer = (uint32_t *)(data + sizeof(*hdr) + num_cbs * sizeof(*cbs));
+
+    *hdr = (struct ws2812_dump_header) {
+        .magic = WS2812_DUMP_MAGIC,
+        .version = WS2812_DUMP_VERSION,
+        .pwm_clock_hz = SELFTEST_CLOCK_HZ,
+        .pwm_range = WS2812_TICKS_PER_BIT,
+        .t0h_ns = SELFTEST_T0H_NS,
+        .t1h_ns = SELFTEST_T1H_NS,
+        .reset_ns = SELFTEST_RESET_NS,
+        .num_leds = n,
+        .cb_addr = SELFTEST_CB_ADDR,
+        .num_cbs = num_cbs,
+        .first_cb = SELFTEST_CB_ADDR,
+        .buffer_addr = SELFTEST_BUFFER_ADDR,
+        .buffer_len = buffer_len,
+    };
+
+    // segments, then the latch word
+    encode(enc, buffer, leds, n);
+    for (unsigned int i = 0; i < num_cbs; ++i) {
+        size_t first = (size_t)i * SELFTEST_SEGMENT_LEDS;
+        size_t count = n - first < SELFTEST_SEGMENT_LEDS ? n - first : SELFTEST_SEGMENT_LEDS;
+
+        cbs[i].ti = WS2812_DUMP_TI_SRCINC;
+        cbs[i].source_ad = SELFTEST_BUFFER_ADDR + first * WS2812_WORDS_PER_LED * sizeof(uint32_t);
+        cbs[i].txfr_len = count * WS2812_WORDS_PER_LED * sizeof(uint32_t);
+        cbs[i].nextconbk = SELFTEST_CB_ADDR + ((i + 1) % num_cbs) * sizeof(*cbs);
+        if (i == num_segments) {
+            cbs[i].ti = 0;
+            cbs[i].source_ad = SELFTEST_BUFFER_ADDR + n * WS2812_WORDS_PER_LED * sizeof(uint32_t);
+            cbs[i].txfr_len = ((SELFTEST_RESET_NS + BIT_NS - 1) / BIT_NS) * sizeof(uint32_t);
+        }
+    }
+
+    return data;
+}
+
+/**
+ * selftest()
+ *
+ * Round-trip random strips of several lengths through every encoder and the
+ * decoder, and check that a chain without a latch block is flagged
+ */
+static int selftest(double tolerance_ns) {
+    // function setup
+    static const size_t lengths[] = { 1, 7, 10, 16, 33, 100, 300 };
+    static struct ws2812_encoder enc;
+    const struct ws2812_encode_impl *impl;
+    struct decoder dec;
+    led_t leds[300];
+    uint8_t *data;
+    size_t len;
+    int failed = 0;
+    int errors;
+
+    ws2812_encoder_init(&enc, (SELFTEST_T0H_NS * (uint64_t)SELFTEST_CLOCK_HZ + 500000000ull) / 1000000000ull,
+        (SELFTEST_T1H_NS * (uint64_t)SELFTEST_CLOCK_HZ + 500000000ull) / 1000000000ull);
+    srand(1);
+    for (size_t i = 0; i < sizeof(leds) / sizeof(leds[0]); ++i) {
+        leds[i].red = (uint8_t)rand();
+        leds[i].green = (uint8_t)rand();
+        leds[i].blue = (uint8_t)rand();
+    }
+
+    for (impl = &ws2812_encode_impls[0]; impl->name; ++impl) {
+        if (!ws2812_encode_impl_usable(impl)) {
+            continue;
+        }
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+            data = build_dump(&enc, impl->encode, leds, lengths[l], 1, &len);
+            if (!data) {
+                return 1;
+            }
+            errors = decode_dump(data, len, tolerance_ns, 0, &dec);
+            if (errors || dec.frames != 1 || dec.num_pixels != lengths[l] ||
+                memcmp(dec.pixels, leds, lengths[l] * sizeof(led_t))) {
+                fprintf(stderr, "%s: %zu leds did not round-trip\n", impl->name, lengths[l]);
+                failed = 1;
+            }
+            free(dec.pixels);
+            free(data);
+        }
+        printf("%-8s round-trips, worst margin %.1f ns\n", impl->name, dec.margin_ns);
+    }
+
+    // the verifier has to catch a chain that loops without a reset
+    data = build_dump(&enc, ws2812_encode_lut, leds, 10, 0, &len);
+    if (!data) {
+        return 1;
+    }
+    fflush(stdout);
+    fprintf(stderr, "expected failure: ");
+    if (decode_dump(data, len, tolerance_ns, 0, &dec) <= 0) {
+        fprintf(stderr, "missing latch not detected\n");
+        failed = 1;
+    }
+    free(dec.pixels);
+    free(data);
+
+    return failed;
+}
+
+/**************************************************************************************
+ * MAIN
+ **************************************************************************************/
+int main(int argc, char **argv) {
+    // function setup
+    double tolerance_ns = DEFAULT_TOLERANCE_NS;
+    const char *expected_path = NULL;
+    struct decoder dec;
+    uint8_t *data = NULL, *expected = NULL;
+    size_t len = 0, expected_len = 0;
+    int run_selftest = 0, verbose = 0;
+    int errors;
+    FILE *f;
+    int opt;
+
+    // parse arguments
+    while ((opt = getopt(argc, argv, "vst:e:h")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = 1;
+                break;
+            case 's':
+                run_selftest = 1;
+                break;
+            case 't':
+                tolerance_ns = strtod(optarg, NULL);
+                break;
+            case 'e':
+                expected_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-v] [-t tolerance_ns] [-e expected.rgb] dump.bin\n"
+                    "       %s -s [-t tolerance_ns]\n", argv[0], argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (run_selftest) {
+        return selftest(tolerance_ns);
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "no dump given\n");
+        return 1;
+    }
+
+    // load the dump and the expected pixels
+    for (int i = 0; i < 2; ++i) {
+        const char *path = i ? expected_path : argv[optind];
+        uint8_t **buf = i ? &expected : &data;
+        size_t *buf_len = i ? &expected_len : &len;
+        long size;
+
+        if (!path) {
+            continue;
+        }
+        f = fopen(path, "rb");
+        if (!f || fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) ||
+            !(*buf = malloc(size + 1)) || fread(*buf, 1, size, f) != (size_t)size) {
+            perror(path);
+            return 1;
+        }
+        *buf_len = size;
+        fclose(f);
+    }
+
+    // decode
+    errors = decode_dump(data, len, tolerance_ns, verbose, &dec);
+    if (errors < 0) {
+        return 1;
+    }
+    if (verbose) {
+        for (size_t i = 0; i < dec.num_pixels; ++i) {
+            printf("led %zu: %02X %02X %02X\n", i, dec.pixels[i].red, dec.pixels[i].green, dec.pixels[i].blue);
+        }
+    }
+    printf("%u frame(s), %zu LEDs, latch %.1f ns (min %u ns), worst margin %.1f ns, %d error(s)\n",
+        dec.frames, dec.num_pixels, dec.latch_ns, dec.hdr->reset_ns, dec.margin_ns, errors);
+
+    // compare against the expected pixels
+    if (expected) {
+        size_t n = expected_len / sizeof(led_t);
+        if (n > dec.num_pixels) {
+            fprintf(stderr, "expected %zu LEDs, decoded %zu\n", n, dec.num_pixels);
+            ++errors;
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                if (memcmp(&dec.pixels[i], expected + i * sizeof(led_t), sizeof(led_t))) {
+                    fprintf(stderr, "led %zu differs from expected\n", i);
+                    ++errors;
+                    break;
+                }
+            }
+        }
+    }
+
+    free(dec.pixels);
+    free(data);
+    free(expected);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,349 @@
+/**
+ * ws2812_hwtrace
+ *
+ * Runs the driver's register access layer (ws2812_hw.c) against simulated GPIO, PWM
+ * and CM blocks and counts every MMIO access it makes, per configuration step and per
+ * register. The simulation also checks the rules the hardware relies on:
+ *
+ *      - every CM write carries the password
+ *      - CM SRC/MASH never change while the clock is enabled or busy
+ *      - the PWM is never enabled while its clock is stopped
+ *      - GPSET/GPCLR (write-only) are never read
+ *
+ * usage: ws2812_hwtrace [-v] [-r read_ns] [-w write_ns]
+ *
+ *      -v          print every access
+ *      -r, -w      cost of one MMIO read/write; adds an estimated time per step
+ *
+ * Exits non-zero if any rule was broken.
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ws2812_encode.h"
+#include "ws2812_hw.h"
+#include "ws2812_timing.h"
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define BLOCK_WORDS                         1024
+#define NUM_BLOCKS                          3
+
+// the driver's pixel-mode settings (ws2812_driver.h); PWMDIV_REGISTER comes from
+// ws2812_timing.h, generated at the module's BIT_NS
+#define WS2812_GPIO_PIN                     18
+#define PWM_DATA_INIT                       25
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+struct block {
+    const char *name;
+    uint32_t regs[BLOCK_WORDS];
+    unsigned long reads[BLOCK_WORDS];
+    unsigned long writes[BLOCK_WORDS];
+};
+
+struct reg_name {
+    int block;
+    uint32_t offset;
+    const char *name;
+};
+
+struct step_count {
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long barriers;
+    unsigned long delay_us;
+};
+
+/**************************************************************************************
+ * GLOBALS
+ **************************************************************************************/
+enum { BLOCK_GPIO, BLOCK_PWM, BLOCK_CM };
+
+static struct block blocks[NUM_BLOCKS] = {
+    [BLOCK_GPIO] = { .name = "GPIO" },
+    [BLOCK_PWM] = { .name = "PWM" },
+    [BLOCK_CM] = { .name = "CM" },
+};
+
+static const struct reg_name reg_names[] = {
+    { BLOCK_GPIO, GPIO_GPFSEL0_OFFSET + 4, "GPFSEL1" },
+    { BLOCK_GPIO, GPIO_GPSET0_OFFSET, "GPSET0" },
+    { BLOCK_GPIO, GPIO_GPCLR0_OFFSET, "GPCLR0" },
+    { BLOCK_PWM, PWM_CTL_OFFSET, "CTL" },
+    { BLOCK_PWM, PWM_STA_OFFSET, "STA" },
+    { BLOCK_PWM, PWM_DMAC_OFFSET, "DMAC" },
+    { BLOCK_PWM, PWM_RNG1_OFFSET, "RNG1" },
+    { BLOCK_PWM, PWM_DAT1_OFFSET, "DAT1" },
+    { BLOCK_CM, CM_PWMCTL_OFFSET, "PWMCTL" },
+    { BLOCK_CM, CM_PWMDIV_OFFSET, "PWMDIV" },
+};
+
+static struct step_count step;
+static unsigned long violations;
+static int verbose;
+
+/**************************************************************************************
+ * SIMULATION
+ **************************************************************************************/
+
+/**
+ * reg_lookup()
+ *
+ * Find which block and word an access hits
+ */
+static void reg_lookup(const volatile uint32_t *reg, int *block, unsigned int *word) {
+    for (int b = 0; b < NUM_BLOCKS; ++b) {
+        if (reg >= blocks[b].regs && reg < blocks[b].regs + BLOCK_WORDS) {
+            *block = b;
+            *word = (unsigned int)(reg - blocks[b].regs);
+            return;
+        }
+    }
+    fprintf(stderr, "access outside the simulated blocks: %p\n", (const void *)reg);
+    exit(2);
+}
+
+/**
+ * reg_label()
+ *
+ * Name of a register, or its offset
+ */
+static const char *reg_label(int block, unsigned int word) {
+    static char buf[32];
+
+    for (size_t i = 0; i < sizeof(reg_names) / sizeof(reg_names[0]); ++i) {
+        if (reg_names[i].block == block && reg_names[i].offset == word * 4) {
+            return reg_names[i].name;
+        }
+    }
+    snprintf(buf, sizeof(buf), "+0x%03X", word * 4);
+    return buf;
+}
+
+/**
+ * violation()
+ *
+ * Report a broken hardware rule
+ */
+static void violation(const char *what, int block, unsigned int word, uint32_t val) {
+    fprintf(stderr, "rule broken: %s (%s %s <- 0x%08X)\n", what, blocks[block].name, reg_label(block, word), val);
+    ++violations;
+}
+
+uint32_t ws2812_hw_trace_read(const volatile uint32_t *reg) {
+    // function setup
+    unsigned int word;
+    int block;
+
+    reg_lookup(reg, &block, &word);
+    if (block == BLOCK_GPIO && (word * 4 == GPIO_GPSET0_OFFSET || word * 4 == GPIO_GPSET1_OFFSET ||
+            word * 4 == GPIO_GPCLR0_OFFSET || word * 4 == GPIO_GPCLR1_OFFSET)) {
+        violation("read of a write-only register", block, word, 0);
+    }
+
+    ++blocks[block].reads[word];
+    ++step.reads;
+    if (verbose) {
+        printf("    R %-4s %-7s -> 0x%08X\n", blocks[block].name, reg_label(block, word), blocks[block].regs[word]);
+    }
+    return blocks[block].regs[word];
+}
+
+void ws2812_hw_trace_write(volatile uint32_t *reg, uint32_t val) {
+    // function setup
+    uint32_t old, changed, stored = val;
+    unsigned int word;
+    int block;
+
+    reg_lookup(reg, &block, &word);
+    old = blocks[block].regs[word];
+
+    if (block == BLOCK_CM) {
+        if ((val & CM_PASSWD_MASK) != CM_PASSWD) {
+            violation("CM write without the password", block, word, val);
+        }
+        stored &= ~CM_PASSWD_MASK;
+    }
+    if (block == BLOCK_CM && word * 4 == CM_PWMCTL_OFFSET) {
+        changed = (old ^ stored) & (CM_PWMCTL_SRC_MASK | CM_PWMCTL_MASH_MASK);
+        if (changed && (old & (CM_PWMCTL_ENAB_MASK | CM_PWMCTL_BUSY_MASK))) {
+            violation("SRC/MASH changed while the clock is running", block, word, val);
+        }
+        if (changed && (stored & CM_PWMCTL_ENAB_MASK)) {
+            violation("SRC/MASH changed together with ENAB", block, word, val);
+        }
+
+        // BUSY follows ENAB straight away in the simulation
+        stored &= ~CM_PWMCTL_BUSY_MASK;
+        if (stored & CM_PWMCTL_ENAB_MASK) {
+            stored |= CM_PWMCTL_BUSY_MASK;
+        }
+    }
+    if (block == BLOCK_PWM && word * 4 == PWM_CTL_OFFSET && (stored & PWM_CTL_PWEN1_MASK) &&
+            !(blocks[BLOCK_CM].regs[CM_PWMCTL_OFFSET / 4] & CM_PWMCTL_BUSY_MASK)) {
+        violation("PWM enabled with its clock stopped", block, word, val);
+    }
+    if (block == BLOCK_PWM && word * 4 == PWM_STA_OFFSET) {
+        // sticky flags clear where 1 is written
+        stored = old & ~(val & PWM_STA_STICKY_MASK);
+    }
+    if (block == BLOCK_PWM && word * 4 == PWM_CTL_OFFSET) {
+        // CLRF1 is single shot and reads back as 0
+        stored &= ~PWM_CTL_CLRF1_MASK;
+    }
+    if (block == BLOCK_GPIO && (word * 4 == GPIO_GPSET0_OFFSET || word * 4 == GPIO_GPCLR0_OFFSET)) {
+        // write-1 registers read back as 0
+        stored = 0;
+    }
+
+    blocks[block].regs[word] = stored;
+    ++blocks[block].writes[word];
+    ++step.writes;
+    if (verbose) {
+        printf("    W %-4s %-7s <- 0x%08X\n", blocks[block].name, reg_label(block, word), val);
+    }
+}
+
+void ws2812_hw_trace_barrier(void) {
+    ++step.barriers;
+    if (verbose) {
+        printf("    barrier\n");
+    }
+}
+
+void ws2812_hw_trace_udelay(unsigned long us) {
+    step.delay_us += us;
+}
+
+/**************************************************************************************
+ * REPORTING
+ **************************************************************************************/
+
+/**
+ * step_end()
+ *
+ * Print the counts for one configuration step and start the next
+ */
+static void step_end(const char *name, double read_ns, double write_ns, struct step_count *total) {
+    printf("%-16s %6lu %6lu %8lu %8lu", name, step.reads, step.writes, step.barriers, step.delay_us);
+    if (read_ns > 0 || write_ns > 0) {
+        printf(" %10.2f", (step.reads * read_ns + step.writes * write_ns) / 1000.0);
+    }
+    printf("\n");
+
+    total->reads += step.reads;
+    total->writes += step.writes;
+    total->barriers += step.barriers;
+    total->delay_us += step.delay_us;
+    memset(&step, 0, sizeof(step));
+}
+
+/**************************************************************************************
+ * MAIN
+ **************************************************************************************/
+int main(int argc, char *argv[]) {
+    // function setup
+    struct step_count total = { 0 };
+    double read_ns = 0, write_ns = 0;
+    struct ws2812_hw hw;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vr:w:")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = 1;
+                break;
+            case 'r':
+                read_ns = atof(optarg);
+                break;
+            case 'w':
+                write_ns = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-v] [-r read_ns] [-w write_ns]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    // reset-ish state: clock on the oscillator and running, PWM idle
+    blocks[BLOCK_CM].regs[CM_PWMCTL_OFFSET / 4] = CM_PWMCTL_SRC(PWMCTL_OSC) | CM_PWMCTL_ENAB(1) | CM_PWMCTL_BUSY(1);
+    blocks[BLOCK_PWM].regs[PWM_DMAC_OFFSET / 4] = 0x00000707;
+
+    printf("%-16s %6s %6s %8s %8s", "step", "reads", "writes", "barriers", "delay_us");
+    if (read_ns > 0 || write_ns > 0) {
+        printf(" %10s", "mmio_us");
+    }
+    printf("\n");
+
+    // probe, in the order ws2812_probe() runs it (pixel mode)
+    ws2812_hw_init(&hw, blocks[BLOCK_GPIO].regs, blocks[BLOCK_PWM].regs, blocks[BLOCK_CM].regs);
+    step_end("init", read_ns, write_ns, &total);
+    ws2812_hw_gpio_configure(&hw, WS2812_GPIO_PIN, GPFSEL_ALT5);
+    step_end("gpio_configure", read_ns, write_ns, &total);
+    ws2812_hw_cm_configure(&hw, PWMCTL_PLLD, PWMDIV_REGISTER, PWMCTL_MASH1STAGE);
+    step_end("cm_configure", read_ns, write_ns, &total);
+    ws2812_hw_pwm_configure(&hw, WS2812_TICKS_PER_BIT, PWM_DATA_INIT);
+    step_end("pwm_configure", read_ns, write_ns, &total);
+    ws2812_hw_gpio_set(&hw, WS2812_GPIO_PIN);
+    step_end("gpio_set", read_ns, write_ns, &total);
+
+    // runtime reconfiguration
+    ws2812_hw_pwm_setduty(&hw, 50);
+    step_end("pwm_setduty", read_ns, write_ns, &total);
+    ws2812_hw_pwm_gate(&hw, true);
+    step_end("pwm_gate", read_ns, write_ns, &total);
+    ws2812_hw_pwm_gate(&hw, false);
+    step_end("pwm_ungate", read_ns, write_ns, &total);
+
+    // watchdog: a status check that finds an underrun, then a recovery
+    blocks[BLOCK_PWM].regs[PWM_STA_OFFSET / 4] |= PWM_STA_GAPO1_MASK | PWM_STA_EMPT1_MASK;
+    ws2812_hw_pwm_status(&hw);
+    if (blocks[BLOCK_PWM].regs[PWM_STA_OFFSET / 4] & PWM_STA_STICKY_MASK) {
+        violation("sticky STA flags not cleared", BLOCK_PWM, PWM_STA_OFFSET / 4, 0);
+    }
+    step_end("pwm_status", read_ns, write_ns, &total);
+    ws2812_hw_pwm_clear_fifo(&hw);
+    step_end("pwm_clear_fifo", read_ns, write_ns, &total);
+
+    // remove
+    ws2812_hw_gpio_clear(&hw, WS2812_GPIO_PIN);
+    ws2812_hw_gpio_configure(&hw, WS2812_GPIO_PIN, GPFSEL_INPUT);
+    step_end("remove", read_ns, write_ns, &total);
+
+    step = total;
+    step_end("total", read_ns, write_ns, &total);
+
+    // per-register totals
+    printf("\n%-16s %6s %6s\n", "register", "reads", "writes");
+    for (size_t i = 0; i < sizeof(reg_names) / sizeof(reg_names[0]); ++i) {
+        const struct block *blk = &blocks[reg_names[i].block];
+        char label[24];
+
+        snprintf(label, sizeof(label), "%s %s", blk->name, reg_names[i].name);
+        printf("%-16s %6lu %6lu\n", label, blk->reads[reg_names[i].offset / 4], blk->writes[reg_names[i].offset / 4]);
+    }
+
+    // the registers must end up where the layer thinks they are
+    if (blocks[BLOCK_PWM].regs[PWM_CTL_OFFSET / 4] != hw.pwm_ctl ||
+            blocks[BLOCK_PWM].regs[PWM_DAT1_OFFSET / 4] != hw.pwm_dat1 ||
+            (blocks[BLOCK_CM].regs[CM_PWMCTL_OFFSET / 4] & ~CM_PWMCTL_BUSY_MASK) != hw.cm_pwmctl) {
+        fprintf(stderr, "shadows out of sync with the registers\n");
+        ++violations;
+    }
+
+    if (violations) {
+        printf("%lu rule(s) broken\n", violations);
+        return 1;
+    }
+    return 0;
+}
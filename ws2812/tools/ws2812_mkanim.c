@@ -0,0 +1,183 @@
+/**
+ * ws2812_mkanim
+ *
+ * Builds a boot animation file (ws2812_anim.h) for the driver's boot_anim parameter,
+ * either from raw frames or from a built-in pattern. Install it where the firmware
+ * loader looks, e.g. /lib/firmware/ws2812-boot.bin, or play it straight away with
+ * -u, which uploads it with WS2812_IOC_PLAY_SEQUENCE.
+ *
+ * usage: ws2812_mkanim -n leds [-d ms] [-l loop_start] [-c loop_count]
+ *                      (-i frames.rgb | -p rainbow|chase|breathe [-f frames])
+ *                      (-o out.bin | -u /dev/ws2812)
+ *
+ *      -n          LEDs per frame
+ *      -d          duration of each frame in ms (default 40)
+ *      -l, -c      first looped frame and how often the loop plays (default 0, 0 = forever)
+ *      -i          raw input, leds * 3 bytes (red, green, blue) per frame
+ *      -p, -f      generate a pattern with the given number of frames (default 50)
+ *      -o, -u      write to a file, or upload to the device
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "ws2812_anim.h"
+#include "ws2812_ioctl.h"
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define DEFAULT_DURATION_MS                 40
+#define DEFAULT_FRAMES                      50
+
+/**************************************************************************************
+ * PATTERNS
+ **************************************************************************************/
+
+/**
+ * hue()
+ *
+ * Fully saturated color at position h (0-1) around the color wheel
+ */
+static void hue(double h, uint8_t rgb[3]) {
+    for (int c = 0; c < 3; ++c) {
+        double x = fabs(fmod(h * 6.0 + 4.0 - 2.0 * c, 6.0) - 3.0) - 1.0;
+        rgb[c] = (uint8_t)(255.0 * (x < 0 ? 0 : x > 1 ? 1 : x));
+    }
+}
+
+/**
+ * pattern()
+ *
+ * Pixel (red, green, blue) of LED i in frame f of a generated pattern
+ */
+static int pattern(const char *name, unsigned int f, unsigned int frames, unsigned int i, unsigned int leds,
+    uint8_t rgb[3]) {
+    // function setup
+    double t = (double)f / frames;
+
+    memset(rgb, 0, 3);
+    if (!strcmp(name, "rainbow")) {
+        hue(fmod(t + (double)i / leds, 1.0), rgb);
+    } else if (!strcmp(name, "chase")) {
+        if (i == f * leds / frames) {
+            rgb[0] = rgb[1] = rgb[2] = 255;
+        }
+    } else if (!strcmp(name, "breathe")) {
+        rgb[2] = (uint8_t)(127.5 * (1.0 - cos(2.0 * M_PI * t)));
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/**************************************************************************************
+ * MAIN
+ **************************************************************************************/
+int main(int argc, char *argv[]) {
+    // function setup
+    struct ws2812_anim_header hdr = { .magic = WS2812_ANIM_MAGIC, .version = WS2812_ANIM_VERSION };
+    struct ws2812_anim_frame frame = { .duration_ms = DEFAULT_DURATION_MS };
+    const char *input = NULL, *name = NULL, *output = NULL, *device = NULL;
+    struct ws2812_sequence seq = { 0 };
+    unsigned int frames = DEFAULT_FRAMES;
+    size_t pixel_bytes, padded, size;
+    FILE *in = NULL, *out;
+    uint8_t *pixels;
+    char *data;
+    int opt, fd;
+
+    while ((opt = getopt(argc, argv, "n:d:l:c:i:p:f:o:u:")) != -1) {
+        switch (opt) {
+            case 'n': hdr.num_leds = strtoul(optarg, NULL, 0); break;
+            case 'd': frame.duration_ms = strtoul(optarg, NULL, 0); break;
+            case 'l': hdr.loop_start = strtoul(optarg, NULL, 0); break;
+            case 'c': hdr.loop_count = strtoul(optarg, NULL, 0); break;
+            case 'i': input = optarg; break;
+            case 'p': name = optarg; break;
+            case 'f': frames = strtoul(optarg, NULL, 0); break;
+            case 'o': output = optarg; break;
+            case 'u': device = optarg; break;
+            default: goto usage;
+        }
+    }
+    if (!hdr.num_leds || !output == !device || !input == !name || !frames) {
+        goto usage;
+    }
+
+    pixel_bytes = hdr.num_leds * 3;
+    padded = WS2812_ANIM_FRAME_SIZE(hdr.num_leds) - sizeof(frame);
+    pixels = calloc(1, padded);
+    if (!pixels) {
+        perror("calloc");
+        return 1;
+    }
+
+    if (input && !(in = fopen(input, "rb"))) {
+        perror(input);
+        return 1;
+    }
+    // uploads are built in memory
+    out = output ? fopen(output, "wb") : open_memstream(&data, &size);
+    if (!out) {
+        perror(output ? output : "open_memstream");
+        return 1;
+    }
+
+    // header first; num_frames is filled in once the frames are counted
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    for (hdr.num_frames = 0; !in || hdr.num_frames < WS2812_ANIM_MAX_FRAMES; ++hdr.num_frames) {
+        if (in && fread(pixels, 1, pixel_bytes, in) != pixel_bytes) {
+            break;
+        }
+        if (!in && hdr.num_frames == frames) {
+            break;
+        }
+        for (unsigned int i = 0; !in && i < hdr.num_leds; ++i) {
+            if (pattern(name, hdr.num_frames, frames, i, hdr.num_leds, &pixels[i * 3])) {
+                fprintf(stderr, "unknown pattern %s\n", name);
+                return 1;
+            }
+        }
+        fwrite(&frame, sizeof(frame), 1, out);
+        fwrite(pixels, 1, padded, out);
+    }
+
+    if (!hdr.num_frames || hdr.loop_start >= hdr.num_frames) {
+        fprintf(stderr, "%u frames; need at least one, and loop_start below that\n", hdr.num_frames);
+        return 1;
+    }
+    rewind(out);
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    fseek(out, 0, SEEK_END);
+    fclose(out);
+
+    if (device) {
+        seq.data = (uintptr_t)data;
+        seq.size = size;
+        if ((fd = open(device, O_WRONLY)) < 0 || ioctl(fd, WS2812_IOC_PLAY_SEQUENCE, &seq)) {
+            perror(device);
+            return 1;
+        }
+        close(fd);
+        output = device;
+    }
+
+    printf("%s: %u frames of %u LEDs, %u ms each, loop from %u %s\n", output, hdr.num_frames, hdr.num_leds,
+        frame.duration_ms, hdr.loop_start, hdr.loop_count ? "then hold" : "forever");
+    return 0;
+
+usage:
+    fprintf(stderr, "usage: %s -n leds [-d ms] [-l loop_start] [-c loop_count]\n"
+        "       (-i frames.rgb | -p rainbow|chase|breathe [-f frames]) (-o out.bin | -u /dev/ws2812)\n", argv[0]);
+    return 2;
+}
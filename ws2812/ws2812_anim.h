@@ -0,0 +1,64 @@
+#ifndef _WS2812_ANIM_H_
+#define _WS2812_ANIM_H_
+
+/**
+ * ws2812 boot animation format
+ *
+ * Pre-rendered animation the driver loads through request_firmware() at probe and
+ * plays from DMA until userspace renders its first frame. Layout:
+ *
+ *      struct ws2812_anim_header
+ *      num_frames x {
+ *          struct ws2812_anim_frame
+ *          num_leds x { red, green, blue }     padded to a multiple of 4 bytes
+ *      }
+ *
+ * Frames before loop_start play once; frames loop_start onwards then play
+ * loop_count times (0: forever), after which the last frame stays lit. All fields
+ * are little-endian. tools/ws2812_mkanim builds these files
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#include <linux/types.h>
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define WS2812_ANIM_MAGIC                   0x31415357  // "WSA1"
+#define WS2812_ANIM_VERSION                 1
+
+// limits the driver accepts
+#define WS2812_ANIM_MAX_FRAMES              1024
+
+// bytes one frame record takes in the file
+#define WS2812_ANIM_FRAME_SIZE(num_leds)    (sizeof(struct ws2812_anim_frame) + (((num_leds) * 3 + 3) & ~3u))
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+/**
+ * struct ws2812_anim_header
+ *
+ * Frame geometry and loop points
+ */
+struct ws2812_anim_header {
+    __u32 magic;
+    __u32 version;
+    __u32 num_leds;     // LEDs per frame, from the start of the strip
+    __u32 num_frames;
+    __u32 loop_start;   // first frame of the looped section
+    __u32 loop_count;   // plays of the looped section; 0 repeats forever
+};
+
+/**
+ * struct ws2812_anim_frame
+ *
+ * One frame; its pixels follow
+ */
+struct ws2812_anim_frame {
+    __u32 duration_ms;  // time from this frame to the next; at least one frame period
+};
+
+#endif /* _WS2812_ANIM_H_ */
@@ -11,296 +11,2720 @@ MODULE_AUTHOR("Jake Uyechi");
 /**************************************************************************************
  * MODULE IMPLEMENTATION
  **************************************************************************************/
+// module parameters
+static char *mode = "pixel";
+module_param(mode, charp, 0444);
+MODULE_PARM_DESC(mode, "Output mode: \"pixel\" (WS2812 frames, default) or \"pwm\" (breathing demo)");
+
+static unsigned int segment_leds = WS2812_SEGMENT_LEDS;
+module_param(segment_leds, uint, 0444);
+MODULE_PARM_DESC(segment_leds, "LEDs per independently encoded frame segment");
+
+static char *chip = WS2812_DEFAULT_CHIP;
+module_param(chip, charp, 0444);
+MODULE_PARM_DESC(chip, "LED part, sets bit and latch timing: ws2812, ws2812b (default), ws2813 or sk6812");
+
+static bool gamma;
+module_param(gamma, bool, 0444);
+MODULE_PARM_DESC(gamma, "Apply the chip's gamma curve to every pixel as it is encoded (single strip)");
+
+static unsigned int num_leds = WS2812_DEFAULT_LEDS;
+module_param(num_leds, uint, 0444);
+MODULE_PARM_DESC(num_leds, "LEDs attached to the strip (to each strip with strips set); shorter strips refresh faster");
+
+static unsigned int strips;
+module_param(strips, uint, 0444);
+MODULE_PARM_DESC(strips, "Drive this many strips in parallel from GPIO strip_pin up, instead of one from the PWM (pixel mode, raw DMA; 0-16, up to 113 LEDs each)");
+
+static unsigned int strip_pin = WS2812_PARALLEL_PIN_BASE;
+module_param(strip_pin, uint, 0444);
+MODULE_PARM_DESC(strip_pin, "GPIO of the first parallel strip; the others follow on consecutive pins");
+
+static bool oneshot;
+module_param(oneshot, bool, 0444);
+MODULE_PARM_DESC(oneshot, "Send each frame once instead of looping the DMA chain (pixel mode)");
+
+static bool gate_clock;
+module_param(gate_clock, bool, 0444);
+MODULE_PARM_DESC(gate_clock, "With oneshot, stop the PWM and its clock between frames");
+
+static char *dma_backend = WS2812_DEFAULT_DMA_BACKEND;
+module_param(dma_backend, charp, 0444);
+MODULE_PARM_DESC(dma_backend, "\"dmaengine\" (channel from the device tree), \"raw\" (DMA channel 5 registers) or \"auto\" (default; dmaengine if available)");
+
+static char *boot_anim = WS2812_DEFAULT_BOOT_ANIM;
+module_param(boot_anim, charp, 0444);
+MODULE_PARM_DESC(boot_anim, "Firmware file played until userspace renders (raw DMA backend); empty to disable");
+
+static char *dma_mem = WS2812_DEFAULT_DMA_MEM;
+module_param(dma_mem, charp, 0444);
+MODULE_PARM_DESC(dma_mem, "Frame buffer memory: \"coherent\" (default), \"wc\" (write-combined) or \"streaming\" (cached, synced per encode)");
+
+static unsigned int watchdog_ms = WS2812_WATCHDOG_MS;
+module_param(watchdog_ms, uint, 0444);
+MODULE_PARM_DESC(watchdog_ms, "Check the DMA channel every this many ms and re-arm it if it errored or stalled; 0 disables");
+MODULE_FIRMWARE(WS2812_DEFAULT_BOOT_ANIM);
+
 // define a global device struct
 struct ws2812_dev ws2812_device;
 static struct platform_device *ws2812_platform_device;
 
+// device tree match; see ws2812-overlay.dts
+static const struct of_device_id ws2812_of_match[] = {
+    { .compatible = WS2812_COMPATIBLE },
+    { },
+};
+MODULE_DEVICE_TABLE(of, ws2812_of_match);
+
 static struct platform_driver ws2812_platform_driver = {
     .driver = {
         .name = WS2812_MODULE_NAME,
         .owner = THIS_MODULE,
+        .of_match_table = ws2812_of_match,
     },
     .probe = ws2812_probe,
     .remove = ws2812_remove,
 };
 
-// file operations table
-static const struct file_operations ws2812_fops = {
-    // file operations
-    .owner = THIS_MODULE,
-    .open = ws2812_open,
-    .write = ws2812_write,
-};
+// file operations table
+static const struct file_operations ws2812_fops = {
+    // file operations
+    .owner = THIS_MODULE,
+    .open = ws2812_open,
+    .release = ws2812_release,
+    .write = ws2812_write,
+    .unlocked_ioctl = ws2812_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .mmap = ws2812_mmap,
+    .poll = ws2812_poll,
+};
+
+// open function; every open gets its own layer
+static int ws2812_open(struct inode *inode, struct file *file) {
+    // function setup
+    struct ws2812_dev *dev = &ws2812_device;
+    struct ws2812_layer *layer;
+
+    // allocate an opaque, full-strip layer on top of the existing ones at z = 0
+    layer = kzalloc(sizeof(*layer), GFP_KERNEL);
+    if (!layer) {
+        LOGE("- Failed to allocate layer.");
+        return -ENOMEM;
+    }
+    layer->dev = dev;
+    layer->cfg.alpha = 255;
+    layer->cfg.blend = WS2812_BLEND_OVER;
+
+    mutex_lock(&dev->lock);
+    ws2812_layer_insert(dev, layer);
+    mutex_unlock(&dev->lock);
+
+    file->private_data = layer;
+    return 0;
+}
+
+// release function; drops the layer and recomposites without it
+static int ws2812_release(struct inode *inode, struct file *file) {
+    // function setup
+    struct ws2812_layer *layer = file->private_data;
+    struct ws2812_dev *dev = layer->dev;
+
+    mutex_lock(&dev->lock);
+    list_del(&layer->node);
+    if (layer->visible && dev->mode == WS2812_MODE_PIXEL) {
+        ws2812_show(dev);
+    }
+    mutex_unlock(&dev->lock);
+
+    vfree(layer->map);
+    kvfree(layer->palette_words);
+    kfree(layer);
+    return 0;
+}
+
+// write function
+static ssize_t ws2812_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+    // function setup
+    ssize_t retval;
+
+    // get layer and device structs
+    struct ws2812_layer *layer = file->private_data;
+    struct ws2812_dev *dev = layer->dev;
+
+    // dispatch on the output mode; non-blocking writers are turned away while both
+    // buffers of some segment are still in use
+    mutex_lock(&dev->lock);
+    if ((file->f_flags & O_NONBLOCK) && !ws2812_frame_ready(dev)) {
+        retval = -EAGAIN;
+    } else if (dev->mode == WS2812_MODE_PIXEL && layer->format == WS2812_FORMAT_RLE) {
+        retval = ws2812_write_rle(layer, buf, count);
+    } else if (dev->mode == WS2812_MODE_PIXEL && layer->format == WS2812_FORMAT_INDEXED) {
+        retval = ws2812_write_indexed(layer, buf, count);
+    } else if (dev->mode == WS2812_MODE_PIXEL) {
+        retval = ws2812_write_pixels(layer, buf, count);
+    } else {
+        retval = ws2812_write_duty(dev, buf, count);
+    }
+    mutex_unlock(&dev->lock);
+
+    // return
+    return retval;
+}
+
+// ioctl function
+static long ws2812_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    // function setup
+    struct ws2812_layer *layer = file->private_data;
+    struct ws2812_dev *dev = layer->dev;
+    void __user *argp = (void __user *)arg;
+    struct ws2812_layer_config cfg;
+    struct ws2812_palette *palette;
+    struct ws2812_timing timing;
+    struct ws2812_waveform wave;
+    struct ws2812_sequence seq;
+    struct ws2812_layout layout;
+    struct ws2812_crossfade crossfade;
+    u16 *table = NULL;
+    void *data;
+    u32 *samples;
+    u32 format;
+    int retval;
+
+    switch (cmd) {
+        case WS2812_IOC_SET_LAYER:
+            if (copy_from_user(&cfg, argp, sizeof(cfg))) {
+                return -EFAULT;
+            }
+
+            // check valid input
+            if (cfg.first_led >= WS2812_MAX_LEDS || cfg.num_leds > WS2812_MAX_LEDS - cfg.first_led ||
+                cfg.blend > WS2812_BLEND_MAX || cfg._reserved[0] || cfg._reserved[1]) {
+                LOGE("- Invalid layer configuration.");
+                return -EINVAL;
+            }
+
+            // re-sort the layer and recomposite
+            mutex_lock(&dev->lock);
+            layer->cfg = cfg;
+            list_del(&layer->node);
+            ws2812_layer_insert(dev, layer);
+            if (layer->visible && dev->mode == WS2812_MODE_PIXEL) {
+                ws2812_show(dev);
+            }
+            mutex_unlock(&dev->lock);
+            return 0;
+
+        case WS2812_IOC_GET_LAYER:
+            mutex_lock(&dev->lock);
+            cfg = layer->cfg;
+            mutex_unlock(&dev->lock);
+            if (copy_to_user(argp, &cfg, sizeof(cfg))) {
+                return -EFAULT;
+            }
+            return 0;
+
+        case WS2812_IOC_SET_FORMAT:
+            if (get_user(format, (u32 __user *)argp)) {
+                return -EFAULT;
+            }
+            if (format > WS2812_FORMAT_INDEXED) {
+                LOGE("- Invalid format %u.", format);
+                return -EINVAL;
+            }
+
+            mutex_lock(&dev->lock);
+            retval = 0;
+            if (format == WS2812_FORMAT_INDEXED) {
+                retval = ws2812_layer_alloc_palette(layer);
+            }
+            if (!retval) {
+                layer->format = format;
+            }
+            mutex_unlock(&dev->lock);
+            return retval;
+
+        case WS2812_IOC_SET_PALETTE:
+            palette = memdup_user(argp, sizeof(*palette));
+            if (IS_ERR(palette)) {
+                return PTR_ERR(palette);
+            }
+
+            mutex_lock(&dev->lock);
+            retval = ws2812_layer_set_palette(layer, palette);
+            mutex_unlock(&dev->lock);
+
+            kfree(palette);
+            return retval;
+
+        case WS2812_IOC_GET_TIMING:
+            mutex_lock(&dev->lock);
+            ws2812_get_timing(dev, &timing);
+            mutex_unlock(&dev->lock);
+            if (copy_to_user(argp, &timing, sizeof(timing))) {
+                return -EFAULT;
+            }
+            return 0;
+
+        case WS2812_IOC_COMMIT:
+            mutex_lock(&dev->lock);
+            if ((file->f_flags & O_NONBLOCK) && !ws2812_frame_ready(dev)) {
+                retval = -EAGAIN;
+            } else {
+                retval = ws2812_commit(layer);
+            }
+            mutex_unlock(&dev->lock);
+            return retval;
+
+        case WS2812_IOC_SET_WAVEFORM:
+            if (copy_from_user(&wave, argp, sizeof(wave))) {
+                return -EFAULT;
+            }
+            if (dev->mode != WS2812_MODE_PWM) {
+                return -ENODEV;
+            }
+
+            // check valid input
+            if (!wave.num_samples || wave.num_samples > WS2812_WAVEFORM_MAX_SAMPLES ||
+                wave.loops > WS2812_WAVEFORM_MAX_LOOPS || wave._reserved ||
+                (wave.divider && ((wave.divider & ~CM_PWMDIV_MASK) || (wave.divider >> 12) < 2))) {
+                LOGE("- Invalid waveform.");
+                return -EINVAL;
+            }
+            samples = memdup_user(u64_to_user_ptr(wave.samples), wave.num_samples * sizeof(u32));
+            if (IS_ERR(samples)) {
+                return PTR_ERR(samples);
+            }
+
+            mutex_lock(&dev->lock);
+            retval = ws2812_waveform_play(dev, samples, wave.num_samples, wave.loops, wave.divider);
+            mutex_unlock(&dev->lock);
+
+            kfree(samples);
+            return retval;
+
+        case WS2812_IOC_PLAY_SEQUENCE:
+            if (copy_from_user(&seq, argp, sizeof(seq))) {
+                return -EFAULT;
+            }
+            if (dev->mode != WS2812_MODE_PIXEL) {
+                return -ENODEV;
+            }
+            if (dev->chan || dev->parallel.strips) {
+                return -EOPNOTSUPP;
+            }
+            if (seq._reserved) {
+                return -EINVAL;
+            }
+            if (seq.size > WS2812_ANIM_MAX_BYTES) {
+                return -EFBIG;
+            }
+
+            // size 0 hands the channel back to the frame chain
+            if (!seq.size) {
+                mutex_lock(&dev->lock);
+                if (dev->seq) {
+                    ws2812_seq_stop(dev);
+                }
+                mutex_unlock(&dev->lock);
+                return 0;
+            }
+
+            data = vmemdup_user(u64_to_user_ptr(seq.data), seq.size);
+            if (IS_ERR(data)) {
+                return PTR_ERR(data);
+            }
+
+            mutex_lock(&dev->lock);
+            dev->rendered = true;
+            retval = ws2812_seq_play(dev, data, seq.size);
+            mutex_unlock(&dev->lock);
+
+            kvfree(data);
+            return retval;
+
+        case WS2812_IOC_SET_LAYOUT:
+            if (copy_from_user(&layout, argp, sizeof(layout))) {
+                return -EFAULT;
+            }
+            if (dev->mode != WS2812_MODE_PIXEL) {
+                return -ENODEV;
+            }
+            if (dev->parallel.strips) {
+                return -EOPNOTSUPP;
+            }
+            if (layout._reserved || (layout.flags & ~WS2812_LAYOUT_FLAGS) ||
+                (u64)layout.width * layout.height > dev->num_leds) {
+                LOGE("- Invalid layout.");
+                return -EINVAL;
+            }
+            if (layout.table && layout.width) {
+                table = memdup_user(u64_to_user_ptr(layout.table), layout.width * layout.height * sizeof(u16));
+                if (IS_ERR(table)) {
+                    return PTR_ERR(table);
+                }
+            }
+
+            mutex_lock(&dev->lock);
+            retval = ws2812_layout_set(dev, &layout, table);
+            if (!retval) {
+                ws2812_render(dev);
+            }
+            mutex_unlock(&dev->lock);
+
+            kfree(table);
+            return retval;
+
+        case WS2812_IOC_SET_CROSSFADE:
+            if (copy_from_user(&crossfade, argp, sizeof(crossfade))) {
+                return -EFAULT;
+            }
+            if (dev->mode != WS2812_MODE_PIXEL) {
+                return -ENODEV;
+            }
+            if (crossfade._reserved ||
+                (crossfade.duration_us > WS2812_CROSSFADE_MAX_US && crossfade.duration_us != WS2812_CROSSFADE_AUTO)) {
+                return -EINVAL;
+            }
+
+            mutex_lock(&dev->lock);
+            ws2812_fade_set(dev, crossfade.duration_us);
+            mutex_unlock(&dev->lock);
+            return 0;
+
+        default:
+            return -ENOTTY;
+    }
+}
+
+// mmap function; shares the layer's pixel buffer with userspace
+static int ws2812_mmap(struct file *file, struct vm_area_struct *vma) {
+    // function setup
+    struct ws2812_layer *layer = file->private_data;
+    struct ws2812_dev *dev = layer->dev;
+    int retval = 0;
+
+    // check valid mapping
+    if (dev->mode != WS2812_MODE_PIXEL) {
+        return -ENODEV;
+    }
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > WS2812_MAP_SIZE) {
+        LOGE("- Invalid mapping; map up to %lu bytes at offset 0.", (unsigned long)WS2812_MAP_SIZE);
+        return -EINVAL;
+    }
+
+    // allocate the buffer on first map
+    mutex_lock(&dev->lock);
+    if (!layer->map) {
+        layer->map = vmalloc_user(WS2812_MAP_SIZE);
+        if (!layer->map) {
+            retval = -ENOMEM;
+        }
+    }
+    mutex_unlock(&dev->lock);
+    if (retval) {
+        LOGE("- Failed to allocate mapped pixel buffer.");
+        return retval;
+    }
+
+    return remap_vmalloc_range(vma, layer->map, 0);
+}
+
+// poll function; writable when a frame can be rendered without waiting
+static __poll_t ws2812_poll(struct file *file, poll_table *wait) {
+    // function setup
+    struct ws2812_layer *layer = file->private_data;
+    struct ws2812_dev *dev = layer->dev;
+
+    poll_wait(file, &dev->dma_wait, wait);
+    if (ws2812_frame_ready(dev)) {
+        return EPOLLOUT | EPOLLWRNORM;
+    }
+    return 0;
+}
+
+/**
+ * ws2812_write_pixels()
+ * 
+ * Pixel mode write; takes an array of led_t starting at the first LED of the layer.
+ * LEDs past the end of the write keep their current color
+ */
+static ssize_t ws2812_write_pixels(struct ws2812_layer *layer, const char __user *buf, size_t count) {
+    // function setup
+    struct ws2812_dev *dev = layer->dev;
+    size_t max_count = ws2812_layer_span(layer) * sizeof(led_t);
+
+    // check for valid parameters
+    if (count < sizeof(led_t) || count > max_count || count % sizeof(led_t)) {
+        LOGE("- Invalid frame size %zu; expected a multiple of %zu up to %zu.", count, sizeof(led_t), max_count);
+        return -EINVAL;
+    }
+
+    // copy from user into the layer
+    if (copy_from_user(layer->pixels, buf, count)) {
+        LOGE("- Copy from userspace failed.");
+        return -EFAULT;
+    }
+    layer->visible = true;
+
+    // composite all layers and re-encode whatever changed
+    ws2812_show(dev);
+
+    // return
+    return count;
+}
+
+/**
+ * ws2812_write_rle()
+ * 
+ * Pixel mode write in WS2812_FORMAT_RLE; takes an array of ws2812_rle_run and
+ * expands the runs from the first LED of the layer. LEDs past the last run keep
+ * their current color
+ */
+static ssize_t ws2812_write_rle(struct ws2812_layer *layer, const char __user *buf, size_t count) {
+    // function setup
+    struct ws2812_dev *dev = layer->dev;
+    unsigned int span = ws2812_layer_span(layer);
+    unsigned int num_runs = count / sizeof(struct ws2812_rle_run);
+    unsigned int led = 0;
+    struct ws2812_rle_run *run;
+
+    // check for valid parameters; every run covers at least one LED
+    if (count < sizeof(struct ws2812_rle_run) || count % sizeof(struct ws2812_rle_run) || num_runs > span) {
+        LOGE("- Invalid RLE frame size %zu.", count);
+        return -EINVAL;
+    }
+
+    // copy from user
+    if (copy_from_user(dev->runs, buf, count)) {
+        LOGE("- Copy from userspace failed.");
+        return -EFAULT;
+    }
+
+    // check the runs are well formed and fit before touching the layer
+    for (unsigned int i = 0; i < num_runs; ++i) {
+        if (!dev->runs[i].count) {
+            LOGE("- RLE run %u is empty.", i);
+            return -EINVAL;
+        }
+        led += dev->runs[i].count;
+    }
+    if (led > span) {
+        LOGE("- RLE frame covers %u LEDs; layer has %u.", led, span);
+        return -EINVAL;
+    }
+
+    // expand into the layer
+    led = 0;
+    for (run = dev->runs; run < dev->runs + num_runs; ++run) {
+        for (unsigned int i = 0; i < run->count; ++i, ++led) {
+            layer->pixels[led].red = run->red;
+            layer->pixels[led].green = run->green;
+            layer->pixels[led].blue = run->blue;
+        }
+    }
+    layer->visible = true;
+
+    // composite all layers and re-encode whatever changed
+    ws2812_show(dev);
+
+    // return
+    return count;
+}
+
+/**
+ * ws2812_write_indexed()
+ * 
+ * Pixel mode write in WS2812_FORMAT_INDEXED; takes one palette index per LED from
+ * the first LED of the layer. LEDs past the end of the write keep their index
+ */
+static ssize_t ws2812_write_indexed(struct ws2812_layer *layer, const char __user *buf, size_t count) {
+    // function setup
+    struct ws2812_dev *dev = layer->dev;
+    size_t max_count = ws2812_layer_span(layer);
+
+    // check for valid parameters
+    if (count < 1 || count > max_count) {
+        LOGE("- Invalid indexed frame size %zu; expected up to %zu.", count, max_count);
+        return -EINVAL;
+    }
+
+    // copy from user
+    if (copy_from_user(layer->indices, buf, count)) {
+        LOGE("- Copy from userspace failed.");
+        return -EFAULT;
+    }
+
+    // resolve through the palette
+    ws2812_layer_resolve(layer);
+    layer->indexed = true;
+    layer->visible = true;
+
+    // composite all layers and re-encode whatever changed
+    ws2812_show(dev);
+
+    // return
+    return count;
+}
+
+/**
+ * ws2812_commit()
+ * 
+ * Show the contents of the layer's mapped pixel buffer; the mmap() counterpart of
+ * a WS2812_FORMAT_RGB write covering the whole layer
+ */
+static int ws2812_commit(struct ws2812_layer *layer) {
+    // function setup
+    struct ws2812_dev *dev = layer->dev;
+
+    if (!layer->map) {
+        LOGE("- Commit without a mapped pixel buffer.");
+        return -EINVAL;
+    }
+
+    // snapshot the shared buffer; userspace may already be drawing the next frame
+    memcpy(layer->pixels, layer->map, ws2812_layer_span(layer) * sizeof(led_t));
+    layer->indexed = false;
+    layer->visible = true;
+
+    // composite all layers and re-encode whatever changed
+    ws2812_show(dev);
+
+    return 0;
+}
+
+/**
+ * ws2812_write_duty()
+ * 
+ * PWM mode write; takes the duty cycle as a decimal string (0-100)
+ */
+static ssize_t ws2812_write_duty(struct ws2812_dev *dev, const char __user *buf, size_t count) {
+    // function setup
+    char user_buffer[16];
+    int retval;
+
+    // check for valid parameters
+    if (count < 1 || count > sizeof(user_buffer) - 1) {
+        LOGE("- Invalid message size.");
+        return -EINVAL;
+    }
+
+    // copy from user
+    if ((retval = copy_from_user(user_buffer, buf, count))) {
+        LOGE("- Copy from userspace failed.");
+        return -EFAULT;
+    }
+
+    // null-terminate string
+    user_buffer[count] = '\0';
+
+    // convert string to integer
+    if ((retval = kstrtoint(user_buffer, 10, &dev->duty_cycle))) {
+        LOGE("- Converting string to int failed.");
+        return retval;
+    }
+    
+    // check valid input
+    if (dev->duty_cycle < 0 || dev->duty_cycle > 100) {
+        LOGE("- Invalid input; please use 0-100");
+        return -EINVAL;
+    }
+
+    // hold the duty cycle as a one-sample waveform; DAT1 is unused while the FIFO
+    // feeds the PWM, and this switches over without stopping the output
+    retval = ws2812_waveform_play(dev, (u32[]){ dev->duty_cycle }, 1, 0, 0);
+    if (retval) {
+        return retval;
+    }
+
+    // return
+    return count;
+}
+
+/**************************************************************************************
+ * LAYERS
+ **************************************************************************************/
+
+/**
+ * ws2812_layer_span()
+ * 
+ * Number of LEDs a layer covers
+ */
+static unsigned int ws2812_layer_span(const struct ws2812_layer *layer) {
+    return layer->cfg.num_leds ? layer->cfg.num_leds : WS2812_MAX_LEDS - layer->cfg.first_led;
+}
+
+/**
+ * ws2812_layer_insert()
+ * 
+ * Insert a layer into the device's list, above every layer with the same or lower z
+ */
+static void ws2812_layer_insert(struct ws2812_dev *dev, struct ws2812_layer *layer) {
+    // function setup
+    struct ws2812_layer *pos;
+
+    list_for_each_entry(pos, &dev->layers, node) {
+        if (pos->cfg.z > layer->cfg.z) {
+            list_add_tail(&layer->node, &pos->node);
+            return;
+        }
+    }
+    list_add_tail(&layer->node, &dev->layers);
+}
+
+/**
+ * ws2812_layer_alloc_palette()
+ * 
+ * Allocate and encode a layer's palette words on first use of the indexed format
+ */
+static int ws2812_layer_alloc_palette(struct ws2812_layer *layer) {
+    if (layer->palette_words) {
+        return 0;
+    }
+
+    layer->palette_words = kvmalloc_array(WS2812_PALETTE_SIZE, sizeof(ws2812_encoded_led_t), GFP_KERNEL);
+    if (!layer->palette_words) {
+        LOGE("- Failed to allocate palette.");
+        return -ENOMEM;
+    }
+    ws2812_encode(&layer->dev->encoder, layer->palette_words[0], layer->palette, WS2812_PALETTE_SIZE);
+
+    return 0;
+}
+
+/**
+ * ws2812_layer_resolve()
+ * 
+ * Look up every index of an indexed layer in its palette
+ */
+static void ws2812_layer_resolve(struct ws2812_layer *layer) {
+    for (unsigned int i = 0; i < ws2812_layer_span(layer); ++i) {
+        layer->pixels[i] = layer->palette[layer->indices[i]];
+    }
+}
+
+/**
+ * ws2812_layer_set_palette()
+ * 
+ * Replace part of a layer's palette, re-encode the changed entries and, if the
+ * layer is showing indexed pixels, re-render it through the new palette
+ */
+static int ws2812_layer_set_palette(struct ws2812_layer *layer, const struct ws2812_palette *palette) {
+    // function setup
+    struct ws2812_dev *dev = layer->dev;
+    int retval;
+
+    // check valid input
+    if (palette->count < 1 || palette->first >= WS2812_PALETTE_SIZE ||
+        palette->count > WS2812_PALETTE_SIZE - palette->first) {
+        LOGE("- Invalid palette range %u+%u.", palette->first, palette->count);
+        return -EINVAL;
+    }
+
+    if ((retval = ws2812_layer_alloc_palette(layer))) {
+        return retval;
+    }
+
+    // update and re-encode the changed entries
+    for (unsigned int i = 0; i < palette->count; ++i) {
+        layer->palette[palette->first + i].red = palette->entries[i].red;
+        layer->palette[palette->first + i].green = palette->entries[i].green;
+        layer->palette[palette->first + i].blue = palette->entries[i].blue;
+    }
+    ws2812_encode(&dev->encoder, layer->palette_words[palette->first], &layer->palette[palette->first], palette->count);
+
+    // re-render
+    if (layer->visible && layer->format == WS2812_FORMAT_INDEXED && layer->indexed &&
+        dev->mode == WS2812_MODE_PIXEL) {
+        ws2812_layer_resolve(layer);
+        ws2812_show(dev);
+    }
+
+    return 0;
+}
+
+/**
+ * blend_over()
+ * 
+ * (src * alpha + dst * (255 - alpha)) / 255, rounded, without a divide
+ */
+static inline uint8_t blend_over(uint8_t src, uint8_t dst, uint8_t alpha) {
+    unsigned int t = src * alpha + dst * (255 - alpha) + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+/**
+ * ws2812_blend()
+ * 
+ * Blend n LEDs of a layer onto the frame
+ */
+static void ws2812_blend(led_t *dst, const led_t *src, unsigned int n, uint8_t mode, uint8_t alpha) {
+    switch (mode) {
+        case WS2812_BLEND_OVER:
+            if (alpha == 255) {
+                memcpy(dst, src, n * sizeof(led_t));
+                return;
+            }
+            for (unsigned int i = 0; i < n; ++i) {
+                dst[i].red = blend_over(src[i].red, dst[i].red, alpha);
+                dst[i].green = blend_over(src[i].green, dst[i].green, alpha);
+                dst[i].blue = blend_over(src[i].blue, dst[i].blue, alpha);
+            }
+            return;
+
+        case WS2812_BLEND_ADD:
+            for (unsigned int i = 0; i < n; ++i) {
+                dst[i].red = min_t(unsigned int, dst[i].red + src[i].red, U8_MAX);
+                dst[i].green = min_t(unsigned int, dst[i].green + src[i].green, U8_MAX);
+                dst[i].blue = min_t(unsigned int, dst[i].blue + src[i].blue, U8_MAX);
+            }
+            return;
+
+        case WS2812_BLEND_MAX:
+            for (unsigned int i = 0; i < n; ++i) {
+                dst[i].red = max(dst[i].red, src[i].red);
+                dst[i].green = max(dst[i].green, src[i].green);
+                dst[i].blue = max(dst[i].blue, src[i].blue);
+            }
+            return;
+    }
+}
+
+/**
+ * ws2812_composite()
+ * 
+ * Composite every visible layer, bottom to top, into the staged frame; LEDs no
+ * layer covers are off
+ */
+static void ws2812_composite(struct ws2812_dev *dev) {
+    // function setup
+    struct ws2812_layer *layer, *top = NULL;
+    unsigned int num_visible = 0;
+
+    memset(dev->frame, 0, sizeof(dev->frame));
+    list_for_each_entry(layer, &dev->layers, node) {
+        if (layer->visible) {
+            ws2812_blend(&dev->frame[layer->cfg.first_led], layer->pixels, ws2812_layer_span(layer),
+                layer->cfg.blend, layer->cfg.alpha);
+            top = layer;
+            ++num_visible;
+        }
+    }
+
+    // a lone opaque layer can be encoded straight from its own format: RLE frames
+    // are runs (plus black outside the layer), full-strip indexed frames are palette
+    // entries (unless a commit replaced the pixels since the last indexed write)
+    dev->frame_source = WS2812_FRAME_COMPOSITED;
+    dev->frame_layer = NULL;
+    if (num_visible == 1 && top->cfg.blend == WS2812_BLEND_OVER && top->cfg.alpha == 255) {
+        if (top->format == WS2812_FORMAT_RLE) {
+            dev->frame_source = WS2812_FRAME_RUNS;
+        } else if (top->format == WS2812_FORMAT_INDEXED && top->indexed &&
+            ws2812_layer_span(top) == WS2812_MAX_LEDS) {
+            dev->frame_source = WS2812_FRAME_INDEXED;
+        }
+        dev->frame_layer = top;
+    }
+}
+
+/**************************************************************************************
+ * FRAME RENDERING
+ **************************************************************************************/
+
+/**
+ * ws2812_frame_period_ns()
+ * 
+ * Time the DMA takes to stream one pass of the control block chain; the attached
+ * LEDs plus the latch gap
+ */
+static u64 ws2812_frame_period_ns(struct ws2812_dev *dev) {
+    if (dev->parallel.strips) {
+        return ((u64)dev->parallel.strip_leds * WS2812_WORDS_PER_LED * WS2812_PARALLEL_PHASES +
+            dev->parallel.latch_phases) * dev->parallel.phase_ns;
+    }
+    return ((u64)dev->num_leds * WS2812_WORDS_PER_LED + dev->latch_words) * WS2812_BIT_NS;
+}
+
+/**
+ * ws2812_fps_account()
+ * 
+ * Count a rendered frame towards the achieved frame rate
+ */
+static void ws2812_fps_account(struct ws2812_dev *dev) {
+    // function setup
+    ktime_t now = ktime_get();
+    s64 elapsed_us = ktime_us_delta(now, dev->fps_window_start);
+
+    ++dev->fps_window_frames;
+    if (elapsed_us >= WS2812_FPS_WINDOW_US) {
+        dev->achieved_fps_milli = div64_u64((u64)dev->fps_window_frames * USEC_PER_SEC * 1000, elapsed_us);
+        dev->fps_window_start = now;
+        dev->fps_window_frames = 0;
+    }
+}
+
+/**
+ * ws2812_get_timing()
+ * 
+ * Fill in the frame timing report. If nothing was rendered for longer than a
+ * window, the open window is reported instead so the rate falls off when writes stop
+ */
+static void ws2812_get_timing(struct ws2812_dev *dev, struct ws2812_timing *timing) {
+    // function setup
+    u64 period_ns = ws2812_frame_period_ns(dev);
+    s64 elapsed_us = ktime_us_delta(ktime_get(), dev->fps_window_start);
+
+    timing->num_leds = dev->num_leds;
+    timing->frame_ns = period_ns;
+    timing->latch_ns = dev->latch_words * WS2812_BIT_NS;
+    if (dev->parallel.strips) {
+        timing->latch_ns = dev->parallel.latch_phases * dev->parallel.phase_ns;
+    }
+    timing->max_fps_milli = period_ns ? div64_u64((u64)NSEC_PER_SEC * 1000, period_ns) : 0;
+    timing->achieved_fps_milli = dev->achieved_fps_milli;
+    if (elapsed_us >= 2 * WS2812_FPS_WINDOW_US) {
+        timing->achieved_fps_milli = div64_u64((u64)dev->fps_window_frames * USEC_PER_SEC * 1000, elapsed_us);
+    }
+}
+
+/**
+ * ws2812_segment_idle()
+ * 
+ * Whether a segment's idle buffer is free to encode into (see ws2812_segment_wait)
+ */
+static bool ws2812_segment_idle(struct ws2812_dev *dev, struct ws2812_segment *seg) {
+    if (dev->chan) {
+        return READ_ONCE(dev->completed) >= seg->relink_seq;
+    }
+    return ktime_to_ns(ktime_sub(ktime_get(), seg->relinked)) >= ws2812_frame_period_ns(dev);
+}
+
+/**
+ * ws2812_segment_wait()
+ * 
+ * Wait until a segment's idle buffer can no longer be in flight. After a relink the
+ * DMA may still be streaming the old buffer, but it picks up the new source address
+ * at its next pass, so one frame period after the relink the old buffer is free
+ */
+static void ws2812_segment_wait(struct ws2812_dev *dev, struct ws2812_segment *seg) {
+    // function setup
+    s64 period_us = DIV_ROUND_UP(ws2812_frame_period_ns(dev), NSEC_PER_USEC);
+    s64 elapsed_us = ktime_us_delta(ktime_get(), seg->relinked);
+
+    // dmaengine frames report completion, so wait for exactly the frames that
+    // could still be reading the idle buffer
+    if (dev->chan) {
+        if (!wait_event_timeout(dev->dma_wait, ws2812_segment_idle(dev, seg),
+                msecs_to_jiffies(WS2812_DMA_TIMEOUT_MS))) {
+            LOGW("- Timed out waiting for a dmaengine frame to complete.");
+        }
+        return;
+    }
+
+    if (elapsed_us < period_us) {
+        usleep_range(period_us - elapsed_us, period_us - elapsed_us + DELAY_SHORT);
+    }
+}
+
+/**
+ * ws2812_dma_busy()
+ * 
+ * Whether a frame is still being sent
+ */
+static bool ws2812_dma_busy(struct ws2812_dev *dev) {
+    if (dev->chan) {
+        return READ_ONCE(dev->in_flight);
+    }
+    return *DMA_REG(DMA_CS_OFFSET) & DMA_CS_ACTIVE_MASK;
+}
+
+/**
+ * ws2812_frame_ready()
+ * 
+ * Whether the next frame can be rendered without waiting on the DMA; this is the
+ * free frame slot O_NONBLOCK writes and poll() report
+ */
+static bool ws2812_frame_ready(struct ws2812_dev *dev) {
+    if (dev->mode != WS2812_MODE_PIXEL) {
+        return true;
+    }
+    if (dev->parallel.strips) {
+        return !ws2812_parallel_busy(dev, !dev->parallel.active);
+    }
+    if (dev->oneshot) {
+        // a playing sequence hands the channel over as soon as a frame is rendered
+        return !ws2812_dma_busy(dev) || dev->seq;
+    }
+    for (unsigned int i = 0; i < dev->num_segments; ++i) {
+        if (!ws2812_segment_idle(dev, &dev->segments[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * ws2812_ready_timer()
+ * 
+ * Runs a frame period after a raw-channel render, when the slot it used frees up;
+ * wakes pollers. A one-shot frame that is still sending is checked again when its
+ * frame period is up; anything running late (a sequence on its way out) every
+ * quarter frame, but never more often than every WS2812_READY_POLL_US
+ */
+static enum hrtimer_restart ws2812_ready_timer(struct hrtimer *timer) {
+    // function setup
+    struct ws2812_dev *dev = container_of(timer, struct ws2812_dev, ready_timer);
+    s64 period_ns = ws2812_frame_period_ns(dev);
+    s64 left_ns = 0;
+
+    if (!ws2812_frame_ready(dev)) {
+        if (dev->oneshot) {
+            left_ns = period_ns - ktime_to_ns(ktime_sub(ktime_get(), dev->started));
+        }
+        left_ns = max3(left_ns, period_ns / 4, (s64)WS2812_READY_POLL_US * NSEC_PER_USEC);
+        hrtimer_forward_now(timer, ns_to_ktime(left_ns));
+        return HRTIMER_RESTART;
+    }
+    wake_up(&dev->dma_wait);
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * ws2812_oneshot_wait()
+ * 
+ * Wait for the last one-shot frame to finish; once the channel is idle neither
+ * buffer of any segment is in flight. A sequence that was just stopped can still
+ * finish its current hold, play one more frame and run that frame's hold (see
+ * ws2812_seq_stop()), so it gets two holds plus a frame period to end on a latched
+ * frame before the channel is reset under it
+ */
+static void ws2812_oneshot_wait(struct ws2812_dev *dev) {
+    // function setup
+    volatile unsigned int *dma_cs = DMA_REG(DMA_CS_OFFSET);
+    s64 period_us = DIV_ROUND_UP(ws2812_frame_period_ns(dev), NSEC_PER_USEC);
+    s64 elapsed_us = ktime_us_delta(ktime_get(), dev->started);
+    ktime_t start = ktime_get();
+    int timeout;
+
+    while (dev->seq_retired && ws2812_seq_busy(dev, dev->seq_retired) &&
+        ktime_us_delta(ktime_get(), start) < 2 * WS2812_ANIM_HOLD_US + period_us) {
+        usleep_range(10 * DELAY_SHORT, 20 * DELAY_SHORT);
+    }
+
+    // the frame cannot finish sooner than one frame period after it started
+    if (elapsed_us < period_us && ws2812_dma_busy(dev)) {
+        usleep_range(period_us - elapsed_us, period_us - elapsed_us + DELAY_SHORT);
+    }
+
+    for (timeout = 100; ws2812_dma_busy(dev) && timeout; --timeout) {
+        usleep_range(DELAY_SHORT, 2 * DELAY_SHORT);
+    }
+    if (!timeout) {
+        LOGW("- DMA still active a frame period after starting; resetting channel.");
+        if (dev->chan) {
+            dmaengine_terminate_sync(dev->chan);
+            WRITE_ONCE(dev->in_flight, false);
+        } else {
+            *dma_cs = DMA_CS_RESET(1);
+        }
+    }
+}
+
+/**
+ * ws2812_oneshot_start()
+ * 
+ * Send the chain once; it ends on the latch block, after which the channel stops
+ */
+static void ws2812_oneshot_start(struct ws2812_dev *dev) {
+    // function setup
+    volatile unsigned int *dma_cs = DMA_REG(DMA_CS_OFFSET);
+    volatile unsigned int *dma_conblkad = DMA_REG(DMA_CONBLKAD_OFFSET);
+
+    if (dev->gated) {
+        ws2812_hw_pwm_gate(&dev->hw, false);
+        dev->gated = false;
+    }
+
+    if (dev->chan) {
+        if (ws2812_dmaengine_submit(dev, false)) {
+            LOGE("- Failed to submit dmaengine frame.");
+        }
+    } else {
+        // clear the previous END flag and restart from the first block
+        *dma_cs = DMA_CS_END(1);
+        *dma_conblkad = dev->cb_phys;
+        *dma_cs |= DMA_CS_ACTIVE(1);
+    }
+    dev->started = ktime_get();
+
+    if (dev->gate) {
+        mod_delayed_work(system_wq, &dev->gate_work,
+            usecs_to_jiffies(DIV_ROUND_UP(ws2812_frame_period_ns(dev), NSEC_PER_USEC)) + 1);
+    }
+}
+
+/**
+ * ws2812_gate_work()
+ * 
+ * Runs a frame period after a one-shot frame started; gates the PWM and its clock
+ * once the frame is out
+ */
+static void ws2812_gate_work(struct work_struct *work) {
+    // function setup
+    struct ws2812_dev *dev = container_of(to_delayed_work(work), struct ws2812_dev, gate_work);
+
+    mutex_lock(&dev->lock);
+    if (dev->seq) {
+        // a sequence owns the channel; ws2812_seq_stop() gates behind it
+    } else if (ws2812_dma_busy(dev)) {
+        // still sending; look again shortly
+        schedule_delayed_work(&dev->gate_work, 1);
+    } else if (!dev->gated) {
+        ws2812_hw_pwm_gate(&dev->hw, true);
+        dev->gated = true;
+    }
+    mutex_unlock(&dev->lock);
+}
+
+/**
+ * ws2812_segment_changed()
+ * 
+ * Whether a segment's pixels, in wiring order, differ from what is encoded
+ */
+static bool ws2812_segment_changed(struct ws2812_dev *dev, struct ws2812_segment *seg) {
+    if (!dev->layout_active) {
+        return memcmp(&dev->frame[seg->first_led], &dev->leds[seg->first_led], seg->num_leds * sizeof(led_t));
+    }
+    for (unsigned int led = seg->first_led; led < seg->first_led + seg->num_leds; ++led) {
+        if (memcmp(&dev->frame[dev->layout[led]], &dev->leds[led], sizeof(led_t))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * ws2812_render()
+ * 
+ * Bring the DMA chain up to date with the staged frame. Each segment whose pixels
+ * differ from what is encoded is encoded into its idle buffer and its control block
+ * is relinked; unchanged segments cost one compare and are never touched
+ */
+static void ws2812_render(struct ws2812_dev *dev) {
+    // function setup
+    struct ws2812_segment *seg;
+    bool changed = false;
+    unsigned long flags;
+    size_t bytes;
+    int next;
+
+    // the first frame from userspace ends the boot animation or sequence
+    dev->rendered = true;
+    if (dev->seq) {
+        ws2812_seq_stop(dev);
+    }
+    if (dev->parallel.strips) {
+        ws2812_parallel_render(dev);
+        return;
+    }
+
+    for (unsigned int i = 0; i < dev->num_segments; ++i) {
+        seg = &dev->segments[i];
+        bytes = seg->num_leds * sizeof(led_t);
+
+        // skip segments that did not change
+        if (!ws2812_segment_changed(dev, seg)) {
+            continue;
+        }
+
+        // encode into the idle buffer; run-length frames reuse one pattern per run,
+        // indexed frames copy pre-encoded palette entries, and matrix layouts gather
+        // each LED from its frame position as it is encoded
+        next = !seg->active;
+        if (!dev->oneshot) {
+            ws2812_segment_wait(dev, seg);
+        } else if (!changed) {
+            ws2812_oneshot_wait(dev);
+        }
+        switch (dev->layout_active ? WS2812_FRAME_COMPOSITED : dev->frame_source) {
+            case WS2812_FRAME_RUNS:
+                ws2812_encode_runs(&dev->encoder, seg->buffer[next], &dev->frame[seg->first_led], seg->num_leds);
+                break;
+            case WS2812_FRAME_INDEXED:
+                ws2812_encode_indexed((const ws2812_encoded_led_t *)dev->frame_layer->palette_words, seg->buffer[next],
+                    &dev->frame_layer->indices[seg->first_led], seg->num_leds);
+                break;
+            default:
+                if (dev->layout_active) {
+                    ws2812_encode_remap(&dev->encoder, seg->buffer[next], dev->frame, &dev->layout[seg->first_led],
+                        seg->num_leds);
+                } else {
+                    ws2812_encode(&dev->encoder, seg->buffer[next], &dev->frame[seg->first_led], seg->num_leds);
+                }
+                break;
+        }
+        ws2812_buffer_sync(dev, seg->buffer[next], seg->num_leds * WS2812_WORDS_PER_LED * sizeof(uint32_t));
+
+        // make the data visible before the DMA can follow the new link; dmaengine
+        // frames pick up the active buffer when they are submitted
+        wmb();
+        if (dev->chan) {
+            spin_lock_irqsave(&dev->submit_lock, flags);
+            seg->active = next;
+            seg->relink_seq = dev->submitted;
+            spin_unlock_irqrestore(&dev->submit_lock, flags);
+        } else {
+            dev->dma_cb[i].source_ad = seg->buffer_phys[next];
+            seg->active = next;
+        }
+        seg->relinked = ktime_get();
+        changed = true;
+
+        if (dev->layout_active) {
+            for (unsigned int led = seg->first_led; led < seg->first_led + seg->num_leds; ++led) {
+                dev->leds[led] = dev->frame[dev->layout[led]];
+            }
+        } else {
+            memcpy(&dev->leds[seg->first_led], &dev->frame[seg->first_led], bytes);
+        }
+        LOG("+ Re-encoded segment %u (LEDs %u-%u).", i, seg->first_led, seg->first_led + seg->num_leds - 1);
+    }
+
+    if (changed) {
+        if (dev->oneshot) {
+            ws2812_oneshot_start(dev);
+        }
+        if (!dev->chan) {
+            hrtimer_start(&dev->ready_timer, ns_to_ktime(ws2812_frame_period_ns(dev)), HRTIMER_MODE_REL);
+        }
+        ws2812_fps_account(dev);
+    }
+}
+
+/**
+ * ws2812_show()
+ * 
+ * Composite the layers and show the result; straight away, or as the target of a
+ * crossfade from what the strip shows now
+ */
+static void ws2812_show(struct ws2812_dev *dev) {
+    ws2812_composite(dev);
+    if (dev->fade.duration_us) {
+        ws2812_fade_start(dev);
+    } else {
+        ws2812_render(dev);
+    }
+}
+
+/**************************************************************************************
+ * PARALLEL OUTPUT
+ **************************************************************************************/
+
+/**
+ * ws2812_parallel_build()
+ * 
+ * Chain the control blocks of one chain: per bit, set every line, clear the lines
+ * sending a 0 (that bit's word of the chain's buffer) and clear every line, each
+ * followed by a pacing write to the PWM FIFO. The latch block paces latch_phases
+ * zero words and loops back to the start of the chain
+ */
+static void ws2812_parallel_build(struct ws2812_dev *dev, int chain) {
+    // function setup
+    struct ws2812_parallel *par = &dev->parallel;
+    dma_cb_t *cb = &dev->dma_cb[chain * par->chain_cbs];
+    dma_addr_t cb_phys = dev->cb_phys + chain * par->chain_cbs * sizeof(dma_cb_t);
+    dma_addr_t words = dev->dma_buffer_phys + chain * dev->frame_words * sizeof(uint32_t);
+    dma_addr_t pin_mask = dev->dma_buffer_phys + 2 * dev->frame_words * sizeof(uint32_t);
+    dma_addr_t zero = pin_mask + sizeof(uint32_t);
+    const dma_addr_t sources[WS2812_PARALLEL_PHASES] = { pin_mask, words, pin_mask };
+    const u32 dests[WS2812_PARALLEL_PHASES] = {
+        GPIO_BUS_BASE_ADDRESS + GPIO_GPSET0_OFFSET,
+        GPIO_BUS_BASE_ADDRESS + GPIO_GPCLR0_OFFSET,
+        GPIO_BUS_BASE_ADDRESS + GPIO_GPCLR0_OFFSET,
+    };
+    unsigned int n = 0;
+
+    for (unsigned int bit = 0; bit < dev->frame_words; ++bit) {
+        for (int phase = 0; phase < WS2812_PARALLEL_PHASES; ++phase) {
+            cb[n].ti = DMA_TI_WAIT_RESP(1);
+            cb[n].source_ad = sources[phase] + (phase == 1 ? bit * sizeof(uint32_t) : 0);
+            cb[n].dest_ad = dests[phase];
+            cb[n].txfr_len = sizeof(uint32_t);
+            cb[n].stride = 0;
+            cb[n].nextconbk = cb_phys + (n + 1) * sizeof(dma_cb_t);
+            ++n;
+
+            cb[n].ti = DMA_TI_DESTDREQ(1) | DMA_TI_PERMAP(DMA_PERMAP_PWM);
+            cb[n].source_ad = zero;
+            cb[n].dest_ad = PWM_BUS_BASE_ADDRESS + PWM_FIF1_OFFSET;
+            cb[n].txfr_len = sizeof(uint32_t);
+            cb[n].stride = 0;
+            cb[n].nextconbk = cb_phys + (n + 1) * sizeof(dma_cb_t);
+            ++n;
+        }
+    }
+
+    // latch block; every line is already LOW, so only the pacing is repeated
+    cb[n].ti = DMA_TI_DESTDREQ(1) | DMA_TI_PERMAP(DMA_PERMAP_PWM);
+    cb[n].source_ad = zero;
+    cb[n].dest_ad = PWM_BUS_BASE_ADDRESS + PWM_FIF1_OFFSET;
+    cb[n].txfr_len = par->latch_phases * sizeof(uint32_t);
+    cb[n].stride = 0;
+    cb[n].nextconbk = cb_phys;
+}
+
+/**
+ * ws2812_parallel_busy()
+ * 
+ * Whether the DMA is still executing a block of the given chain
+ */
+static bool ws2812_parallel_busy(struct ws2812_dev *dev, int chain) {
+    // function setup
+    dma_addr_t first = dev->cb_phys + chain * dev->parallel.chain_cbs * sizeof(dma_cb_t);
+    dma_addr_t cb = *DMA_REG(DMA_CONBLKAD_OFFSET);
+
+    return cb >= first && cb < first + dev->parallel.chain_cbs * sizeof(dma_cb_t);
+}
+
+/**
+ * ws2812_parallel_render()
+ * 
+ * Transpose the staged frame into the idle chain's clear words and switch the DMA
+ * over to that chain at the end of its current pass. The idle chain may still be
+ * finishing the pass it was playing before the last switch, so wait that out first
+ */
+static void ws2812_parallel_render(struct ws2812_dev *dev) {
+    // function setup
+    struct ws2812_parallel *par = &dev->parallel;
+    int next = !par->active;
+    uint32_t *words = dev->dma_buffer + next * dev->frame_words;
+    unsigned long deadline = jiffies + msecs_to_jiffies(WS2812_DMA_TIMEOUT_MS);
+
+    if (!memcmp(dev->frame, dev->leds, dev->num_leds * sizeof(led_t))) {
+        return;
+    }
+
+    while (ws2812_parallel_busy(dev, next)) {
+        if (time_after(jiffies, deadline)) {
+            LOGW("- DMA never left the idle chain; overwriting it.");
+            break;
+        }
+        usleep_range(DELAY_SHORT * 10, DELAY_SHORT * 20);
+    }
+
+    // strip s is frame[s * strip_leds], sent on GPIO pin_base + s
+    ws2812_transpose_swar(words, dev->frame, par->strip_leds, par->strips, par->strip_leds, par->pin_base);
+    ws2812_buffer_sync(dev, words, dev->frame_words * sizeof(uint32_t));
+
+    // make the words visible before the DMA can follow the new link
+    wmb();
+    dev->dma_cb[(next + 1) * par->chain_cbs - 1].nextconbk = dev->cb_phys + next * par->chain_cbs * sizeof(dma_cb_t);
+    dev->dma_cb[(par->active + 1) * par->chain_cbs - 1].nextconbk =
+        dev->cb_phys + next * par->chain_cbs * sizeof(dma_cb_t);
+    par->active = next;
+
+    memcpy(dev->leds, dev->frame, dev->num_leds * sizeof(led_t));
+    hrtimer_start(&dev->ready_timer, ns_to_ktime(ws2812_frame_period_ns(dev)), HRTIMER_MODE_REL);
+    ws2812_fps_account(dev);
+}
+
+/**************************************************************************************
+ * CROSSFADE
+ **************************************************************************************/
+
+/**
+ * ws2812_fade_step()
+ * 
+ * Render the step of the current fade that is due now, as a linear blend in 8-bit
+ * fixed point, and schedule the next one a frame period later. The last step is
+ * the target frame itself
+ */
+static void ws2812_fade_step(struct ws2812_dev *dev) {
+    // function setup
+    struct ws2812_fade *fade = &dev->fade;
+    u64 elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), fade->start));
+    u32 w = elapsed_ns >= fade->span_ns ? 256 : div64_u64(elapsed_ns << 8, fade->span_ns);
+
+    for (unsigned int i = 0; i < dev->num_leds; ++i) {
+        dev->frame[i].red = (fade->from[i].red * (256 - w) + fade->to[i].red * w) >> 8;
+        dev->frame[i].green = (fade->from[i].green * (256 - w) + fade->to[i].green * w) >> 8;
+        dev->frame[i].blue = (fade->from[i].blue * (256 - w) + fade->to[i].blue * w) >> 8;
+    }
+    memcpy(fade->shown, dev->frame, sizeof(fade->shown));
+
+    // a blend is never a run or palette frame
+    dev->frame_source = WS2812_FRAME_COMPOSITED;
+    ws2812_render(dev);
+
+    fade->active = w < 256;
+    if (fade->active) {
+        hrtimer_start(&fade->timer, ns_to_ktime(ws2812_frame_period_ns(dev)), HRTIMER_MODE_REL);
+    }
+}
+
+/**
+ * ws2812_fade_start()
+ * 
+ * Start fading from what the strip shows towards the frame just composited. An
+ * automatic fade lasts as long as the gap since the previous frame, at least one
+ * frame period and at most WS2812_CROSSFADE_AUTO_MAX_US
+ */
+static void ws2812_fade_start(struct ws2812_dev *dev) {
+    // function setup
+    struct ws2812_fade *fade = &dev->fade;
+    ktime_t now = ktime_get();
+
+    if (fade->duration_us == WS2812_CROSSFADE_AUTO) {
+        fade->span_ns = clamp_t(u64, ktime_to_ns(ktime_sub(now, fade->last_arrival)), ws2812_frame_period_ns(dev),
+            (u64)WS2812_CROSSFADE_AUTO_MAX_US * NSEC_PER_USEC);
+    } else {
+        fade->span_ns = (u64)fade->duration_us * NSEC_PER_USEC;
+    }
+    fade->last_arrival = now;
+
+    memcpy(fade->from, fade->shown, sizeof(fade->from));
+    memcpy(fade->to, dev->frame, sizeof(fade->to));
+    fade->start = now;
+    ws2812_fade_step(dev);
+}
+
+/**
+ * ws2812_fade_set()
+ * 
+ * Change the crossfade duration. Turning it on starts from the frame on the strip;
+ * turning it off mid-fade jumps to the target frame
+ */
+static void ws2812_fade_set(struct ws2812_dev *dev, u32 duration_us) {
+    // function setup
+    struct ws2812_fade *fade = &dev->fade;
+
+    if (duration_us && !fade->duration_us) {
+        memcpy(fade->shown, dev->frame, sizeof(fade->shown));
+        fade->last_arrival = ktime_get();
+    }
+    fade->duration_us = duration_us;
+
+    if (!duration_us && fade->active) {
+        fade->active = false;
+        memcpy(dev->frame, fade->to, sizeof(dev->frame));
+        ws2812_render(dev);
+    }
+}
+
+/**
+ * ws2812_fade_work()
+ * 
+ * Render the next fade step; the fade may have been superseded or turned off since
+ * the timer fired
+ */
+static void ws2812_fade_work(struct work_struct *work) {
+    // function setup
+    struct ws2812_dev *dev = container_of(work, struct ws2812_dev, fade.work);
+
+    mutex_lock(&dev->lock);
+    if (dev->fade.active) {
+        ws2812_fade_step(dev);
+    }
+    mutex_unlock(&dev->lock);
+}
+
+/**
+ * ws2812_fade_timer()
+ * 
+ * Fires once per frame period while fading; rendering sleeps, so it is handed to
+ * the high priority workqueue
+ */
+static enum hrtimer_restart ws2812_fade_timer(struct hrtimer *timer) {
+    // function setup
+    struct ws2812_dev *dev = container_of(timer, struct ws2812_dev, fade.timer);
+
+    queue_work(system_highpri_wq, &dev->fade.work);
+    return HRTIMER_NORESTART;
+}
+
+/**************************************************************************************
+ * MATRIX LAYOUT
+ **************************************************************************************/
+
+/**
+ * ws2812_layout_index()
+ * 
+ * Frame index (row-major) of the i-th wired LED of a tiled matrix
+ */
+static u16 ws2812_layout_index(const struct ws2812_layout *cfg, unsigned int pw, unsigned int ph, unsigned int i) {
+    // function setup
+    unsigned int panel_cols = cfg->width / pw;
+    unsigned int panel = i / (pw * ph), k = i % (pw * ph);
+    unsigned int prow = panel / panel_cols, pcol = panel % panel_cols;
+    unsigned int major, minor, x, y;
+
+    if ((cfg->flags & WS2812_LAYOUT_PANEL_SERPENTINE) && (prow & 1)) {
+        pcol = panel_cols - 1 - pcol;
+    }
+
+    // position in the panel along the chain: rows (or columns) of minor LEDs
+    major = k / (cfg->flags & WS2812_LAYOUT_COLUMNS ? ph : pw);
+    minor = k % (cfg->flags & WS2812_LAYOUT_COLUMNS ? ph : pw);
+    if ((cfg->flags & WS2812_LAYOUT_SERPENTINE) && (major & 1)) {
+        minor = (cfg->flags & WS2812_LAYOUT_COLUMNS ? ph : pw) - 1 - minor;
+    }
+    x = cfg->flags & WS2812_LAYOUT_COLUMNS ? major : minor;
+    y = cfg->flags & WS2812_LAYOUT_COLUMNS ? minor : major;
+    if (cfg->flags & WS2812_LAYOUT_FLIP_X) {
+        x = pw - 1 - x;
+    }
+    if (cfg->flags & WS2812_LAYOUT_FLIP_Y) {
+        y = ph - 1 - y;
+    }
+
+    return (prow * ph + y) * cfg->width + pcol * pw + x;
+}
+
+/**
+ * ws2812_layout_set()
+ * 
+ * Build the wiring table for a layout, or take it from table; width 0 removes the
+ * layout. The next render re-encodes whatever the new order changes
+ */
+static int ws2812_layout_set(struct ws2812_dev *dev, const struct ws2812_layout *cfg, const u16 *table) {
+    // function setup
+    unsigned int pw = cfg->panel_width ? cfg->panel_width : cfg->width;
+    unsigned int ph = cfg->panel_height ? cfg->panel_height : cfg->height;
+    unsigned int n = cfg->width * cfg->height;
+
+    if (!cfg->width) {
+        dev->layout_active = false;
+        LOG("+ Cleared matrix layout.");
+        return 0;
+    }
+    if (!cfg->height || !pw || !ph || cfg->width % pw || cfg->height % ph) {
+        LOGE("- Invalid layout: %ux%u in %ux%u panels.", cfg->width, cfg->height, pw, ph);
+        return -EINVAL;
+    }
+    for (unsigned int i = 0; table && i < n; ++i) {
+        if (table[i] >= n) {
+            LOGE("- Layout table entry %u out of range.", i);
+            return -EINVAL;
+        }
+    }
+
+    for (unsigned int i = 0; i < dev->num_leds; ++i) {
+        if (i >= n) {
+            dev->layout[i] = i;
+        } else if (table) {
+            dev->layout[i] = table[i];
+        } else {
+            dev->layout[i] = ws2812_layout_index(cfg, pw, ph, i);
+        }
+    }
+    dev->layout_active = true;
+
+    LOG("+ Matrix layout %ux%u in %ux%u panels, flags 0x%x%s.", cfg->width, cfg->height, pw, ph, cfg->flags,
+        table ? " (table)" : "");
+    return 0;
+}
+
+/**************************************************************************************
+ * WAVEFORM PLAYBACK
+ **************************************************************************************/
+
+/**
+ * ws2812_waveform_build()
+ * 
+ * Chain a control block set for n samples of waveform buffer set: loops blocks
+ * playing the buffer, then a hold block repeating the hold word forever. With loops
+ * 0 a single block plays the buffer forever
+ */
+static void ws2812_waveform_build(struct ws2812_dev *dev, int set, unsigned int n, unsigned int loops) {
+    // function setup
+    dma_cb_t *cbs = &dev->dma_cb[set * WS2812_WAVEFORM_CBS];
+    dma_addr_t cbs_phys = dev->cb_phys + set * WS2812_WAVEFORM_CBS * sizeof(dma_cb_t);
+    dma_addr_t buffer_phys = dev->dma_buffer_phys + set * WS2812_WAVEFORM_WORDS * sizeof(uint32_t);
+    unsigned int num_cbs = loops ? loops + 1 : 1;
+
+    for (unsigned int i = 0; i < num_cbs; ++i) {
+        cbs[i].ti = DMA_TI_SRCINC(1) | DMA_TI_DESTDREQ(1) | DMA_TI_PERMAP(DMA_PERMAP_PWM);
+        cbs[i].source_ad = buffer_phys;
+        cbs[i].dest_ad = PWM_BUS_BASE_ADDRESS + PWM_FIF1_OFFSET;
+        cbs[i].txfr_len = n * sizeof(uint32_t);
+        cbs[i].stride = 0;
+        cbs[i].nextconbk = cbs_phys + min(i + 1, num_cbs - 1) * sizeof(dma_cb_t);
+    }
+    if (loops) {
+        // hold block; repeats the word after the samples without advancing
+        cbs[loops].ti &= ~(DMA_TI_SRCINC_MASK);
+        cbs[loops].source_ad = buffer_phys + WS2812_WAVEFORM_MAX_SAMPLES * sizeof(uint32_t);
+        cbs[loops].txfr_len = sizeof(uint32_t);
+    }
+    dev->wave_cbs[set] = num_cbs;
+    dev->wave_samples[set] = n;
+}
+
+/**
+ * ws2812_waveform_set_busy()
+ * 
+ * Whether the DMA is still executing a block of the given set
+ */
+static bool ws2812_waveform_set_busy(struct ws2812_dev *dev, int set) {
+    // function setup
+    dma_addr_t first = dev->cb_phys + set * WS2812_WAVEFORM_CBS * sizeof(dma_cb_t);
+    dma_addr_t cb = *DMA_REG(DMA_CONBLKAD_OFFSET);
+
+    return cb >= first && cb < first + WS2812_WAVEFORM_CBS * sizeof(dma_cb_t);
+}
+
+/**
+ * ws2812_waveform_pass_ns()
+ * 
+ * How long one pass of n samples takes at the current PWM clock
+ */
+static u64 ws2812_waveform_pass_ns(struct ws2812_dev *dev, unsigned int n) {
+    // function setup
+    u64 sample_ns = div_u64((u64)dev->hw.cm_pwmdiv * WS2812_WAVEFORM_RANGE * NSEC_PER_SEC,
+        WS2812_WAVEFORM_CLOCK_HZ);
+
+    return (sample_ns >> 12) * n;
+}
+
+/**
+ * ws2812_waveform_play()
+ * 
+ * Load a waveform into the idle buffer and switch the DMA over to it. Every block
+ * of the playing set is relinked to the new chain, but the DMA latched the running
+ * block's link when it loaded it: the switch happens after the running block and
+ * the one it already leads to (so a looping pass plays once more), and the FIFO
+ * never runs dry
+ */
+static int ws2812_waveform_play(struct ws2812_dev *dev, const u32 *samples, unsigned int n, unsigned int loops,
+    u32 divider) {
+    // function setup
+    int next = !dev->wave_active;
+    uint32_t *buffer = dev->dma_buffer + next * WS2812_WAVEFORM_WORDS;
+    dma_addr_t head = dev->cb_phys + next * WS2812_WAVEFORM_CBS * sizeof(dma_cb_t);
+    unsigned long deadline;
+    int retval;
+
+    for (unsigned int i = 0; i < n; ++i) {
+        if (samples[i] > WS2812_WAVEFORM_RANGE) {
+            LOGE("- Waveform sample %u out of range (%u).", i, samples[i]);
+            return -EINVAL;
+        }
+    }
+    if (dev->chan && loops) {
+        LOGE("- Finite waveform loops need the raw DMA backend.");
+        return -EOPNOTSUPP;
+    }
+
+    // the previous waveform's set may still be playing its last two blocks, which
+    // at a slow clock can take far longer than the timeout alone
+    deadline = jiffies + msecs_to_jiffies(WS2812_WAVEFORM_TIMEOUT_MS) +
+        nsecs_to_jiffies(2 * ws2812_waveform_pass_ns(dev, dev->wave_samples[next]));
+    while (!dev->chan && ws2812_waveform_set_busy(dev, next)) {
+        if (time_after(jiffies, deadline)) {
+            LOGE("- Previous waveform never finished its pass.");
+            return -EBUSY;
+        }
+        if (signal_pending(current)) {
+            return -ERESTARTSYS;
+        }
+        usleep_range(DELAY_SHORT * 100, DELAY_SHORT * 200);
+    }
+
+    memcpy(buffer, samples, n * sizeof(uint32_t));
+    buffer[WS2812_WAVEFORM_MAX_SAMPLES] = samples[n - 1];
+    ws2812_buffer_sync(dev, buffer, WS2812_WAVEFORM_WORDS * sizeof(uint32_t));
+
+    // a new sample rate needs the clock stopped; everything else is seamless. If the
+    // clock does not come back, the old waveform stays linked
+    if (divider && CM_PWMDIV(divider) != dev->hw.cm_pwmdiv) {
+        retval = ws2812_hw_cm_configure(&dev->hw, PWMCTL_OSC, divider, PWMCTL_MASH1STAGE);
+        if (retval) {
+            LOGE("- Failed to set waveform clock divider 0x%08X (%d).", divider, retval);
+            return retval;
+        }
+    }
+
+    if (dev->chan) {
+        // the cyclic transfer can only be replaced, not relinked
+        dmaengine_terminate_sync(dev->chan);
+        dev->wave_active = next;
+        return ws2812_dmaengine_cyclic(dev, dev->dma_buffer_phys + next * WS2812_WAVEFORM_WORDS * sizeof(uint32_t),
+            n * sizeof(uint32_t));
+    }
+
+    ws2812_waveform_build(dev, next, n, loops);
+
+    // make the chain visible before the DMA can follow a link into it
+    wmb();
+    for (unsigned int i = 0; i < dev->wave_cbs[dev->wave_active]; ++i) {
+        dev->dma_cb[dev->wave_active * WS2812_WAVEFORM_CBS + i].nextconbk = head;
+    }
+    dev->wave_active = next;
+    LOG("+ Playing %u-sample waveform, %u loops.", n, loops);
+
+    return 0;
+}
+
+/**************************************************************************************
+ * FRAME SEQUENCES
+ **************************************************************************************/
+// most words one hold block sends
+#define ANIM_HOLD_WORDS                     (WS2812_ANIM_HOLD_US * NSEC_PER_USEC / WS2812_BIT_NS)
+
+/**
+ * ws2812_anim_frame()
+ * 
+ * Frame f of an animation file
+ */
+static const struct ws2812_anim_frame *ws2812_anim_frame(const struct ws2812_anim_header *hdr, unsigned int f) {
+    return (const void *)((const u8 *)(hdr + 1) + f * WS2812_ANIM_FRAME_SIZE(hdr->num_leds));
+}
+
+/**
+ * ws2812_anim_hold_words()
+ * 
+ * LOW words a frame is held for after its data: the rest of its duration, and at
+ * least the chip's latch time
+ */
+static u64 ws2812_anim_hold_words(struct ws2812_dev *dev, const struct ws2812_anim_header *hdr, unsigned int f) {
+    // function setup
+    u64 words = div_u64((u64)ws2812_anim_frame(hdr, f)->duration_ms * NSEC_PER_MSEC, WS2812_BIT_NS);
+    u64 data_words = hdr->num_leds * WS2812_WORDS_PER_LED;
+
+    return max_t(u64, dev->latch_words, words > data_words ? words - data_words : 0);
+}
+
+/**
+ * ws2812_anim_check()
+ * 
+ * Validate a sequence (ws2812_anim.h format) against the strip and count the control
+ * blocks its ring needs: one per frame played, plus its hold blocks, plus the
+ * opening latch
+ */
+static int ws2812_anim_check(struct ws2812_dev *dev, const void *data, size_t size, unsigned int *num_cbs) {
+    // function setup
+    const struct ws2812_anim_header *hdr = data;
+    u64 cbs_intro = 0, cbs_loop = 0, cbs;
+
+    if (size < sizeof(*hdr) || hdr->magic != WS2812_ANIM_MAGIC || hdr->version != WS2812_ANIM_VERSION) {
+        LOGE("- Not a ws2812 animation.");
+        return -EINVAL;
+    }
+    if (!hdr->num_leds || hdr->num_leds > dev->num_leds || !hdr->num_frames ||
+        hdr->num_frames > WS2812_ANIM_MAX_FRAMES || hdr->loop_start >= hdr->num_frames ||
+        hdr->loop_count > WS2812_ANIM_MAX_CBS) {
+        LOGE("- Invalid animation: %u LEDs, %u frames, loop %u x%u.",
+            hdr->num_leds, hdr->num_frames, hdr->loop_start, hdr->loop_count);
+        return -EINVAL;
+    }
+    if (size < sizeof(*hdr) + hdr->num_frames * WS2812_ANIM_FRAME_SIZE(hdr->num_leds)) {
+        LOGE("- Animation truncated at %zu bytes.", size);
+        return -EINVAL;
+    }
+    if ((1 + (size_t)hdr->num_frames * hdr->num_leds * WS2812_WORDS_PER_LED) * sizeof(uint32_t) > WS2812_ANIM_MAX_BYTES) {
+        LOGE("- Animation too large to encode.");
+        return -EFBIG;
+    }
+
+    for (unsigned int f = 0; f < hdr->num_frames; ++f) {
+        cbs = 1 + DIV_ROUND_UP_ULL(ws2812_anim_hold_words(dev, hdr, f), ANIM_HOLD_WORDS);
+        if (f < hdr->loop_start) {
+            cbs_intro += cbs;
+        } else {
+            cbs_loop += cbs;
+        }
+    }
+
+    cbs = 1 + cbs_intro + cbs_loop * (hdr->loop_count ? hdr->loop_count : 1);
+    if (cbs > WS2812_ANIM_MAX_CBS) {
+        LOGE("- Animation needs %llu control blocks; at most %d.", cbs, WS2812_ANIM_MAX_CBS);
+        return -EFBIG;
+    }
+    *num_cbs = cbs;
+    return 0;
+}
+
+/**
+ * ws2812_seq_cb()
+ * 
+ * Append a control block to a sequence's ring, linked to the block after it. Hold
+ * blocks repeat the zero word; only they are relinked when the sequence ends
+ */
+static void ws2812_seq_cb(struct ws2812_seq *seq, unsigned int *n, dma_addr_t source, u32 words, bool hold) {
+    // function setup
+    dma_cb_t *cb = &seq->cb[*n];
+
+    cb->ti = DMA_TI_DESTDREQ(1) | DMA_TI_PERMAP(DMA_PERMAP_PWM) | (hold ? 0 : DMA_TI_SRCINC(1));
+    cb->source_ad = source;
+    cb->dest_ad = PWM_BUS_BASE_ADDRESS + PWM_FIF1_OFFSET;
+    cb->txfr_len = words * sizeof(uint32_t);
+    cb->stride = 0;
+    cb->nextconbk = seq->cb_phys + ++*n * sizeof(dma_cb_t);
+}
+
+/**
+ * ws2812_seq_build()
+ * 
+ * Encode every frame once and chain the blocks that play them: the opening latch,
+ * the intro frames, then the looped section loop_count times (or once, linked back
+ * to itself into a ring). A finite sequence ends on a hold block that repeats forever
+ */
+static void ws2812_seq_build(struct ws2812_dev *dev, struct ws2812_seq *seq, const struct ws2812_anim_header *hdr) {
+    // function setup
+    unsigned int data_words = hdr->num_leds * WS2812_WORDS_PER_LED;
+    unsigned int loop_len = hdr->num_frames - hdr->loop_start;
+    unsigned int plays = hdr->loop_start + loop_len * (hdr->loop_count ? hdr->loop_count : 1);
+    unsigned int n = 0, loop_head = 0, f;
+    u64 hold, words;
+
+    seq->buffer[0] = 0;
+    for (f = 0; f < hdr->num_frames; ++f) {
+        ws2812_encode(&dev->encoder, &seq->buffer[1 + f * data_words],
+            (const led_t *)(ws2812_anim_frame(hdr, f) + 1), hdr->num_leds);
+    }
+
+    ws2812_seq_cb(seq, &n, seq->buffer_phys, dev->latch_words, true);
+    for (unsigned int i = 0; i < plays; ++i) {
+        f = i < hdr->loop_start ? i : hdr->loop_start + (i - hdr->loop_start) % loop_len;
+        if (i == hdr->loop_start) {
+            loop_head = n;
+        }
+
+        ws2812_seq_cb(seq, &n, seq->buffer_phys + (1 + f * data_words) * sizeof(uint32_t), data_words, false);
+        for (hold = ws2812_anim_hold_words(dev, hdr, f); hold; hold -= words) {
+            words = min_t(u64, hold, ANIM_HOLD_WORDS);
+            ws2812_seq_cb(seq, &n, seq->buffer_phys, words, true);
+        }
+    }
+
+    seq->cb[n - 1].nextconbk = seq->cb_phys + (hdr->loop_count ? n - 1 : loop_head) * sizeof(dma_cb_t);
+}
+
+/**
+ * ws2812_seq_relink()
+ * 
+ * Point every hold block of a sequence at target, so the DMA leaves the ring at the
+ * end of a frame's delay, on a latched frame. The DMA latches a block's link when
+ * it loads the block, so a hold already running still leads to the next frame,
+ * and the DMA leaves after that frame's hold
+ */
+static void ws2812_seq_relink(struct ws2812_seq *seq, dma_addr_t target) {
+    for (unsigned int i = 0; i < seq->num_cbs; ++i) {
+        if (!(seq->cb[i].ti & DMA_TI_SRCINC_MASK)) {
+            seq->cb[i].nextconbk = target;
+        }
+    }
+}
+
+/**
+ * ws2812_seq_busy()
+ * 
+ * Whether the DMA is still in a sequence's ring
+ */
+static bool ws2812_seq_busy(struct ws2812_dev *dev, struct ws2812_seq *seq) {
+    // function setup
+    dma_addr_t cb = *DMA_REG(DMA_CONBLKAD_OFFSET);
+
+    return ws2812_dma_busy(dev) && cb >= seq->cb_phys && cb < seq->cb_phys + seq->num_cbs * sizeof(dma_cb_t);
+}
+
+/**
+ * ws2812_seq_retire()
+ * 
+ * Move the playing sequence aside once its ring leads elsewhere; seq_work frees it
+ * when the DMA has left
+ */
+static void ws2812_seq_retire(struct ws2812_dev *dev) {
+    dev->seq_retired = dev->seq;
+    dev->seq = NULL;
+    schedule_delayed_work(&dev->seq_work, usecs_to_jiffies(WS2812_ANIM_HOLD_US) + 1);
+}
+
+/**
+ * ws2812_seq_play()
+ * 
+ * Encode a sequence into DMA memory and switch the channel over to it. From the
+ * frame chain the channel restarts on the new ring; from another sequence the old
+ * ring's hold blocks are relinked to it, so the switch waits for the end of a hold
+ * (up to two holds and a frame, see ws2812_seq_relink())
+ */
+static int ws2812_seq_play(struct ws2812_dev *dev, const void *data, size_t size) {
+    // function setup
+    const struct ws2812_anim_header *hdr = data;
+    volatile unsigned int *dma_cs = DMA_REG(DMA_CS_OFFSET);
+    volatile unsigned int *dma_conblkad = DMA_REG(DMA_CONBLKAD_OFFSET);
+    struct ws2812_seq *seq;
+    unsigned int num_cbs;
+    int retval;
+
+    retval = ws2812_anim_check(dev, data, size, &num_cbs);
+    if (retval) {
+        return retval;
+    }
+
+    // only one sequence can be on its way out
+    if (dev->seq_retired) {
+        if (ws2812_seq_busy(dev, dev->seq_retired)) {
+            return -EBUSY;
+        }
+        ws2812_seq_free(dev, &dev->seq_retired);
+    }
+
+    seq = kzalloc(sizeof(*seq), GFP_KERNEL);
+    if (!seq) {
+        return -ENOMEM;
+    }
+    seq->buffer_len = (1 + hdr->num_frames * hdr->num_leds * WS2812_WORDS_PER_LED) * sizeof(uint32_t);
+    seq->buffer = ws2812_dma_alloc(dev, seq->buffer_len, &seq->buffer_phys);
+    seq->num_cbs = num_cbs;
+    seq->cb = ws2812_cb_alloc(dev, num_cbs, &seq->cb_phys);
+    if (!seq->buffer || !seq->cb) {
+        ws2812_seq_free(dev, &seq);
+        return -ENOMEM;
+    }
+    ws2812_seq_build(dev, seq, hdr);
+
+    if (dev->gated) {
+        ws2812_hw_pwm_gate(&dev->hw, false);
+        dev->gated = false;
+    }
+
+    // make the ring visible before the DMA can follow a link into it
+    wmb();
+    if (dev->seq && ws2812_seq_busy(dev, dev->seq)) {
+        ws2812_seq_relink(dev->seq, seq->cb_phys);
+        ws2812_seq_retire(dev);
+    } else {
+        // restart the channel on the sequence; it opens with a latch, so cutting off
+        // whatever was being sent is harmless
+        *dma_cs = DMA_CS_RESET(1);
+        *dma_conblkad = seq->cb_phys;
+        *dma_cs |= DMA_CS_ACTIVE(1);
+        ws2812_seq_free(dev, &dev->seq);
+    }
+    dev->seq = seq;
+
+    LOG("> Playing sequence: %u frames of %u LEDs, %u control blocks.", hdr->num_frames, hdr->num_leds, num_cbs);
+    return 0;
+}
+
+/**
+ * ws2812_seq_stop()
+ * 
+ * Hand the channel to the frame chain; every hold block now leads there, so the
+ * switch always happens on a latched frame, within two holds and a frame period
+ * (the running hold keeps its old link). In one-shot mode the channel stops instead
+ */
+static void ws2812_seq_stop(struct ws2812_dev *dev) {
+    ws2812_seq_relink(dev->seq, dev->oneshot ? 0 : dev->cb_phys);
+    ws2812_seq_retire(dev);
+
+    // a one-shot channel now stops; gate it behind the last frame
+    if (dev->oneshot && dev->gate) {
+        mod_delayed_work(system_wq, &dev->gate_work, usecs_to_jiffies(2 * WS2812_ANIM_HOLD_US +
+            div_u64(ws2812_frame_period_ns(dev), NSEC_PER_USEC)) + 1);
+    }
+}
+
+/**
+ * ws2812_seq_work()
+ * 
+ * Free the retired sequence once the DMA is no longer in its ring
+ */
+static void ws2812_seq_work(struct work_struct *work) {
+    // function setup
+    struct ws2812_dev *dev = container_of(to_delayed_work(work), struct ws2812_dev, seq_work);
+
+    mutex_lock(&dev->lock);
+    if (dev->seq_retired && ws2812_seq_busy(dev, dev->seq_retired)) {
+        schedule_delayed_work(&dev->seq_work, usecs_to_jiffies(WS2812_ANIM_HOLD_US) + 1);
+    } else {
+        ws2812_seq_free(dev, &dev->seq_retired);
+    }
+    mutex_unlock(&dev->lock);
+}
+
+/**
+ * ws2812_seq_free()
+ * 
+ * Release a sequence's DMA memory; the DMA must not be using it
+ */
+static void ws2812_seq_free(struct ws2812_dev *dev, struct ws2812_seq **seq) {
+    if (!*seq) {
+        return;
+    }
+    ws2812_cb_free(dev, (*seq)->cb, (*seq)->num_cbs, (*seq)->cb_phys);
+    ws2812_dma_free(dev, (*seq)->buffer_len, (*seq)->buffer, (*seq)->buffer_phys);
+    kfree(*seq);
+    *seq = NULL;
+}
+
+/**
+ * ws2812_anim_loaded()
+ * 
+ * request_firmware_nowait() callback; plays the boot animation unless userspace
+ * has already rendered or uploaded a sequence
+ */
+static void ws2812_anim_loaded(const struct firmware *fw, void *context) {
+    // function setup
+    struct ws2812_dev *dev = context;
+    int retval;
+
+    if (!fw) {
+        LOG("> No boot animation.");
+        complete(&dev->anim_loaded);
+        return;
+    }
+
+    mutex_lock(&dev->lock);
+    if (dev->rendered) {
+        LOG("> Userspace already rendering; skipping boot animation.");
+    } else if ((retval = ws2812_seq_play(dev, fw->data, fw->size))) {
+        LOGE("- Boot animation not played (%d).", retval);
+    }
+    mutex_unlock(&dev->lock);
+
+    release_firmware(fw);
+    complete(&dev->anim_loaded);
+}
+
+/**************************************************************************************
+ * WATCHDOG
+ **************************************************************************************/
+
+/**
+ * ws2812_watchdog_head()
+ * 
+ * First block of the chain the raw channel should be running
+ */
+static dma_addr_t ws2812_watchdog_head(struct ws2812_dev *dev) {
+    if (dev->seq) {
+        return dev->seq->cb_phys;
+    }
+    if (dev->mode == WS2812_MODE_PWM) {
+        return dev->cb_phys + dev->wave_active * WS2812_WAVEFORM_CBS * sizeof(dma_cb_t);
+    }
+    if (dev->parallel.strips) {
+        return dev->cb_phys + dev->parallel.active * dev->parallel.chain_cbs * sizeof(dma_cb_t);
+    }
+    return dev->cb_phys;
+}
+
+/**
+ * ws2812_watchdog_owns()
+ * 
+ * Whether cb is a control block of the frame chain, the waveform sets or a
+ * sequence ring, so the channel can safely be re-armed on it
+ */
+static bool ws2812_watchdog_owns(struct ws2812_dev *dev, dma_addr_t cb) {
+    // function setup
+    struct ws2812_seq *seqs[] = { dev->seq, dev->seq_retired };
+
+    if (!cb || cb % sizeof(dma_cb_t)) {
+        return false;
+    }
+    if (cb >= dev->cb_phys && cb < dev->cb_phys + dev->num_cbs * sizeof(dma_cb_t)) {
+        return true;
+    }
+    for (unsigned int i = 0; i < ARRAY_SIZE(seqs); ++i) {
+        if (seqs[i] && cb >= seqs[i]->cb_phys && cb < seqs[i]->cb_phys + seqs[i]->num_cbs * sizeof(dma_cb_t)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * ws2812_watchdog_recover()
+ * 
+ * Reset the raw channel, clear its error flags and flush the PWM FIFO, then re-arm
+ * it on the block it was executing; that block restarts from its first word and
+ * the chain carries on from there. A block outside the driver's chains restarts
+ * the current chain instead. Returns the block the channel was re-armed on
+ */
+static dma_addr_t ws2812_watchdog_recover(struct ws2812_dev *dev, bool rearm) {
+    // function setup
+    volatile unsigned int *dma_cs = DMA_REG(DMA_CS_OFFSET);
+    volatile unsigned int *dma_conblkad = DMA_REG(DMA_CONBLKAD_OFFSET);
+    dma_addr_t cb = *dma_conblkad;
+
+    if (!ws2812_watchdog_owns(dev, cb)) {
+        cb = ws2812_watchdog_head(dev);
+    }
+
+    *dma_cs = DMA_CS_RESET(1);
+    *DMA_REG(DMA_DEBUG_OFFSET) = DMA_DEBUG_ERRORS_MASK;
+    ws2812_hw_pwm_clear_fifo(&dev->hw);
+
+    if (rearm) {
+        *dma_conblkad = cb;
+        *dma_cs |= DMA_CS_ACTIVE(1);
+        dev->started = ktime_get();
+    }
+    ++dev->watchdog.recoveries;
+    return cb;
+}
+
+/**
+ * ws2812_watchdog_check_raw()
+ * 
+ * Check the raw channel against what it should be doing. Looping chains and
+ * sequences never stop and never drain the FIFO; a one-shot frame only has to keep
+ * moving while it is sent. Returns whether the channel had to be recovered
+ */
+static bool ws2812_watchdog_check_raw(struct ws2812_dev *dev, u32 sta) {
+    // function setup
+    struct ws2812_watchdog *wd = &dev->watchdog;
+    u32 cs = *DMA_REG(DMA_CS_OFFSET);
+    u32 debug = *DMA_REG(DMA_DEBUG_OFFSET);
+    dma_addr_t cb = *DMA_REG(DMA_CONBLKAD_OFFSET);
+    u32 len = *DMA_REG(DMA_TXFR_LEN_OFFSET);
+    bool active = cs & DMA_CS_ACTIVE_MASK;
+    bool expected = dev->seq || !dev->oneshot;
+    const char *fault = NULL;
+
+    if ((cs & DMA_CS_ERROR_MASK) || (debug & DMA_DEBUG_ERRORS_MASK) || (sta & PWM_STA_ERRORS_MASK)) {
+        ++wd->errors;
+        fault = "errored";
+    } else if (expected && !active) {
+        ++wd->stops;
+        fault = "stopped";
+    } else if (active && cb == wd->last_cb && len == wd->last_len && (sta & PWM_STA_EMPT1_MASK)) {
+        // a hold block may repeat the same position, but it keeps the FIFO fed
+        ++wd->stalls;
+        fault = "stalled";
+    } else if (expected && (sta & PWM_STA_GAPO1_MASK)) {
+        // the FIFO ran dry once but the channel is moving again
+        ++wd->underruns;
+    }
+
+    if (!fault) {
+        wd->last_cb = cb;
+        wd->last_len = len;
+        return false;
+    }
+
+    cb = ws2812_watchdog_recover(dev, active || expected);
+    LOGW("- DMA channel %s (CS 0x%08x, DEBUG 0x%x, PWM STA 0x%x); re-armed at %pad.", fault, cs, debug, sta, &cb);
+    wd->last_cb = 0;
+    wd->last_len = 0;
+    return true;
+}
+
+/**
+ * ws2812_watchdog_check_dmaengine()
+ * 
+ * Check that dmaengine frames keep completing. A frame in flight for two frame
+ * periods (at least one check interval) with no completion is terminated and sent
+ * again. Returns whether the channel had to be recovered
+ */
+static bool ws2812_watchdog_check_dmaengine(struct ws2812_dev *dev, u32 sta) {
+    // function setup
+    struct ws2812_watchdog *wd = &dev->watchdog;
+    u64 completed = READ_ONCE(dev->completed);
+    u64 stall_ns = max_t(u64, 2 * ws2812_frame_period_ns(dev), (u64)wd->interval_ms * NSEC_PER_MSEC);
+    ktime_t now = ktime_get();
+
+    // cyclic waveforms report nothing to watch; only the FIFO flags are counted
+    if (sta & PWM_STA_ERRORS_MASK) {
+        ++wd->errors;
+    }
+    if (dev->mode != WS2812_MODE_PIXEL || !READ_ONCE(dev->in_flight) || completed != wd->last_completed) {
+        wd->last_completed = completed;
+        wd->progress = now;
+        return false;
+    }
+    if (ktime_to_ns(ktime_sub(now, wd->progress)) < stall_ns) {
+        return false;
+    }
+
+    ++wd->stalls;
+    dmaengine_terminate_sync(dev->chan);
+    WRITE_ONCE(dev->in_flight, false);
+    wake_up(&dev->dma_wait);
+    if (ws2812_dmaengine_submit(dev, false)) {
+        LOGE("- Failed to resubmit dmaengine frame; output stopped.");
+    }
+    ++wd->recoveries;
+    wd->progress = now;
+    LOGW("- dmaengine frame stalled after %llu frames; resubmitted.", completed);
+    return true;
+}
+
+/**
+ * ws2812_watchdog_work()
+ * 
+ * Periodic channel check. While recoveries keep failing the interval doubles up to
+ * WS2812_WATCHDOG_MAX_MS, so a dead channel is not reset (and logged) every check
+ */
+static void ws2812_watchdog_work(struct work_struct *work) {
+    // function setup
+    struct ws2812_dev *dev = container_of(to_delayed_work(work), struct ws2812_dev, watchdog.work);
+    struct ws2812_watchdog *wd = &dev->watchdog;
+    bool recovered = false;
+
+    mutex_lock(&dev->lock);
+    if (!dev->gated) {
+        if (dev->chan) {
+            recovered = ws2812_watchdog_check_dmaengine(dev, ws2812_hw_pwm_status(&dev->hw));
+        } else if (dev->dma_cb) {
+            recovered = ws2812_watchdog_check_raw(dev, ws2812_hw_pwm_status(&dev->hw));
+        }
+    }
+    wd->backoff_ms = recovered ? min_t(unsigned int, 2 * wd->backoff_ms, WS2812_WATCHDOG_MAX_MS) : wd->interval_ms;
+    mutex_unlock(&dev->lock);
+
+    schedule_delayed_work(&wd->work, msecs_to_jiffies(wd->backoff_ms));
+}
+
+/**************************************************************************************
+ * DEBUGFS
+ **************************************************************************************/
+
+/**
+ * struct ws2812_dump
+ * 
+ * Snapshot handed to one reader of the debugfs dump
+ */
+struct ws2812_dump {
+    size_t len;
+    u8 data[];
+};
+
+/**
+ * ws2812_dump_open()
+ * 
+ * Snapshot the control blocks and DMA buffer in the format of ws2812_dump.h. Taken
+ * under the device lock, so no render can relink a block halfway through the copy
+ */
+static int ws2812_dump_open(struct inode *inode, struct file *file) {
+    // function setup
+    struct ws2812_dev *dev = &ws2812_device;
+    struct ws2812_dump_header *hdr;
+    struct ws2812_dump *dump;
+    size_t cbs_len;
+    u64 src_hz;
+
+    mutex_lock(&dev->lock);
+    if (!dev->dma_cb || !dev->dma_buffer) {
+        mutex_unlock(&dev->lock);
+        return -ENODEV;
+    }
 
-// open function
-static int ws2812_open(struct inode *inode, struct file *file) {
-    file->private_data = &ws2812_device;
+    cbs_len = dev->num_cbs * sizeof(dma_cb_t);
+    dump = kvmalloc(sizeof(*dump) + sizeof(*hdr) + cbs_len + dev->dma_buffer_len, GFP_KERNEL);
+    if (!dump) {
+        mutex_unlock(&dev->lock);
+        return -ENOMEM;
+    }
+    dump->len = sizeof(*hdr) + cbs_len + dev->dma_buffer_len;
+
+    // header
+    hdr = (struct ws2812_dump_header *)dump->data;
+    hdr->magic = WS2812_DUMP_MAGIC;
+    hdr->version = WS2812_DUMP_VERSION;
+    // the clock as programmed now; pwm mode runs from the oscillator, and waveforms
+    // can change the divider
+    src_hz = (dev->hw.cm_pwmctl & CM_PWMCTL_SRC_MASK) == CM_PWMCTL_SRC(PWMCTL_OSC) ? WS2812_WAVEFORM_CLOCK_HZ :
+        PLLD_HZ;
+    hdr->pwm_clock_hz = dev->hw.cm_pwmdiv ? div_u64((u64)src_hz << 12, dev->hw.cm_pwmdiv) : 0;
+    hdr->pwm_range = dev->parallel.strips ? dev->parallel.phase_ticks : WS2812_TICKS_PER_BIT;
+    hdr->t0h_ns = dev->chip->t0h_ns;
+    hdr->t1h_ns = dev->chip->t1h_ns;
+    hdr->reset_ns = dev->chip->reset_ns;
+    hdr->num_leds = dev->num_leds;
+    hdr->cb_addr = dev->cb_phys;
+    hdr->num_cbs = dev->num_cbs;
+    hdr->first_cb = dev->cb_phys;
+    if (dev->mode == WS2812_MODE_PWM) {
+        hdr->first_cb += dev->wave_active * WS2812_WAVEFORM_CBS * sizeof(dma_cb_t);
+    } else if (dev->parallel.strips) {
+        hdr->first_cb += dev->parallel.active * dev->parallel.chain_cbs * sizeof(dma_cb_t);
+    }
+    hdr->buffer_addr = dev->dma_buffer_phys;
+    hdr->buffer_len = dev->dma_buffer_len;
+
+    // control blocks and buffer, as the DMA sees them
+    memcpy(dump->data + sizeof(*hdr), dev->dma_cb, cbs_len);
+    memcpy(dump->data + sizeof(*hdr) + cbs_len, dev->dma_buffer, dev->dma_buffer_len);
+    mutex_unlock(&dev->lock);
+
+    file->private_data = dump;
     return 0;
 }
 
-// write function
-static ssize_t ws2812_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
-    // function setup
-    char user_buffer[16];
-    int retval;
+static ssize_t ws2812_dump_read(struct file *file, char __user *buf, size_t count, loff_t *ppos) {
+    struct ws2812_dump *dump = file->private_data;
+    return simple_read_from_buffer(buf, count, ppos, dump->data, dump->len);
+}
 
-    // get device struct
-    struct ws2812_dev *dev = file->private_data;
+static int ws2812_dump_release(struct inode *inode, struct file *file) {
+    kvfree(file->private_data);
+    return 0;
+}
 
-    // check for valid parameters
-    if (count < 1 || count > 16) {
-        LOGE("- Invalid message size.");
-        return -EINVAL;
+static const struct file_operations ws2812_dump_fops = {
+    .owner = THIS_MODULE,
+    .open = ws2812_dump_open,
+    .read = ws2812_dump_read,
+    .release = ws2812_dump_release,
+    .llseek = default_llseek,
+};
+
+/**
+ * ws2812_bench_open()
+ * 
+ * Time the encoder writing frames of the attached LEDs into each kind of frame
+ * buffer memory, WS2812_MEM_BENCH_FRAMES frames each, and snapshot the results as
+ * CSV. Streaming buffers are synced after every frame as the render path does;
+ * "cached" is the same memory never synced, the bound the others approach
+ */
+static int ws2812_bench_open(struct inode *inode, struct file *file) {
+    // function setup
+    static const struct {
+        const char *name;
+        ws2812_dma_mem_t mem;
+        bool sync;
+    } kinds[] = {
+        { "coherent", WS2812_DMA_MEM_COHERENT, false },
+        { "wc", WS2812_DMA_MEM_WC, false },
+        { "streaming", WS2812_DMA_MEM_STREAMING, true },
+        { "cached", WS2812_DMA_MEM_STREAMING, false },
+    };
+    struct ws2812_dev *dev = &ws2812_device;
+    size_t size = dev->num_leds * WS2812_WORDS_PER_LED * sizeof(uint32_t);
+    struct ws2812_dump *dump;
+    uint32_t *buffer;
+    dma_addr_t phys;
+    led_t *leds;
+    size_t len;
+    u64 ns;
+
+    if (dev->mode != WS2812_MODE_PIXEL) {
+        return -ENODEV;
     }
 
-    // copy from user
-    if ((retval = copy_from_user(user_buffer, buf, count))) {
-        LOGE("- Copy from userspace failed.");
-        return -EFAULT;
+    dump = kvmalloc(sizeof(*dump) + PAGE_SIZE, GFP_KERNEL);
+    leds = kmalloc_array(dev->num_leds, sizeof(led_t), GFP_KERNEL);
+    if (!dump || !leds) {
+        kvfree(dump);
+        kfree(leds);
+        return -ENOMEM;
+    }
+    for (unsigned int i = 0; i < dev->num_leds; ++i) {
+        leds[i] = (led_t){ .red = i * 7, .green = i * 13 + 85, .blue = i * 29 + 170 };
     }
 
-    // null-terminate string
-    user_buffer[count] = '\0';
+    len = scnprintf((char *)dump->data, PAGE_SIZE, "memory,leds,frames,ns_per_frame\n");
+    for (unsigned int k = 0; k < ARRAY_SIZE(kinds); ++k) {
+        // only the allocation counters need the lock; the encoding runs without it
+        mutex_lock(&dev->lock);
+        buffer = ws2812_buffer_alloc(dev, kinds[k].mem, size, &phys);
+        mutex_unlock(&dev->lock);
+        if (!buffer) {
+            len += scnprintf((char *)dump->data + len, PAGE_SIZE - len, "%s,%u,0,unavailable\n", kinds[k].name,
+                dev->num_leds);
+            continue;
+        }
 
-    // convert string to integer
-    if ((retval = kstrtoint(user_buffer, 10, &dev->duty_cycle))) {
-        LOGE("- Converting string to int failed.");
-        return retval;
-    }
-    
-    // check valid input
-    if (dev->duty_cycle < 0 || dev->duty_cycle > 100) {
-        LOGE("- Invalid input; please use 0-100");
-        return -EINVAL;
+        ns = ktime_get_ns();
+        for (unsigned int f = 0; f < WS2812_MEM_BENCH_FRAMES; ++f) {
+            leds[f % dev->num_leds].red = f;
+            ws2812_encode(&dev->encoder, buffer, leds, dev->num_leds);
+            if (kinds[k].sync) {
+                dma_sync_single_for_device(dev->device, phys, size, DMA_TO_DEVICE);
+            }
+        }
+        ns = ktime_get_ns() - ns;
+
+        mutex_lock(&dev->lock);
+        ws2812_buffer_free(dev, kinds[k].mem, size, buffer, phys);
+        mutex_unlock(&dev->lock);
+
+        len += scnprintf((char *)dump->data + len, PAGE_SIZE - len, "%s,%u,%u,%llu\n", kinds[k].name,
+            dev->num_leds, WS2812_MEM_BENCH_FRAMES, div_u64(ns, WS2812_MEM_BENCH_FRAMES));
     }
+    kfree(leds);
 
-    // set the duty cycle of the pwm module
-    pwm_setduty(dev->duty_cycle);
+    dump->len = len;
+    file->private_data = dump;
+    return 0;
+}
 
-    // return
-    return count;
+static const struct file_operations ws2812_bench_fops = {
+    .owner = THIS_MODULE,
+    .open = ws2812_bench_open,
+    .read = ws2812_dump_read,
+    .release = ws2812_dump_release,
+    .llseek = default_llseek,
+};
+
+/**
+ * ws2812_debugfs_init()
+ * 
+ * Create the debugfs directory; failures are not fatal, debugfs is optional
+ */
+static void ws2812_debugfs_init(struct ws2812_dev *dev) {
+    // function setup
+    struct dentry *watchdog, *alloc;
+
+    dev->debugfs = debugfs_create_dir(WS2812_MODULE_NAME, NULL);
+    debugfs_create_file("dma", 0400, dev->debugfs, dev, &ws2812_dump_fops);
+    debugfs_create_file("encode_bench", 0400, dev->debugfs, dev, &ws2812_bench_fops);
+
+    // watchdog event counters
+    watchdog = debugfs_create_dir("watchdog", dev->debugfs);
+    debugfs_create_u32("errors", 0444, watchdog, &dev->watchdog.errors);
+    debugfs_create_u32("stops", 0444, watchdog, &dev->watchdog.stops);
+    debugfs_create_u32("stalls", 0444, watchdog, &dev->watchdog.stalls);
+    debugfs_create_u32("underruns", 0444, watchdog, &dev->watchdog.underruns);
+    debugfs_create_u32("recoveries", 0444, watchdog, &dev->watchdog.recoveries);
+
+    // live DMA allocations
+    alloc = debugfs_create_dir("alloc", dev->debugfs);
+    debugfs_create_u32("cb_pool", 0444, alloc, &dev->cb_pool_live);
+    debugfs_create_u32("coherent", 0444, alloc, &dev->coherent_live);
+    debugfs_create_size_t("coherent_bytes", 0444, alloc, &dev->coherent_bytes);
+    debugfs_create_u32("streaming", 0444, alloc, &dev->streaming_live);
 }
 
 /**************************************************************************************
- * HELPER FUNCTIONS
+ * DMAENGINE BACKEND
  **************************************************************************************/
 
 /**
- * gpio_configure()
+ * ws2812_dmaengine_request()
  * 
- * Configure the GPFSEL register in the GPIO peripheral
+ * Request the PWM's DMA channel named "tx" in the device tree and point it at the
+ * PWM FIFO. The platform DMA driver owns the channel, its control blocks and its
+ * interrupt, so nothing else can be handed the same channel
  */
-static int gpio_configure(unsigned int pin, gpfsel_mode_t mode) {
+static int ws2812_dmaengine_request(struct ws2812_dev *dev, struct platform_device *pdev) {
     // function setup
-    volatile unsigned int *gpio_gpfseli;
+    struct dma_slave_config cfg = {
+        .direction = DMA_MEM_TO_DEV,
+        .dst_addr = PWM_BUS_BASE_ADDRESS + PWM_FIF1_OFFSET,
+        .dst_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES,
+    };
+    struct dma_chan *chan;
+    int retval;
 
-    // check that pins are within bounds
-    if (pin > NUM_GPIO_PINS) {
-        LOGE("Error; cannot use GPIO pin outside of [0, %d]", NUM_GPIO_PINS);
-        return -EINVAL;
+    chan = dma_request_chan(&pdev->dev, "tx");
+    if (IS_ERR(chan)) {
+        return PTR_ERR(chan);
     }
 
-    // create a pointer to the selected pin's GPIO register
-    // gpfsel registers each correspond to 10 pins each, using an offset at (pin / 10)
-    gpio_gpfseli = (volatile unsigned int *)(gpio_registers + (pin / 10));
-
-    // clear the target register bits and set the mode
-    LOG("+ Configuring GPFSEL%d register.", pin / 10);
-    *gpio_gpfseli &= ~(GPIO_GPFSEL_MASK(pin));
-    *gpio_gpfseli |= (GPIO_GPFSEL(pin, mode));
-    LOG("+ GPIO_GPFSEL%d [%p]: 0x%08X", pin / 10, gpio_gpfseli, *gpio_gpfseli);
+    retval = dmaengine_slave_config(chan, &cfg);
+    if (retval) {
+        LOGE("- Failed to configure dmaengine channel.");
+        dma_release_channel(chan);
+        return retval;
+    }
 
-    // return success
-    LOG("GPIO Configuration Complete! Enabling peripheral.");
+    dev->chan = chan;
     return 0;
 }
 
 /**
- * gpio_set()
+ * ws2812_dmaengine_done()
  * 
- * Set a GPIO pin
+ * Completion callback (tasklet context); counts the frame and, unless in one-shot
+ * mode, submits the next one so the strip keeps refreshing
  */
-static int gpio_set(unsigned int pin) {
+static void ws2812_dmaengine_done(void *param) {
     // function setup
-    volatile unsigned int *gpio_gpsetn;
+    struct ws2812_dev *dev = param;
 
-    // check that pins are within bounds
-    if (pin > NUM_GPIO_PINS) {
-        LOGE("Error; cannot use GPIO pin outside of [0, %d]", NUM_GPIO_PINS);
-        return -EINVAL;
-    }
+    WRITE_ONCE(dev->completed, dev->completed + 1);
+    WRITE_ONCE(dev->in_flight, false);
+    wake_up(&dev->dma_wait);
 
-    // create a pointer to the selected pin's GPSET register
-    if (pin < 32) {
-        gpio_gpsetn = GPIO_REG(GPIO_GPSET0_OFFSET);
-    } else {
-        gpio_gpsetn = GPIO_REG(GPIO_GPSET1_OFFSET);
+    if (ws2812_dmaengine_submit(dev, true)) {
+        LOGE("- Failed to submit dmaengine frame; output stopped.");
     }
-
-    // write a 1 to the set bit corresponding to the pin
-    *gpio_gpsetn |= GPIO_GPSETN(pin);
-
-    // return success
-    return 0;
 }
 
 /**
- * gpio_clear()
+ * ws2812_dmaengine_submit()
  * 
- * Clear a GPIO pin
+ * Queue one frame: the active buffer of every segment, then the latch words. Called
+ * from process context and, with resubmit set, from the completion callback; a
+ * resubmit only goes out while the output is streaming, checked under submit_lock so
+ * it cannot race ws2812_dmaengine_cleanup()
  */
-static int gpio_clear(unsigned int pin) {
+static int ws2812_dmaengine_submit(struct ws2812_dev *dev, bool resubmit) {
     // function setup
-    volatile unsigned int *gpio_gpclrn;
+    struct dma_async_tx_descriptor *desc;
+    struct ws2812_segment *seg;
+    unsigned long flags;
+    unsigned int i;
+    int retval = 0;
 
-    // check that pins are within bounds
-    if (pin > NUM_GPIO_PINS) {
-        LOGE("Error; cannot use GPIO pin outside of [0, %d]", NUM_GPIO_PINS);
-        return -EINVAL;
+    spin_lock_irqsave(&dev->submit_lock, flags);
+    if (resubmit && !dev->streaming) {
+        goto out;
     }
-
-    // create a pointer to the selected pin's GPSET register
-    if (pin < 32) {
-        gpio_gpclrn = GPIO_REG(GPIO_GPCLR0_OFFSET);
-    } else {
-        gpio_gpclrn = GPIO_REG(GPIO_GPCLR1_OFFSET);
+    for (i = 0; i < dev->num_segments; ++i) {
+        seg = &dev->segments[i];
+        sg_dma_address(&dev->sg[i]) = seg->buffer_phys[seg->active];
+        sg_dma_len(&dev->sg[i]) = seg->num_leds * WS2812_WORDS_PER_LED * sizeof(uint32_t);
+    }
+    sg_dma_address(&dev->sg[i]) = dev->dma_buffer_phys + 2 * dev->frame_words * sizeof(uint32_t);
+    sg_dma_len(&dev->sg[i]) = dev->latch_words * sizeof(uint32_t);
+
+    desc = dmaengine_prep_slave_sg(dev->chan, dev->sg, dev->num_segments + 1, DMA_MEM_TO_DEV,
+        DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+    if (!desc) {
+        retval = -ENOMEM;
+        goto out;
+    }
+    desc->callback = ws2812_dmaengine_done;
+    desc->callback_param = dev;
+    if (dma_submit_error(dmaengine_submit(desc))) {
+        retval = -EIO;
+        goto out;
     }
 
-    // write a 1 to the clear bit corresponding to the pin
-    *gpio_gpclrn |= GPIO_GPCLRN(pin);
+    ++dev->submitted;
+    WRITE_ONCE(dev->in_flight, true);
+    dma_async_issue_pending(dev->chan);
 
-    // return success
-    return 0;
+out:
+    spin_unlock_irqrestore(&dev->submit_lock, flags);
+    return retval;
 }
 
 /**
- * cm_configure()
+ * ws2812_dmaengine_cyclic()
  * 
- * Configure the clock manager peripheral
+ * Loop len bytes at addr to the PWM FIFO until terminated
  */
-static int cm_configure(pwmctl_src_t src, uint32_t div, pwmctl_mash_t mash) {         
+static int ws2812_dmaengine_cyclic(struct ws2812_dev *dev, dma_addr_t addr, size_t len) {
     // function setup
-    int timeout;
-    volatile unsigned int *cm_pwmctl = CM_REG(CM_PWMCTL_OFFSET);
-    volatile unsigned int *cm_pwmdiv = CM_REG(CM_PWMDIV_OFFSET);
-
-    // disable clocks and wait until the busy flag is cleared
-    LOG("+ Disabling CM for configuration.");
-    *cm_pwmctl = (CM_PASSWD) | (*cm_pwmctl & ~CM_PWMCTL_ENAB_MASK) | (CM_PWMCTL_ENAB(0));
+    struct dma_async_tx_descriptor *desc;
 
-    // waiting on busy flag
-    LOG("+ Waiting for BUSY flag to go low...");
-    timeout = 100000;
-    while((*cm_pwmctl & CM_PWMCTL_BUSY_MASK) && --timeout);
-    if (timeout == 0) {
-        LOGE("- BUSY flag never goes low.");
+    desc = dmaengine_prep_dma_cyclic(dev->chan, addr, len, len, DMA_MEM_TO_DEV, 0);
+    if (!desc || dma_submit_error(dmaengine_submit(desc))) {
+        LOGE("- Failed to submit cyclic transfer.");
+        return -EIO;
     }
+    dma_async_issue_pending(dev->chan);
+    return 0;
+}
 
-    // configure the clock divider
-    LOG("+ Configuring the clock divider.");
-    *cm_pwmdiv = (CM_PASSWD) | (*cm_pwmdiv & ~CM_PWMDIV_MASK) | (CM_PWMDIV(div));
-    LOG("+ CM_PWMDIV [%p]: 0x%08X", cm_pwmdiv, *cm_pwmdiv);
-
-    // configure the clock source and MASH
-    LOG("+ Configuring PWMCTL register.");
-    *cm_pwmctl = (CM_PASSWD) | (*cm_pwmctl & ~CM_PWMCTL_SRC_MASK);
-    *cm_pwmctl |= (CM_PASSWD) | (CM_PWMCTL_SRC(src));
-    *cm_pwmctl = (CM_PASSWD) | (*cm_pwmctl & ~CM_PWMCTL_MASH_MASK);
-    *cm_pwmctl |= (CM_PASSWD) | (CM_PWMCTL_MASH(mash));
-    LOG("+ CM_PWMCTL [%p]: 0x%08X", cm_pwmctl, *cm_pwmctl);
-
-    // enable clocks and wait until the busy flag turns on
-    LOG("+ CM Configuration Complete! Enabling peripheral.");
-    *cm_pwmctl |= (CM_PASSWD) | (CM_PWMCTL_ENAB(1));
+/**
+ * ws2812_dmaengine_configure()
+ * 
+ * Start output on the dmaengine channel. Pixel frames go out as slave_sg
+ * descriptors, resubmitted from their completion callback unless in one-shot mode;
+ * pwm mode waveforms are plain cyclic transfers
+ */
+static int ws2812_dmaengine_configure(struct ws2812_dev *dev) {
+    if (dev->mode == WS2812_MODE_PWM) {
+        return ws2812_dmaengine_cyclic(dev, dev->dma_buffer_phys, BREATH_STEPS * sizeof(uint32_t));
+    }
 
-    timeout = 100000;
-    while((!(*cm_pwmctl & CM_PWMCTL_BUSY_MASK)) && --timeout);
-    if (timeout == 0) {
-        LOGE("- BUSY flag never goes high.");
+    dev->sg = kcalloc(dev->num_segments + 1, sizeof(*dev->sg), GFP_KERNEL);
+    if (!dev->sg) {
+        LOGE("- Failed to allocate scatterlist.");
+        return -ENOMEM;
     }
+    sg_init_table(dev->sg, dev->num_segments + 1);
 
-    // return
-    return 0;
+    // send the blank frame; looping output keeps resubmitting from the callback
+    dev->streaming = !dev->oneshot;
+    dev->started = ktime_get();
+    return ws2812_dmaengine_submit(dev, false);
 }
 
 /**
- * pwm_configure()
+ * ws2812_dmaengine_cleanup()
  * 
- * Configure PWM peripheral using memory-mapped physical address
+ * Stop output and hand the channel back
  */
-static int pwm_configure(void) {
+static void ws2812_dmaengine_cleanup(struct ws2812_dev *dev) {
     // function setup
-    volatile unsigned int *pwm_ctl = PWM_REG(PWM_CTL_OFFSET);
-    volatile unsigned int *pwm_dmac = PWM_REG(PWM_DMAC_OFFSET);
-    volatile unsigned int *pwm_rng1 = PWM_REG(PWM_RNG1_OFFSET);
-    volatile unsigned int *pwm_dat1 = PWM_REG(PWM_DAT1_OFFSET);
+    unsigned long flags;
+
+    // once this is clear no callback can queue another frame
+    spin_lock_irqsave(&dev->submit_lock, flags);
+    dev->streaming = false;
+    spin_unlock_irqrestore(&dev->submit_lock, flags);
+    dmaengine_terminate_sync(dev->chan);
+    dma_release_channel(dev->chan);
+    dev->chan = NULL;
+
+    kfree(dev->sg);
+    dev->sg = NULL;
+}
 
-    // disable PWM for configuration
-    LOG("+ Disabling PWM for configuration.");
-    *pwm_ctl &= ~(PWM_CTL_PWEN1_MASK);
-    udelay(DELAY_SHORT);
+/**************************************************************************************
+ * DMA MEMORY
+ **************************************************************************************/
 
-    // configure the CTL register
-    LOG("+ Configuring CTL register.");
-    *pwm_ctl &= ~(PWM_CTL_MODE1_MASK);          // set to PWM mode
-    *pwm_ctl &= ~(PWM_CTL_SBIT1_MASK);          // pull LOW between transfers (TODO: change after testing)
-    *pwm_ctl |= PWM_CTL_USEF1(1);               // enable FIFO
-    *pwm_ctl |= PWM_CTL_MSEN1(1);               // enable Mark-Space (M/S) mode
-    LOG("+ PWM_CTL [%p]: 0x%08X", pwm_ctl, *pwm_ctl);
+/**
+ * ws2812_dma_alloc()
+ * 
+ * Coherent DMA memory, counted so leaks show up in debugfs
+ */
+static void *ws2812_dma_alloc(struct ws2812_dev *dev, size_t size, dma_addr_t *phys) {
+    // function setup
+    void *mem = dma_alloc_coherent(dev->device, size, phys, GFP_KERNEL);
 
-    // configure the DMAC register
-    LOG("+ Configuring DMAC register.");
-    *pwm_dmac |= PWM_DMAC_ENAB(1);         // enable DMA
-    LOG("+ PWM_DMAC [%p]: 0x%08X", pwm_dmac, *pwm_dmac);
-    
-    // configure the RNG1 register
-    LOG("+ Configuring RNG1 register.");
-    *pwm_rng1 = PWM_RNG1(100);                  // set the range to 100 (percentage-based duty cycle)
-    LOG("+ PWM_RNG1 [%p]: 0x%08X", pwm_rng1, *pwm_rng1);
-    udelay(DELAY_SHORT);
-
-    // configure the DAT1 register
-    LOG("+ Configuring DAT1 register.");
-    *pwm_dat1 = PWM_DAT1(25);                   // set the duty cycle
-    LOG("+ PWM_DAT1 [%p]: 0x%08X", pwm_dat1, *pwm_dat1);
-    udelay(DELAY_SHORT);
-
-    // configuration complete; enable PWM
-    LOG("+ PWM Configuration Complete! Enabling peripheral.");
-    *pwm_ctl |= PWM_CTL_PWEN1(1);
-    LOG("+ PWM_CTL after enabling: 0x%08X", *pwm_ctl);
+    if (mem) {
+        ++dev->coherent_live;
+        dev->coherent_bytes += size;
+    }
+    return mem;
+}
 
-    // return
-    return 0;
+/**
+ * ws2812_dma_free()
+ * 
+ * Release memory from ws2812_dma_alloc(); NULL is ignored
+ */
+static void ws2812_dma_free(struct ws2812_dev *dev, size_t size, void *mem, dma_addr_t phys) {
+    if (!mem) {
+        return;
+    }
+    dma_free_coherent(dev->device, size, mem, phys);
+    --dev->coherent_live;
+    dev->coherent_bytes -= size;
 }
 
 /**
- * pwm_setduty()
+ * ws2812_cb_alloc()
  * 
- * Sets the duty cycle of the PWM module
+ * A zeroed, contiguous chain of n control blocks; from the pool when it fits in a
+ * pool block, otherwise from its own coherent allocation
  */
-static int pwm_setduty(int duty) {
+static dma_cb_t *ws2812_cb_alloc(struct ws2812_dev *dev, unsigned int n, dma_addr_t *phys) {
     // function setup
-    volatile unsigned int *pwm_ctl = PWM_REG(PWM_CTL_OFFSET);
-    volatile unsigned int *pwm_dat1 = PWM_REG(PWM_DAT1_OFFSET);
+    dma_cb_t *cbs;
+
+    if (n > WS2812_CB_POOL_CBS || !dev->cb_pool) {
+        cbs = ws2812_dma_alloc(dev, n * sizeof(dma_cb_t), phys);
+        if (cbs) {
+            memset(cbs, 0, n * sizeof(dma_cb_t));
+        }
+        return cbs;
+    }
 
-    // disable PWM for changing duty cycle
-    LOG("+ Disabling PWM to change duty cycle.");
-    *pwm_ctl &= ~(PWM_CTL_PWEN1_MASK);
+    cbs = dma_pool_zalloc(dev->cb_pool, GFP_KERNEL, phys);
+    if (cbs) {
+        ++dev->cb_pool_live;
+    }
+    return cbs;
+}
+
+/**
+ * ws2812_cb_free()
+ * 
+ * Release a chain from ws2812_cb_alloc(); n must match the allocation. NULL is
+ * ignored
+ */
+static void ws2812_cb_free(struct ws2812_dev *dev, dma_cb_t *cbs, unsigned int n, dma_addr_t phys) {
+    if (!cbs) {
+        return;
+    }
+    if (n > WS2812_CB_POOL_CBS || !dev->cb_pool) {
+        ws2812_dma_free(dev, n * sizeof(dma_cb_t), cbs, phys);
+        return;
+    }
+    dma_pool_free(dev->cb_pool, cbs, phys);
+    --dev->cb_pool_live;
+}
 
-    // modify the duty cycle (DAT1)
-    LOG("+ Changing duty cycle to %d", duty);
-    *pwm_dat1 &= ~(PWM_DAT1_MASK);
-    *pwm_dat1 |= PWM_DAT1(duty);
+/**
+ * ws2812_buffer_alloc()
+ * 
+ * A zeroed buffer the encoder writes and the DMA reads, allocated the given way.
+ * Streaming buffers are ordinary cached kernel memory mapped for the device; the
+ * CPU owns them between ws2812_buffer_sync() calls
+ */
+static void *ws2812_buffer_alloc(struct ws2812_dev *dev, ws2812_dma_mem_t mem, size_t size, dma_addr_t *phys) {
+    // function setup
+    void *buffer;
+
+    switch (mem) {
+        case WS2812_DMA_MEM_WC:
+            buffer = dma_alloc_wc(dev->device, size, phys, GFP_KERNEL);
+            if (buffer) {
+                memset(buffer, 0, size);
+                ++dev->coherent_live;
+                dev->coherent_bytes += size;
+            }
+            return buffer;
+
+        case WS2812_DMA_MEM_STREAMING:
+            buffer = kzalloc(size, GFP_KERNEL);
+            if (!buffer) {
+                return NULL;
+            }
+            *phys = dma_map_single(dev->device, buffer, size, DMA_TO_DEVICE);
+            if (dma_mapping_error(dev->device, *phys)) {
+                kfree(buffer);
+                return NULL;
+            }
+            ++dev->streaming_live;
+            return buffer;
+
+        default:
+            buffer = ws2812_dma_alloc(dev, size, phys);
+            if (buffer) {
+                memset(buffer, 0, size);
+            }
+            return buffer;
+    }
+}
 
-    // enable PWM
-    LOG("+ Duty cycle changed! Enabling PWM.");
-    *pwm_ctl |= PWM_CTL_PWEN1(1);
+/**
+ * ws2812_buffer_free()
+ * 
+ * Release a buffer from ws2812_buffer_alloc(); NULL is ignored
+ */
+static void ws2812_buffer_free(struct ws2812_dev *dev, ws2812_dma_mem_t mem, size_t size, void *buffer,
+    dma_addr_t phys) {
+    if (!buffer) {
+        return;
+    }
+    switch (mem) {
+        case WS2812_DMA_MEM_WC:
+            dma_free_wc(dev->device, size, buffer, phys);
+            --dev->coherent_live;
+            dev->coherent_bytes -= size;
+            break;
+
+        case WS2812_DMA_MEM_STREAMING:
+            dma_unmap_single(dev->device, phys, size, DMA_TO_DEVICE);
+            kfree(buffer);
+            --dev->streaming_live;
+            break;
+
+        default:
+            ws2812_dma_free(dev, size, buffer, phys);
+            break;
+    }
+}
 
-    // return
-    return 0;
+/**
+ * ws2812_buffer_sync()
+ * 
+ * Hand len bytes of the frame buffer at start, just written by the CPU, to the
+ * device; writes back the cache lines they occupy. Must run before the DMA can be
+ * pointed at them. Coherent and write-combined memory need nothing
+ */
+static void ws2812_buffer_sync(struct ws2812_dev *dev, const void *start, size_t len) {
+    if (dev->dma_mem != WS2812_DMA_MEM_STREAMING) {
+        return;
+    }
+    dma_sync_single_for_device(dev->device, dev->dma_buffer_phys + ((const u8 *)start - (u8 *)dev->dma_buffer),
+        len, DMA_TO_DEVICE);
 }
 
+/**************************************************************************************
+ * HELPER FUNCTIONS
+ **************************************************************************************/
+
 /**
  * dma_configure()
  * 
@@ -312,48 +2736,156 @@ static int dma_configure(void) {
     volatile unsigned int *dma_conblkad = DMA_REG(DMA_CONBLKAD_OFFSET);
 
     // disable DMA channel
-    LOG("+ Disabling DMA for configuration.");
-    *dma_cs &= ~(DMA_CS_ACTIVE_MASK);
-    udelay(DELAY_SHORT);
+    if (!ws2812_device.chan) {
+        LOG("+ Disabling DMA for configuration.");
+        *dma_cs &= ~(DMA_CS_ACTIVE_MASK);
+        udelay(DELAY_SHORT);
+    }
 
     // allocate a DMA-accessible buffer for DMA transfers
     if (!ws2812_device.dma_buffer) {
+        if (ws2812_device.parallel.strips) {
+            // two buffers of clear words, one word per bit of a strip, then the pin
+            // mask and the zero word the pacing blocks write
+            ws2812_device.frame_words = ws2812_device.parallel.strip_leds * WS2812_WORDS_PER_LED;
+            ws2812_device.dma_buffer_len = (2 * ws2812_device.frame_words + 2) * sizeof(uint32_t);
+        } else if (ws2812_device.mode == WS2812_MODE_PIXEL) {
+            // two buffers per segment, sized to the attached LEDs, then the latch words
+            ws2812_device.frame_words = ws2812_device.num_leds * WS2812_WORDS_PER_LED;
+            ws2812_device.dma_buffer_len = (2 * ws2812_device.frame_words + ws2812_device.latch_words) *
+                sizeof(uint32_t);
+        } else {
+            // two waveform buffers, each followed by its hold word
+            ws2812_device.dma_buffer_len = 2 * WS2812_WAVEFORM_WORDS * sizeof(uint32_t);
+        }
+
         LOG("+ Allocating DMA-accessible memory buffer (device: %p).", ws2812_device.mdev.this_device);
-        ws2812_device.dma_buffer = dma_alloc_coherent(
-            ws2812_device.device,
-            BREATH_STEPS * sizeof(uint32_t),
-            &ws2812_device.dma_buffer_phys,
-            GFP_KERNEL
-        );
+        ws2812_device.dma_buffer = ws2812_buffer_alloc(&ws2812_device, ws2812_device.dma_mem,
+            ws2812_device.dma_buffer_len, &ws2812_device.dma_buffer_phys);
         if (!ws2812_device.dma_buffer) {
             LOGE("- Failed to allocate DMA buffer.");
             return -ENOMEM;
         }
     }
 
-    // populate the DMA buffer with a breathing LED, for now
-    for (int i = 0; i < BREATH_STEPS; ++i) {
-        ws2812_device.dma_buffer[i] = (uint32_t)breathing_table[i];
+    if (ws2812_device.parallel.strips) {
+        // both chains start out sending the current (initially blank) frame
+        ws2812_device.parallel.chain_cbs = ws2812_device.frame_words * WS2812_PARALLEL_BIT_CBS + 1;
+        ws2812_device.num_cbs = 2 * ws2812_device.parallel.chain_cbs;
+        ws2812_device.parallel.active = 0;
+        for (int b = 0; b < 2; ++b) {
+            ws2812_transpose_swar(ws2812_device.dma_buffer + b * ws2812_device.frame_words, ws2812_device.leds,
+                ws2812_device.parallel.strip_leds, ws2812_device.parallel.strips, ws2812_device.parallel.strip_leds,
+                ws2812_device.parallel.pin_base);
+        }
+        ws2812_device.dma_buffer[2 * ws2812_device.frame_words] = ws2812_device.parallel.pin_mask;
+        ws2812_device.dma_buffer[2 * ws2812_device.frame_words + 1] = 0;
+    } else if (ws2812_device.mode == WS2812_MODE_PIXEL) {
+        // split the strip into segments; one control block each
+        if (segment_leds == 0 || segment_leds > WS2812_MAX_LEDS) {
+            LOGW("- segment_leds=%u out of range; using %d.", segment_leds, WS2812_SEGMENT_LEDS);
+            segment_leds = WS2812_SEGMENT_LEDS;
+        }
+        ws2812_device.num_segments = DIV_ROUND_UP(ws2812_device.num_leds, segment_leds);
+        ws2812_device.num_cbs = ws2812_device.num_segments + 1;
+
+        ws2812_device.segments = kcalloc(ws2812_device.num_segments, sizeof(struct ws2812_segment), GFP_KERNEL);
+        if (!ws2812_device.segments) {
+            LOGE("- Failed to allocate segments.");
+            return -ENOMEM;
+        }
+
+        // segment buffers are slices of the two frame-sized halves of the DMA buffer
+        for (unsigned int i = 0; i < ws2812_device.num_segments; ++i) {
+            struct ws2812_segment *seg = &ws2812_device.segments[i];
+            size_t offset;
+
+            seg->first_led = i * segment_leds;
+            seg->num_leds = min_t(unsigned int, segment_leds, ws2812_device.num_leds - seg->first_led);
+            for (int b = 0; b < 2; ++b) {
+                offset = b * ws2812_device.frame_words + seg->first_led * WS2812_WORDS_PER_LED;
+                seg->buffer[b] = ws2812_device.dma_buffer + offset;
+                seg->buffer_phys[b] = ws2812_device.dma_buffer_phys + offset * sizeof(uint32_t);
+            }
+
+            // populate the active buffer with the current (initially blank) frame
+            ws2812_encode(&ws2812_device.encoder, seg->buffer[0], &ws2812_device.leds[seg->first_led], seg->num_leds);
+        }
+        LOG("+ Frame split into %u segments of up to %u LEDs.", ws2812_device.num_segments, segment_leds);
+
+        // a zero word is a bit period held LOW
+        memset(&ws2812_device.dma_buffer[2 * ws2812_device.frame_words], 0,
+            ws2812_device.latch_words * sizeof(uint32_t));
+    } else {
+        // the breathing table is the first waveform, played from set 0
+        ws2812_device.num_cbs = 2 * WS2812_WAVEFORM_CBS;
+        ws2812_device.wave_active = 0;
+        for (int i = 0; i < BREATH_STEPS; ++i) {
+            ws2812_device.dma_buffer[i] = (uint32_t)breathing_table[i];
+        }
+    }
+    ws2812_buffer_sync(&ws2812_device, ws2812_device.dma_buffer, ws2812_device.dma_buffer_len);
+
+    // the platform DMA driver builds and owns its own control blocks
+    if (ws2812_device.chan) {
+        LOG("+ Starting output on dmaengine channel.");
+        return ws2812_dmaengine_configure(&ws2812_device);
     }
     
-    // create a control block structure
-    LOG("+ Allocating DMA-accessible control block.");
-    ws2812_device.dma_cb = dma_alloc_coherent(ws2812_device.device, sizeof(dma_cb_t), &ws2812_device.cb_phys, GFP_KERNEL);
+    // short chains (the frame chain, small sequences) share pages of the control
+    // block pool; blocks must be 32-byte aligned for the DMA
+    if (!ws2812_device.cb_pool) {
+        ws2812_device.cb_pool = dma_pool_create("ws2812_cb", ws2812_device.device,
+            WS2812_CB_POOL_CBS * sizeof(dma_cb_t), sizeof(dma_cb_t), 0);
+        if (!ws2812_device.cb_pool) {
+            LOGE("- Failed to create control block pool.");
+            return -ENOMEM;
+        }
+    }
+
+    // create the control blocks
+    LOG("+ Allocating DMA-accessible control blocks.");
+    if (!ws2812_device.dma_cb) {
+        ws2812_device.dma_cb = ws2812_cb_alloc(&ws2812_device, ws2812_device.num_cbs, &ws2812_device.cb_phys);
+    }
     if (!ws2812_device.dma_cb) {
         LOGE("- Error allocating memory for DMA handle.");
         return -ENOMEM;
     }
 
-    // fill the control block
+    // fill the control blocks and chain them, the last one looping back to the first
     // DMA controller uses the bus addresses, not the virtually-mapped addresses, so dest_ad = bus address
-    LOG("+ Configuring DMA control block structure.");
-    ws2812_device.dma_cb->ti = DMA_TI_SRCINC(1) | DMA_TI_DESTDREQ(1) | DMA_TI_PERMAP(DMA_PERMAP_PWM);
-    ws2812_device.dma_cb->source_ad = ws2812_device.dma_buffer_phys;
-    ws2812_device.dma_cb->dest_ad = PWM_BUS_BASE_ADDRESS + PWM_FIF1_OFFSET;
-    ws2812_device.dma_cb->txfr_len = BREATH_STEPS * sizeof(uint32_t); // TODO: change this for WS2812
-    ws2812_device.dma_cb->stride = 0;
-    ws2812_device.dma_cb->nextconbk = ws2812_device.cb_phys; // repeat the buffer
-    LOG("+ DMA control block allocated at %p (phys: %pa)", ws2812_device.dma_cb, &ws2812_device.cb_phys);
+    LOG("+ Configuring DMA control block structures.");
+    if (ws2812_device.mode == WS2812_MODE_PWM) {
+        ws2812_waveform_build(&ws2812_device, 0, BREATH_STEPS, 0);
+    } else if (ws2812_device.parallel.strips) {
+        ws2812_parallel_build(&ws2812_device, 0);
+        ws2812_parallel_build(&ws2812_device, 1);
+    }
+    for (unsigned int i = 0; ws2812_device.mode == WS2812_MODE_PIXEL && !ws2812_device.parallel.strips &&
+            i < ws2812_device.num_cbs; ++i) {
+        dma_cb_t *cb = &ws2812_device.dma_cb[i];
+
+        cb->ti = DMA_TI_SRCINC(1) | DMA_TI_DESTDREQ(1) | DMA_TI_PERMAP(DMA_PERMAP_PWM);
+        cb->dest_ad = PWM_BUS_BASE_ADDRESS + PWM_FIF1_OFFSET;
+        cb->stride = 0;
+        cb->nextconbk = ws2812_device.cb_phys + ((i + 1) % ws2812_device.num_cbs) * sizeof(dma_cb_t);
+        if (ws2812_device.oneshot && i == ws2812_device.num_cbs - 1) {
+            // one-shot chains stop after the latch block
+            cb->nextconbk = 0;
+        }
+        if (ws2812_device.mode == WS2812_MODE_PIXEL && i == ws2812_device.num_segments) {
+            // latch block; holds the line LOW for the chip's reset time without
+            // advancing the source, so it costs one word of memory
+            cb->ti &= ~(DMA_TI_SRCINC_MASK);
+            cb->source_ad = ws2812_device.dma_buffer_phys + 2 * ws2812_device.frame_words * sizeof(uint32_t);
+            cb->txfr_len = ws2812_device.latch_words * sizeof(uint32_t);
+        } else {
+            cb->source_ad = ws2812_device.segments[i].buffer_phys[0];
+            cb->txfr_len = ws2812_device.segments[i].num_leds * WS2812_WORDS_PER_LED * sizeof(uint32_t);
+        }
+    }
+    LOG("+ %u DMA control blocks allocated at %p (phys: %pa)", ws2812_device.num_cbs, ws2812_device.dma_cb, &ws2812_device.cb_phys);
 
     // set the control block address
     LOG("+ Setting the configured control block to the DMA's settings.");
@@ -362,6 +2894,7 @@ static int dma_configure(void) {
     // enable DMA channel
     LOG("+ DMA Configuration Complete! Enabling peripheral.");
     *dma_cs |= DMA_CS_ACTIVE(1);
+    ws2812_device.started = ktime_get();
 
     // return 
     return 0;
@@ -377,41 +2910,88 @@ static void dma_cleanup(void) {
     volatile unsigned int *dma_cs = DMA_REG(DMA_CS_OFFSET);
     volatile unsigned int *dma_conblkad = DMA_REG(DMA_CONBLKAD_OFFSET);
 
-    // disable DMA channel
-    LOG("+ Disabling DMA channel.");
-    *dma_cs &= ~(DMA_CS_ACTIVE_MASK);  // Clear the ACTIVE bit to stop the DMA transfer
+    if (ws2812_device.chan) {
+        // stop the dmaengine channel before its buffers go away
+        LOG("+ Releasing dmaengine channel.");
+        ws2812_dmaengine_cleanup(&ws2812_device);
+    } else {
+        // disable DMA channel
+        LOG("+ Disabling DMA channel.");
+        *dma_cs &= ~(DMA_CS_ACTIVE_MASK);  // Clear the ACTIVE bit to stop the DMA transfer
+
+        // clear the control block address
+        LOG("+ Clearing DMA control block address.");
+        *dma_conblkad = 0;  // Clear the control block address
+    }
 
-    // clear the control block address
-    LOG("+ Clearing DMA control block address.");
-    *dma_conblkad = 0;  // Clear the control block address
+    // sequences that never handed over; the channel is stopped, so neither is in use
+    ws2812_seq_free(&ws2812_device, &ws2812_device.seq);
+    ws2812_seq_free(&ws2812_device, &ws2812_device.seq_retired);
 
     // free any allocated DMA resources if necessary
-    if (ws2812_device.dma_cb != NULL) {
-        dma_free_coherent(
-            ws2812_device.device,
-            sizeof(dma_cb_t),
-            ws2812_device.dma_cb,
-            ws2812_device.cb_phys
-        );
-        ws2812_device.dma_cb = NULL;
-        ws2812_device.cb_phys = 0;
-    }
+    ws2812_cb_free(&ws2812_device, ws2812_device.dma_cb, ws2812_device.num_cbs, ws2812_device.cb_phys);
+    ws2812_device.dma_cb = NULL;
+    ws2812_device.cb_phys = 0;
+
+    // free the segment table
+    kfree(ws2812_device.segments);
+    ws2812_device.segments = NULL;
+    ws2812_device.num_segments = 0;
 
     // free DMA buffer
-    if (ws2812_device.dma_buffer != NULL) {
-        dma_free_coherent(
-            ws2812_device.device,
-            BREATH_STEPS * sizeof(uint32_t),
-            ws2812_device.dma_buffer,
-            ws2812_device.dma_buffer_phys
-        );
-        ws2812_device.dma_buffer = NULL;
+    ws2812_buffer_free(&ws2812_device, ws2812_device.dma_mem, ws2812_device.dma_buffer_len,
+        ws2812_device.dma_buffer, ws2812_device.dma_buffer_phys);
+    ws2812_device.dma_buffer = NULL;
+
+    // everything the pool handed out has been returned by now
+    if (ws2812_device.cb_pool_live || ws2812_device.coherent_live || ws2812_device.streaming_live) {
+        LOGW("- Leaked %u control block chains, %u DMA allocations (%zu bytes) and %u mappings.",
+            ws2812_device.cb_pool_live, ws2812_device.coherent_live, ws2812_device.coherent_bytes,
+            ws2812_device.streaming_live);
     }
+    dma_pool_destroy(ws2812_device.cb_pool);
+    ws2812_device.cb_pool = NULL;
 
     // dma cleaned up
     LOG("DMA deconfiguration complete.");
 }
 
+/**
+ * gpio_configure()
+ * 
+ * Hand the data pin to the PWM, or make the parallel strips' pins LOW outputs; the
+ * PWM then only paces the DMA, so its pin is left alone
+ */
+static void gpio_configure(void) {
+    if (!ws2812_device.parallel.strips) {
+        ws2812_hw_gpio_configure(&ws2812_device.hw, WS2812_GPIO_PIN, GPFSEL_ALT5);
+        return;
+    }
+    for (unsigned int s = 0; s < ws2812_device.parallel.strips; ++s) {
+        ws2812_hw_gpio_clear(&ws2812_device.hw, ws2812_device.parallel.pin_base + s);
+        ws2812_hw_gpio_configure(&ws2812_device.hw, ws2812_device.parallel.pin_base + s, GPFSEL_OUTPUT);
+    }
+}
+
+/**
+ * gpio_cleanup()
+ * 
+ * Drive every data pin LOW and return it to an input
+ */
+static void gpio_cleanup(void) {
+    // function setup
+    unsigned int first = WS2812_GPIO_PIN, count = 1;
+
+    if (ws2812_device.parallel.strips) {
+        first = ws2812_device.parallel.pin_base;
+        count = ws2812_device.parallel.strips;
+    }
+    for (unsigned int pin = first; pin < first + count; ++pin) {
+        ws2812_hw_gpio_clear(&ws2812_device.hw, pin);
+        ws2812_hw_gpio_configure(&ws2812_device.hw, pin, GPFSEL_INPUT);
+    }
+}
+
 /**************************************************************************************
  * MODULE LOAD/UNLOAD FUNCTIONS
  **************************************************************************************/
@@ -430,6 +3010,130 @@ static int ws2812_probe(struct platform_device *pdev) {
 
     // store reference to device in the overarching device struct
     ws2812_device.device = &pdev->dev;
+    mutex_init(&ws2812_device.lock);
+    INIT_LIST_HEAD(&ws2812_device.layers);
+    spin_lock_init(&ws2812_device.submit_lock);
+    init_waitqueue_head(&ws2812_device.dma_wait);
+
+    // select the output mode
+    if (!strcmp(mode, "pixel")) {
+        ws2812_device.mode = WS2812_MODE_PIXEL;
+    } else if (!strcmp(mode, "pwm")) {
+        ws2812_device.mode = WS2812_MODE_PWM;
+    } else {
+        LOGE("- Unknown mode \"%s\"; use \"pixel\" or \"pwm\".", mode);
+        return -EINVAL;
+    }
+
+    // select the frame buffer memory
+    if (!strcmp(dma_mem, "coherent")) {
+        ws2812_device.dma_mem = WS2812_DMA_MEM_COHERENT;
+    } else if (!strcmp(dma_mem, "wc")) {
+        ws2812_device.dma_mem = WS2812_DMA_MEM_WC;
+    } else if (!strcmp(dma_mem, "streaming")) {
+        ws2812_device.dma_mem = WS2812_DMA_MEM_STREAMING;
+    } else {
+        LOGE("- Unknown dma_mem \"%s\"; use \"coherent\", \"wc\" or \"streaming\".", dma_mem);
+        return -EINVAL;
+    }
+
+    // select the chip profile and strip length
+    for (ws2812_device.chip = ws2812_chip_profiles; ws2812_device.chip->name; ++ws2812_device.chip) {
+        if (!strcmp(chip, ws2812_device.chip->name)) {
+            break;
+        }
+    }
+    if (!ws2812_device.chip->name) {
+        LOGE("- Unknown chip \"%s\".", chip);
+        return -EINVAL;
+    }
+    if (strips > WS2812_MAX_STRIPS || (strips && ws2812_device.mode != WS2812_MODE_PIXEL)) {
+        LOGE("- strips=%u invalid; pixel mode drives up to %d strips.", strips, WS2812_MAX_STRIPS);
+        return -EINVAL;
+    }
+    if (strips && strip_pin + strips - 1 > WS2812_PARALLEL_MAX_PIN) {
+        LOGE("- Strips on GPIO %u-%u; the last usable pin is %d.", strip_pin, strip_pin + strips - 1,
+            WS2812_PARALLEL_MAX_PIN);
+        return -EINVAL;
+    }
+    if (num_leds == 0 || num_leds > WS2812_MAX_LEDS / max(strips, 1u)) {
+        LOGE("- num_leds=%u out of range (1-%u).", num_leds, WS2812_MAX_LEDS / max(strips, 1u));
+        return -EINVAL;
+    }
+    if (strips && num_leds > WS2812_PARALLEL_MAX_LEDS) {
+        LOGE("- num_leds=%u too long for parallel output; the control blocks allow %zu LEDs per strip.", num_leds,
+            WS2812_PARALLEL_MAX_LEDS);
+        return -EINVAL;
+    }
+    ws2812_device.num_leds = num_leds * max(strips, 1u);
+    ws2812_device.latch_words = DIV_ROUND_UP(ws2812_device.chip->reset_ns, WS2812_BIT_NS);
+    ws2812_device.fps_window_start = ktime_get();
+
+    // one-shot transmission only applies to pixel frames
+    ws2812_device.oneshot = oneshot && ws2812_device.mode == WS2812_MODE_PIXEL && !strips;
+    ws2812_device.gate = gate_clock && ws2812_device.oneshot;
+    INIT_DELAYED_WORK(&ws2812_device.gate_work, ws2812_gate_work);
+    INIT_DELAYED_WORK(&ws2812_device.watchdog.work, ws2812_watchdog_work);
+    hrtimer_init(&ws2812_device.ready_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    ws2812_device.ready_timer.function = ws2812_ready_timer;
+    hrtimer_init(&ws2812_device.fade.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    ws2812_device.fade.timer.function = ws2812_fade_timer;
+    INIT_WORK(&ws2812_device.fade.work, ws2812_fade_work);
+
+    // use the chip's generated encoder table and pick the fastest encoder for this CPU;
+    // gamma is folded into the table, which the parallel transposes do not read
+    if (gamma && strips) {
+        LOGE("- gamma applies to single strip output only.");
+        return -EINVAL;
+    }
+    if (ws2812_device.mode == WS2812_MODE_PIXEL) {
+        ws2812_encoder_init_lut(&ws2812_device.encoder, ws2812_device.chip->lut);
+        if (gamma) {
+            ws2812_encoder_set_gamma(&ws2812_device.encoder, ws2812_device.chip->gamma);
+        }
+        LOG("> Using the %s encoder%s.", ws2812_device.encoder.name, gamma ? " with gamma correction" : "");
+    }
+
+    // parallel bits are three phases of T0H; T1H is two of them
+    if (strips) {
+        ws2812_device.parallel.strips = strips;
+        ws2812_device.parallel.strip_leds = num_leds;
+        ws2812_device.parallel.pin_base = strip_pin;
+        ws2812_device.parallel.pin_mask = GENMASK(strip_pin + strips - 1, strip_pin);
+        ws2812_device.parallel.phase_ticks = ws2812_device.encoder.t0h;
+        ws2812_device.parallel.phase_ns = DIV_ROUND_CLOSEST(ws2812_device.encoder.t0h * WS2812_BIT_NS,
+            WS2812_TICKS_PER_BIT);
+        ws2812_device.parallel.latch_phases = DIV_ROUND_UP(ws2812_device.chip->reset_ns,
+            ws2812_device.parallel.phase_ns);
+        LOG("> %u strips on GPIO %u-%u, %u ns per phase.", strips, strip_pin, strip_pin + strips - 1,
+            ws2812_device.parallel.phase_ns);
+    }
+    if (ws2812_device.mode == WS2812_MODE_PIXEL) {
+        LOG("> %u %s LEDs; %llu ns per frame including a %u ns latch.", ws2812_device.num_leds,
+            ws2812_device.chip->name, ws2812_frame_period_ns(&ws2812_device), ws2812_device.latch_words * WS2812_BIT_NS);
+    }
+
+    // pick the DMA backend; dmaengine needs the channel from the device tree, and
+    // can only stream to one peripheral, so parallel output runs on the raw channel
+    if (strips && !strcmp(dma_backend, "dmaengine")) {
+        LOGE("- Parallel output needs the raw DMA backend.");
+        return -EINVAL;
+    }
+    if (strcmp(dma_backend, "raw") && !strips) {
+        retval = ws2812_dmaengine_request(&ws2812_device, pdev);
+        if (retval == -EPROBE_DEFER) {
+            return retval;
+        }
+        if (retval && !strcmp(dma_backend, "dmaengine")) {
+            LOGE("- No dmaengine channel (%d); is ws2812-overlay loaded?", retval);
+            return retval;
+        }
+        if (retval) {
+            LOG("> No dmaengine channel (%d); using raw DMA channel %d.", retval, DMA_CHANNEL);
+        } else {
+            LOG("> Using dmaengine channel.");
+        }
+    }
 
     // initialize the misc device
     ws2812_device.mdev.minor = MISC_DYNAMIC_MINOR;
@@ -440,25 +3144,62 @@ static int ws2812_probe(struct platform_device *pdev) {
     retval = misc_register(&ws2812_device.mdev);
     if (retval) {
         LOGE("- Error registering misc device");
+        if (ws2812_device.chan) {
+            dma_release_channel(ws2812_device.chan);
+            ws2812_device.chan = NULL;
+        }
         return retval;
     }
 
     // configure GPIO
     LOG("> Configuring GPIO.");
-    gpio_configure(WS2812_GPIO_PIN, GPFSEL_ALT5);
+    gpio_configure();
 
     LOG("> Configuring CM.");
-    cm_configure(PWMCTL_OSC, PWMDIV_REGISTER_BREATHE, PWMCTL_MASH1STAGE); // TODO: change clock source and div for ws2812
-    // cm_configure(PWMCTL_PLLD, PWMDIV_REGISTER, PWMCTL_MASH1STAGE);
+    if (ws2812_device.mode == WS2812_MODE_PIXEL) {
+        ws2812_hw_cm_configure(&ws2812_device.hw, PWMCTL_PLLD, PWMDIV_REGISTER, PWMCTL_MASH1STAGE);
+    } else {
+        ws2812_hw_cm_configure(&ws2812_device.hw, PWMCTL_OSC, PWMDIV_REGISTER_BREATHE, PWMCTL_MASH1STAGE);
+    }
 
     LOG("> Configuring PWM.");
-    pwm_configure();
+    ws2812_hw_pwm_configure(&ws2812_device.hw, strips ? ws2812_device.parallel.phase_ticks : WS2812_TICKS_PER_BIT,
+        25);
 
     LOG("> Configuring DMA.");
-    dma_configure();
+    retval = dma_configure();
+    if (retval) {
+        LOGE("- DMA configuration failed (%d).", retval);
+        dma_cleanup();
+        gpio_cleanup();
+        misc_deregister(&ws2812_device.mdev);
+        return retval;
+    }
+
+    ws2812_debugfs_init(&ws2812_device);
+
+    // watch the channel from here on
+    ws2812_device.watchdog.interval_ms = watchdog_ms;
+    ws2812_device.watchdog.backoff_ms = watchdog_ms;
+    if (watchdog_ms) {
+        schedule_delayed_work(&ws2812_device.watchdog.work, msecs_to_jiffies(watchdog_ms));
+    }
+
+    // the boot animation plays from its own ring, so it needs the raw channel
+    init_completion(&ws2812_device.anim_loaded);
+    INIT_DELAYED_WORK(&ws2812_device.seq_work, ws2812_seq_work);
+    if (ws2812_device.mode == WS2812_MODE_PIXEL && !ws2812_device.chan && !strips && boot_anim[0] &&
+        !request_firmware_nowait(THIS_MODULE, true, boot_anim, &pdev->dev, GFP_KERNEL, &ws2812_device,
+            ws2812_anim_loaded)) {
+        LOG("> Requested boot animation %s.", boot_anim);
+    } else {
+        complete(&ws2812_device.anim_loaded);
+    }
 
     // set gpio
-    gpio_set(WS2812_GPIO_PIN);
+    if (!strips) {
+        ws2812_hw_gpio_set(&ws2812_device.hw, WS2812_GPIO_PIN);
+    }
 
     // success
     return 0;
@@ -473,12 +3214,27 @@ static int ws2812_remove(struct platform_device *pdev) {
     // log
     LOG("> Removing WS2812 Module.");
 
+    // no gating or recovery may race the teardown
+    cancel_delayed_work_sync(&ws2812_device.watchdog.work);
+    mutex_lock(&ws2812_device.lock);
+    ws2812_device.fade.active = false;
+    mutex_unlock(&ws2812_device.lock);
+    hrtimer_cancel(&ws2812_device.fade.timer);
+    cancel_work_sync(&ws2812_device.fade.work);
+    wait_for_completion(&ws2812_device.anim_loaded);
+    cancel_delayed_work_sync(&ws2812_device.seq_work);
+    cancel_delayed_work_sync(&ws2812_device.gate_work);
+    hrtimer_cancel(&ws2812_device.ready_timer);
+
+    // remove debugfs entries before the buffers they dump go away
+    debugfs_remove_recursive(ws2812_device.debugfs);
+    ws2812_device.debugfs = NULL;
+
     // deconfigure DMA
     dma_cleanup();
 
     // turn off an LED and configure GPIO to default
-    gpio_clear(WS2812_GPIO_PIN);
-    gpio_configure(WS2812_GPIO_PIN, GPFSEL_INPUT);
+    gpio_cleanup();
 
     // de-register device
     misc_deregister(&ws2812_device.mdev);
@@ -498,6 +3254,7 @@ static int __init ws2812_init(void) {
      * START MODULE ENTRY
      *****************************/
     // initialization setup
+    struct device_node *node;
     int retval = 0;
     
     // function setup
@@ -547,6 +3304,9 @@ static int __init ws2812_init(void) {
         LOG("> DMA peripheral mapped in memory at 0x%p.", dma_registers);
     }
 
+    // GPIO, PWM and CM control registers are only written through the shadowed layer
+    ws2812_hw_init(&ws2812_device.hw, gpio_registers, pwm_registers, cm_registers);
+
     /*****************************
      * DEVICE REGISTRATION
      *****************************/
@@ -557,11 +3317,17 @@ static int __init ws2812_init(void) {
     }
 
     // Register platform device manually (if no device tree)
-    LOG("> Registering platform device.");
-    ws2812_platform_device = platform_device_register_simple(WS2812_MODULE_NAME, -1, NULL, 0);
-    if (IS_ERR(ws2812_platform_device)) {
-        platform_driver_unregister(&ws2812_platform_driver);
-        return PTR_ERR(ws2812_platform_device);
+    node = of_find_compatible_node(NULL, NULL, WS2812_COMPATIBLE);
+    if (node) {
+        LOG("> Using platform device from the device tree.");
+        of_node_put(node);
+    } else {
+        LOG("> Registering platform device.");
+        ws2812_platform_device = platform_device_register_simple(WS2812_MODULE_NAME, -1, NULL, 0);
+        if (IS_ERR(ws2812_platform_device)) {
+            platform_driver_unregister(&ws2812_platform_driver);
+            return PTR_ERR(ws2812_platform_device);
+        }
     }
 
     /*****************************
@@ -590,22 +3356,20 @@ static void __exit ws2812_exit(void) {
     /*****************************
      * UNREGISTER MODULE
      *****************************/
-    platform_device_unregister(ws2812_platform_device);
+    if (ws2812_platform_device) {
+        platform_device_unregister(ws2812_platform_device);
+    }
     platform_driver_unregister(&ws2812_platform_driver);
 
     /*****************************
      * DE-INITIALIZE
      *****************************/
-    // free the DMA-accessible memory for the dma_buffer
-    if (ws2812_device.dma_buffer != NULL) {
-        LOG("> Freeing DMA-accessible memory for the DMA buffer.");
-        dma_free_coherent(
-            ws2812_device.device,
-            BREATH_STEPS * sizeof(uint32_t),
-            ws2812_device.dma_buffer,
-            ws2812_device.dma_buffer_phys
-        );
-        ws2812_device. dma_buffer = NULL;
+    // DMA memory was released by ws2812_remove() through dma_cleanup()
+
+    // unmap the DMA channel from memory
+    if (dma_registers != NULL) {
+        LOG("> Unmapping DMA peripheral.");
+        iounmap(dma_registers);
     }
 
     // unmap the CM peripheral from memory
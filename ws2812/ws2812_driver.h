@@ -22,15 +22,38 @@
 #include <linux/slab.h>             // memory allocation
 #include <asm/io.h>                 // provides arch-specific memory mapping
 #include <linux/dma-mapping.h>      // provides memory mapping for DMA peripheral
+#include <linux/dmapool.h>          // control block pool
 #include <linux/fs.h>               // file operations
 #include <linux/cdev.h>             // character device
 #include <linux/platform_device.h>  // platform device
 #include <linux/miscdevice.h>       // misc. device interface
 #include <linux/uaccess.h>          // user/kernel memory interfacing
 #include <linux/delay.h>            // delays
+#include <linux/mutex.h>            // device lock
+#include <linux/ktime.h>            // segment relink timestamps
+#include <linux/list.h>             // client layers
+#include <linux/mm.h>               // mmap
+#include <linux/vmalloc.h>          // mmap()ed pixel buffers
+#include <linux/debugfs.h>          // DMA dumps
+#include <linux/workqueue.h>        // one-shot clock gating
+#include <linux/dmaengine.h>        // dmaengine backend
+#include <linux/scatterlist.h>      // dmaengine frame descriptors
+#include <linux/of.h>               // device tree match
+#include <linux/spinlock.h>         // dmaengine submission
+#include <linux/wait.h>             // dmaengine frame completion
+#include <linux/poll.h>             // frame slot readiness
+#include <linux/hrtimer.h>          // raw-channel frame slot wakeups
+#include <linux/firmware.h>         // boot animation
+#include <linux/completion.h>       // boot animation load
+#include <linux/sched/signal.h>     // interruptible waveform waits
 
 // local includes
 #include "log.h"
+#include "ws2812_encode.h"
+#include "ws2812_ioctl.h"
+#include "ws2812_dump.h"
+#include "ws2812_hw.h"
+#include "ws2812_anim.h"
 
 /**************************************************************************************
  * MACROS/DEFINES
@@ -40,18 +63,85 @@
 
 // define module information
 #define WS2812_MODULE_NAME                  "ws2812"
+#define WS2812_COMPATIBLE                   "jauy,ws2812"
 #define WS2812_GPIO_PIN                     18
-#define WS2812_MAX_LEDS                     100
+#define WS2812_MAX_LEDS                     1024
+#define WS2812_DEFAULT_LEDS                 100
 #define DELAY_SHORT                         10
 
-// test defines
-#define BREATH_STEPS                        200
+// size of a layer's mmap()ed pixel buffer
+#define WS2812_MAP_SIZE                     PAGE_ALIGN(WS2812_MAX_LEDS * sizeof(led_t))
+
+// LEDs per independently encoded segment of the frame (segment_leds parameter)
+#define WS2812_SEGMENT_LEDS                 10
+
+// dma backend (dma_backend parameter), and how long to wait for a dmaengine frame
+#define WS2812_DEFAULT_DMA_BACKEND          "auto"
+#define WS2812_DMA_TIMEOUT_MS               100
+
+// control block chains of up to this many blocks come from the control block pool;
+// longer ones (waveform sets, long sequences) get a coherent allocation of their own
+#define WS2812_CB_POOL_CBS                  32
+
+// frame buffer memory (dma_mem parameter), and frames per strategy in the debugfs
+// encode benchmark
+#define WS2812_DEFAULT_DMA_MEM              "coherent"
+#define WS2812_MEM_BENCH_FRAMES             1000
+
+// default chip profile (chip parameter) and the window achieved fps is measured over
+#define WS2812_DEFAULT_CHIP                 "ws2812b"
+#define WS2812_FPS_WINDOW_US                1000000
+
+// shortest interval the frame slot timer re-checks a frame that is still sending
+#define WS2812_READY_POLL_US                100
+
+// longest automatic crossfade; a longer gap between frames is treated as a pause
+#define WS2812_CROSSFADE_AUTO_MAX_US        100000
+
+// frame sequences (boot_anim parameter, WS2812_IOC_PLAY_SEQUENCE); encoded size and
+// chain length limits, and the longest a hold block runs, which bounds how late a
+// new sequence or userspace takes over
+#define WS2812_DEFAULT_BOOT_ANIM            "ws2812-boot.bin"
+#define WS2812_ANIM_MAX_BYTES               (1 << 20)
+#define WS2812_ANIM_MAX_CBS                 4096
+#define WS2812_ANIM_HOLD_US                 20000
+
+// pwm mode waveform playback; each of the two waveform buffers is followed by its
+// hold word, and each control block set has one block per loop plus the hold block.
+// An upload waits for the previous set's last two blocks plus the timeout
+#define WS2812_WAVEFORM_WORDS               (WS2812_WAVEFORM_MAX_SAMPLES + 1)
+#define WS2812_WAVEFORM_CBS                 (WS2812_WAVEFORM_MAX_LOOPS + 1)
+#define WS2812_WAVEFORM_TIMEOUT_MS          1000
+
+// parallel output (strips parameter); first GPIO of the strips, and the phases of
+// a bit: every line HIGH, the lines sending a 0 LOW, every line LOW. Each phase is
+// one GPIO write and one pacing write, so two control blocks
+#define WS2812_PARALLEL_PIN_BASE            4
+#define WS2812_PARALLEL_MAX_PIN             27
+#define WS2812_PARALLEL_PHASES              3
+#define WS2812_PARALLEL_BIT_CBS             (2 * WS2812_PARALLEL_PHASES)
+
+// coherent memory the two parallel chains may take; every bit of a strip costs
+// WS2812_PARALLEL_BIT_CBS control blocks per chain whatever the number of strips,
+// so this bounds the LEDs per strip (113)
+#define WS2812_PARALLEL_CB_BYTES            (1 << 20)
+#define WS2812_PARALLEL_MAX_LEDS            \
+    ((WS2812_PARALLEL_CB_BYTES / (2 * sizeof(dma_cb_t)) - 2) / (WS2812_WORDS_PER_LED * WS2812_PARALLEL_BIT_CBS))
+
+// channel watchdog; checked every watchdog_ms, backing off to the maximum while
+// recoveries keep failing
+#define WS2812_WATCHDOG_MS                  10
+#define WS2812_WATCHDOG_MAX_MS              1000
 
 /**
  * CLOCK/PWM CONFIGURATION
  * 
- * 1. to keep it simple, we should assume 100 "ticks" per data bit sent to the WS2812,
- * so we can configure duty cycle as a percentage
+ * WS2812_BIT_NS, PLLD_HZ, the clock dividers (PWMDIV_REGISTER, PWMDIV_REGISTER_BREATHE)
+ * and BREATH_STEPS come from ws2812_tables.h, which ws2812_mktables generates at build
+ * time; set BIT_NS, BREATH_STEPS, BREATH_PERIOD_MS or GAMMA on the make command line.
+ * 
+ * 1. assume WS2812_TICKS_PER_BIT (100) "ticks" per data bit sent to the WS2812, so we
+ * can configure duty cycle as a percentage
  * 
  * 2. the WS2812 needs 1.25us per bit, so (1.25 us/bit) / (100 ticks/bit) = 12.5ns/tick
  * 
@@ -59,16 +149,9 @@
  * 
  * 4. divide the source clock by the desired clock to get the divider, so 500/80 = 6.25
  * 
- * 5. Since the PWM uses the clock divider register as a 12.12 fixed-point number, we
- *    can do some bit math to figure this out
- * 
- *      Integer component = (6 << 12) & 0x00FFF000;
- *      Fractional component = ((float)25/(float)100) * (1 << 12)
- * 
- * 6. OR'ing these together gives the register's set value (0x00006400)
+ * 5. the clock divider register is a 12.12 fixed-point number, so the register value
+ * is round(6.25 * 4096) = 0x00006400
  */
-#define PWMDIV_REGISTER                     (0x00006400)
-#define PWMDIV_REGISTER_BREATHE             (0x00180000)
 
 // BCM base address in physical memory
 #define PHY_BASE_ADDRESS                    (0x3F000000)
@@ -79,121 +162,12 @@
 
 // BCM bus addresses
 #define BUS_BASE_ADDRESS                    (0x7E000000)
+#define GPIO_BUS_BASE_ADDRESS               (BUS_BASE_ADDRESS + 0x00200000)
 #define PWM_BUS_BASE_ADDRESS                (BUS_BASE_ADDRESS + 0x0020C000)
 
 // BCM peripheral base registers
-#define GPIO_REG(offset)                    ((volatile unsigned int *)(((char *)gpio_registers) + (offset)))
-#define PWM_REG(offset)                     ((volatile unsigned int *)(((char *)pwm_registers) + (offset)))
-#define CM_REG(offset)                      ((volatile unsigned int *)(((char *)cm_registers) + (offset)))
 #define DMA_REG(offset)                     ((volatile unsigned int *)(((char *)dma_registers) + (offset)))
 
-// GPIO ====================================================================================
-// BCM GPIO offsets
-#define GPIO_GPFSEL0_OFFSET                 (0x00000000)
-#define GPIO_GPSET0_OFFSET                  (0x0000001C)
-#define GPIO_GPSET1_OFFSET                  (0x00000020)
-#define GPIO_GPCLR0_OFFSET                  (0x00000028)
-#define GPIO_GPCLR1_OFFSET                  (0x0000002C)
-
-// GPFSELn
-#define GPIO_GPFSEL_SHIFT(pin)              (((pin) % (10)) * (3))
-#define GPIO_GPFSEL_MASK(pin)               ((0x7) << (GPIO_GPFSEL_SHIFT(pin)))
-#define GPIO_GPFSEL_VALUE(pin, mode)        (((mode) & (0x7)) << (GPIO_GPFSEL_SHIFT(pin)))
-#define GPIO_GPFSEL(pin, mode)              ((GPIO_GPFSEL_MASK(pin)) & ((GPIO_GPFSEL_VALUE(pin, mode))))
-
-// BCM GPIO GPSET
-#define GPIO_GPSETN_SHIFT(pin)              (pin)
-#define GPIO_GPSETN_MASK(pin)               ((0x1) << (GPIO_GPSETN_SHIFT(pin)))
-#define GPIO_GPSETN(pin)                    ((0x1) << (pin))
-
-// BCM GPIO GPCLR
-#define GPIO_GPCLRN_SHIFT(pin)              (pin)
-#define GPIO_GPCLRN_MASK(pin)               ((0x1) << (GPIO_GPCLRN_SHIFT(pin)))
-#define GPIO_GPCLRN(pin)                    ((0x1) << (pin))
-
-// PWM =====================================================================================
-// BCM PWM offsets
-#define PWM_CTL_OFFSET                      (0x00000000)
-#define PWM_DMAC_OFFSET                     (0x00000008)
-#define PWM_RNG1_OFFSET                     (0x00000010)
-#define PWM_DAT1_OFFSET                     (0x00000014)
-#define PWM_FIF1_OFFSET                     (0x00000018)
-
-// BCM PWM CTL
-#define PWM_CTL_PWEN1_SHIFT                 (0)
-#define PWM_CTL_PWEN1_MASK                  ((0x1) << (PWM_CTL_PWEN1_SHIFT))
-#define PWM_CTL_PWEN1(val)                  ((PWM_CTL_PWEN1_MASK) & ((val) << (PWM_CTL_PWEN1_SHIFT)))
-
-#define PWM_CTL_MODE1_SHIFT                 (1)
-#define PWM_CTL_MODE1_MASK                  ((0x1) << (PWM_CTL_MODE1_SHIFT))
-#define PWM_CTL_MODE1(val)                  ((PWM_CTL_MODE1_MASK) & ((val) << (PWM_CTL_MODE1_SHIFT)))
-
-#define PWM_CTL_SBIT1_SHIFT                 (3)
-#define PWM_CTL_SBIT1_MASK                  ((0x1) << (PWM_CTL_SBIT1_SHIFT))
-#define PWM_CTL_SBIT1(val)                  ((PWM_CTL_SBIT1_MASK) & ((val) << (PWM_CTL_SBIT1_SHIFT)))
-
-#define PWM_CTL_USEF1_SHIFT                 (5)
-#define PWM_CTL_USEF1_MASK                  ((0x1) << (PWM_CTL_USEF1_SHIFT))
-#define PWM_CTL_USEF1(val)                  ((PWM_CTL_USEF1_MASK) & ((val) << (PWM_CTL_USEF1_SHIFT)))
-
-#define PWM_CTL_MSEN1_SHIFT                 (7)
-#define PWM_CTL_MSEN1_MASK                  ((0x1) << (PWM_CTL_MSEN1_SHIFT))
-#define PWM_CTL_MSEN1(val)                  ((PWM_CTL_MSEN1_MASK) & ((val) << (PWM_CTL_MSEN1_SHIFT)))
-
-// BCM PWM DMAC
-#define PWM_DMAC_ENAB_SHIFT                 (31)
-#define PWM_DMAC_ENAB_MASK                  ((0x1) << (PWM_DMAC_ENAB_SHIFT))
-#define PWM_DMAC_ENAB(val)                  ((PWM_DMAC_ENAB_MASK) & ((val) << (PWM_DMAC_ENAB_SHIFT)))
-
-// BCM PWM RNG1
-#define PWM_RNG1_SHIFT                      (0)
-#define PWM_RNG1_MASK                       ((0xFFFFFFFF) << (PWM_RNG1_SHIFT))
-#define PWM_RNG1(val)                       ((PWM_RNG1_MASK) & ((val) << (PWM_RNG1_SHIFT)))
-
-// BCM PWM DAT1
-#define PWM_DAT1_SHIFT                      (0)
-#define PWM_DAT1_MASK                       ((0xFFFFFFFF) << (PWM_DAT1_SHIFT))
-#define PWM_DAT1(val)                       ((PWM_DAT1_MASK) & ((val) << (PWM_DAT1_SHIFT)))
-
-// BCM PWM FIF1
-#define PWM_FIF1_PWM_FIFO_SHIFT             (0)
-#define PWM_FIF1_PWM_FIFO_MASK              ((0xFFFFFFF) << PWM_FIF1_PWM_FIFO_SHIFT)
-#define PWM_FIF1_PWM_FIFO(val)              ((PWM_FIF1_PWM_FIFO_MASK) & ((val) << (PWM_FIF1_PWM_FIFO_SHIFT)))
-
-// CM =====================================================================================
-// BCM CM constants
-#define CM_PASSWD                           (0x5A000000)
-#define CM_PASSWD_MASK                      (0xFF000000)
-
-// BCM CM offsets
-#define CM_PWMCTL_OFFSET                    (0x000000A0)
-#define CM_PWMDIV_OFFSET                   	(0x000000A4)
-
-// BCM CM PWMCTL_SRC
-#define CM_PWMCTL_SRC_SHIFT                 (0)
-#define CM_PWMCTL_SRC_MASK                  ((0xF) << (CM_PWMCTL_SRC_SHIFT))
-#define CM_PWMCTL_SRC(val)                  ((CM_PWMCTL_SRC_MASK) & ((val) << (CM_PWMCTL_SRC_SHIFT)))
-
-// BCM CM PWMCTL_ENAB
-#define CM_PWMCTL_ENAB_SHIFT                (4)
-#define CM_PWMCTL_ENAB_MASK                 ((0x1) << (CM_PWMCTL_ENAB_SHIFT))
-#define CM_PWMCTL_ENAB(val)                 ((CM_PWMCTL_ENAB_MASK) & ((val) << (CM_PWMCTL_ENAB_SHIFT)))
-
-// BCM CM PWMCTL_BUSY
-#define CM_PWMCTL_BUSY_SHIFT                (7)
-#define CM_PWMCTL_BUSY_MASK                 ((0x1) << (CM_PWMCTL_BUSY_SHIFT))
-#define CM_PWMCTL_BUSY(val)                 ((CM_PWMCTL_BUSY_MASK) & ((val) << (CM_PWMCTL_BUSY_SHIFT)))
-
-// BCM CM PWMCTL_MASH
-#define CM_PWMCTL_MASH_SHIFT                (9)
-#define CM_PWMCTL_MASH_MASK                 ((0x3) << (CM_PWMCTL_MASH_SHIFT))
-#define CM_PWMCTL_MASH(val)                 ((CM_PWMCTL_MASH_MASK) & ((val) << (CM_PWMCTL_MASH_SHIFT)))
-
-// BCM CM PWMDIV
-#define CM_PWMDIV_SHIFT                     (0)
-#define CM_PWMDIV_MASK                      ((0x00FFFFFF) << (CM_PWMDIV_SHIFT))
-#define CM_PWMDIV(val)                      ((CM_PWMDIV_MASK) & ((val) << (CM_PWMDIV_SHIFT)))
-
 // DMA =====================================================================================
 // BCM DMA constants
 #define DMA_CHANNEL                         5
@@ -204,6 +178,8 @@
 #define DMA_CHANNEL_BASE_ADDRESS            (DMA_BASE_ADDRESS + DMA_CHANNEL_OFFSET)
 #define DMA_CS_OFFSET                       (DMA_CHANNEL_OFFSET + 0x00000000)
 #define DMA_CONBLKAD_OFFSET                 (DMA_CHANNEL_OFFSET + 0x00000004)
+#define DMA_TXFR_LEN_OFFSET                 (DMA_CHANNEL_OFFSET + 0x00000014)
+#define DMA_DEBUG_OFFSET                    (DMA_CHANNEL_OFFSET + 0x00000020)
 
 // BCM DMA CS_ACTIVE
 #define DMA_CS_ACTIVE_SHIFT                 (0)
@@ -215,6 +191,11 @@
 #define DMA_CS_END_MASK                     ((0x1) << (DMA_CS_END_SHIFT))
 #define DMA_CS_END(val)                     ((DMA_CS_END_MASK) & ((val) << (DMA_CS_END_SHIFT)))
 
+// BCM DMA CS_ERROR; read only, mirrors the DEBUG error flags
+#define DMA_CS_ERROR_SHIFT                  (8)
+#define DMA_CS_ERROR_MASK                   ((0x1) << (DMA_CS_ERROR_SHIFT))
+#define DMA_CS_ERROR(val)                   ((DMA_CS_ERROR_MASK) & ((val) << (DMA_CS_ERROR_SHIFT)))
+
 // BCM DMA CS_RESET
 #define DMA_CS_RESET_SHIFT                  (31)
 #define DMA_CS_RESET_MASK                   ((0x1) << (DMA_CS_RESET_SHIFT))
@@ -225,6 +206,16 @@
 #define DMA_CONBLKAD_SCB_MASK               ((0xFFFFFFFF) << (DMA_CONBLKAD_SCB_SHIFT))
 #define DMA_CONBLKAD_SCB(val)               ((DMA_CONBLKAD_SCB_MASK) & ((val) << (DMA_CONBLKAD_SCB_SHIFT)))
 
+// BCM DMA DEBUG read, FIFO and read-last-not-set errors; write 1 to clear
+#define DMA_DEBUG_ERRORS_SHIFT              (0)
+#define DMA_DEBUG_ERRORS_MASK               ((0x7) << (DMA_DEBUG_ERRORS_SHIFT))
+#define DMA_DEBUG_ERRORS(val)               ((DMA_DEBUG_ERRORS_MASK) & ((val) << (DMA_DEBUG_ERRORS_SHIFT)))
+
+// BCM DMA TI_WAIT_RESP; the write completes before the next transfer starts
+#define DMA_TI_WAIT_RESP_SHIFT              (3)
+#define DMA_TI_WAIT_RESP_MASK               ((0x1) << (DMA_TI_WAIT_RESP_SHIFT))
+#define DMA_TI_WAIT_RESP(val)               ((DMA_TI_WAIT_RESP_MASK) & ((val) << (DMA_TI_WAIT_RESP_SHIFT)))
+
 // BCM DMA TI_DESTDREQ
 #define DMA_TI_DESTDREQ_SHIFT               (6)
 #define DMA_TI_DESTDREQ_MASK                ((0x1) << (DMA_TI_DESTDREQ_SHIFT))
@@ -243,50 +234,6 @@
 /**************************************************************************************
  * TYPEDEFS
  **************************************************************************************/
-/**
- * gpfsel_mode_t
- * 
- * Enumeration to control the GPFSEL registers
- */
- typedef enum {
-	GPFSEL_INPUT        = 0b000,
-	GPFSEL_OUTPUT       = 0b001,
-	GPFSEL_ALT0         = 0b100,
-	GPFSEL_ALT1         = 0b101,
-	GPFSEL_ALT2         = 0b110,
-	GPFSEL_ALT3         = 0b111,
-	GPFSEL_ALT4         = 0b011,
-	GPFSEL_ALT5         = 0b010,
-} gpfsel_mode_t;
-
-/**
- * pwmctl_src_t
- * 
- * Enumeration to control the clock source of the CM (clock manager)
- */
-typedef enum {
-	PWMCTL_GND          = 0b000,
-	PWMCTL_OSC          = 0b001,
-	PWMCTL_TESTDEBUG0   = 0B010,
-	PWMCTL_TESTDEBUG1   = 0b011,
-	PWMCTL_PLLA         = 0b100,
-	PWMCTL_PLLC         = 0b101,
-	PWMCTL_PLLD         = 0b110,
-	PWMCTL_HDMIAUX      = 0b111,
-} pwmctl_src_t;
-
-/**
- * pwmctl_mash_t
- * 
- * Enumeration to determine the MASH algorithm
- */
-typedef enum {
-	PWMCTL_MASHINT      = 0b000,
-	PWMCTL_MASH1STAGE   = 0b001,
-	PWMCTL_MASH2STAGE   = 0b010,
-	PWMCTL_MASH3STAGE   = 0b011,
-} pwmctl_mash_t;
-
 /**
  * dma_cb_t
  * 
@@ -307,15 +254,208 @@ typedef struct dma_cb_t {
 } dma_cb_t;
 
 /**
- * led_t
+ * ws2812_mode_t
+ * 
+ * Enumeration of what the driver streams to the PWM; selected by the mode parameter
+ */
+typedef enum {
+    WS2812_MODE_PIXEL,      // encoded WS2812 frames, written as led_t arrays
+    WS2812_MODE_PWM,        // duty-cycle waveforms (breathing demo at load), written as
+                            // a duty cycle string or WS2812_IOC_SET_WAVEFORM
+} ws2812_mode_t;
+
+/**
+ * ws2812_dma_mem_t
  * 
- * Defines an LED struct representing a single RGB led
+ * How the frame buffer the encoder writes is allocated; selected by the dma_mem
+ * parameter
  */
-typedef struct led {
-    uint8_t red;
-    uint8_t green;
-    uint8_t blue;
-} led_t;
+typedef enum {
+    WS2812_DMA_MEM_COHERENT,    // dma_alloc_coherent; uncached on ARM, never synced
+    WS2812_DMA_MEM_WC,          // dma_alloc_wc; uncached, but stores are combined
+    WS2812_DMA_MEM_STREAMING,   // cached pages under a streaming mapping, synced to
+                                // the device after each encode
+} ws2812_dma_mem_t;
+
+/**
+ * struct ws2812_segment
+ * 
+ * A run of LEDs with its own pair of encoded buffers and its own control block in
+ * the frame chain. Only segments whose pixels change are re-encoded; the new data
+ * goes into the idle buffer and the control block is relinked to it, so the DMA
+ * switches over at its next pass without ever reading a half-encoded buffer
+ */
+struct ws2812_segment {
+    // LEDs covered by this segment
+    unsigned int first_led;
+    unsigned int num_leds;
+
+    // encoded buffers; the control block points at buffer[active]
+    uint32_t *buffer[2];
+    dma_addr_t buffer_phys[2];
+    int active;
+
+    // when the control block was last relinked; the idle buffer may still be in
+    // flight until one full frame period has passed
+    ktime_t relinked;
+
+    // dmaengine backend: frames submitted before the relink; the idle buffer is
+    // free once that many frames have completed
+    u64 relink_seq;
+};
+
+/**
+ * struct ws2812_seq
+ *
+ * A pre-encoded frame sequence the DMA plays with no CPU involvement: every frame
+ * encoded once into buffer behind a zero word, and a ring of data blocks and hold
+ * blocks that repeat the zero word, paced by the PWM DREQ, for each frame's delay
+ */
+struct ws2812_seq {
+    uint32_t *buffer;
+    dma_addr_t buffer_phys;
+    size_t buffer_len;
+    dma_cb_t *cb;
+    dma_addr_t cb_phys;
+    unsigned int num_cbs;
+};
+
+/**
+ * struct ws2812_chip_profile
+ *
+ * Timing of one WS2812-compatible LED part. The high times set the PWM words for a 0
+ * and a 1 bit; reset_ns is the minimum LOW time that latches a frame, which is sent
+ * after every frame as a run of all-LOW bit periods. gamma and lut are the part's
+ * generated gamma curve and encoder lookup table
+ */
+struct ws2812_chip_profile {
+    const char *name;
+    unsigned int t0h_ns;
+    unsigned int t1h_ns;
+    unsigned int reset_ns;
+    const uint8_t *gamma;
+    const uint32_t (*lut)[WS2812_BITS_PER_BYTE];
+};
+
+/**
+ * ws2812_frame_source_t
+ * 
+ * Where the composited frame came from; lets the render pick a cheaper encoding
+ * when a single opaque layer makes up the whole frame
+ */
+typedef enum {
+    WS2812_FRAME_COMPOSITED,    // general case; encode the frame pixels
+    WS2812_FRAME_RUNS,          // single RLE layer; encode run by run
+    WS2812_FRAME_INDEXED,       // single full-strip indexed layer; copy palette words
+} ws2812_frame_source_t;
+
+/**
+ * struct ws2812_layer
+ * 
+ * Per-open state; every client draws into its own layer and the driver composites
+ * all layers into the output frame whenever one of them changes
+ */
+struct ws2812_layer {
+    // position in the device's layer list, sorted by z
+    struct list_head node;
+    struct ws2812_dev *dev;
+
+    // placement and blending, as set by WS2812_IOC_SET_LAYER
+    struct ws2812_layer_config cfg;
+
+    // write format, as set by WS2812_IOC_SET_FORMAT
+    u32 format;
+
+    // WS2812_FORMAT_INDEXED state; the pre-encoded palette is allocated on first use
+    uint8_t indices[WS2812_MAX_LEDS];
+    led_t palette[WS2812_PALETTE_SIZE];
+    ws2812_encoded_led_t *palette_words;
+
+    // pixels were last filled from indices (rather than by a commit), so the frame
+    // can be encoded from the palette and follows palette changes
+    bool indexed;
+
+    // layer contents, relative to cfg.first_led; hidden until first written
+    led_t pixels[WS2812_MAX_LEDS];
+    bool visible;
+
+    // pixel buffer shared with userspace by mmap(); copied into pixels on
+    // WS2812_IOC_COMMIT
+    led_t *map;
+};
+
+/**
+ * struct ws2812_fade
+ * 
+ * Crossfade state (WS2812_IOC_SET_CROSSFADE), in frame order: the frame shown when
+ * the latest one arrived, that frame, and the step last rendered between them. The
+ * timer fires once per output frame period and queues work, which renders the next
+ * step under the device lock
+ */
+struct ws2812_fade {
+    led_t from[WS2812_MAX_LEDS];
+    led_t to[WS2812_MAX_LEDS];
+    led_t shown[WS2812_MAX_LEDS];
+    u32 duration_us;
+    u64 span_ns;
+    ktime_t start;
+    ktime_t last_arrival;
+    bool active;
+    struct hrtimer timer;
+    struct work_struct work;
+};
+
+/**
+ * struct ws2812_watchdog
+ * 
+ * Channel watchdog state: the transfer position at the last check, and how often
+ * each fault was seen. A stall is a channel that is active but has neither moved
+ * nor kept the PWM FIFO fed since the last check
+ */
+struct ws2812_watchdog {
+    struct delayed_work work;
+    unsigned int interval_ms;
+    unsigned int backoff_ms;
+
+    // raw channel position, or the dmaengine completion count and when it last moved
+    dma_addr_t last_cb;
+    u32 last_len;
+    u64 last_completed;
+    ktime_t progress;
+
+    // event counters (debugfs)
+    u32 errors;
+    u32 stops;
+    u32 stalls;
+    u32 underruns;
+    u32 recoveries;
+};
+
+/**
+ * struct ws2812_parallel
+ * 
+ * Parallel output: strips strips of strip_leds LEDs on consecutive GPIOs from
+ * pin_base, sent together by DMA writes to GPSET0/GPCLR0. The PWM only paces the
+ * chain; every phase ends on a word written to its FIFO, which drains one word per
+ * phase_ticks. Each of the two chains sends its own buffer of clear words and ends
+ * on a latch block; the DMA loops on chain active, and a render switches it over by
+ * relinking the active chain's latch block
+ */
+struct ws2812_parallel {
+    unsigned int strips;
+    unsigned int strip_leds;
+    unsigned int pin_base;
+    u32 pin_mask;
+
+    // phase length in PWM ticks and ns, and the latch in phases
+    unsigned int phase_ticks;
+    unsigned int phase_ns;
+    unsigned int latch_phases;
+
+    // control blocks per chain, and the chain the DMA loops on
+    unsigned int chain_cbs;
+    int active;
+};
 
 /**
  * struct ws2812_dev
@@ -323,21 +463,133 @@ typedef struct led {
  * Defines the structure of the module's device
  */
 struct ws2812_dev {
-    // array of LEDs
+    // array of LEDs as currently encoded, and the composited next frame
     led_t leds[WS2812_MAX_LEDS];
+    led_t frame[WS2812_MAX_LEDS];
     int duty_cycle;
 
-    // dma buffer and physical handle
+    // matrix layout (WS2812_IOC_SET_LAYOUT); wired LED i shows frame[layout[i]].
+    // Only consulted while layout_active, otherwise frames are sent as they are
+    u16 layout[WS2812_MAX_LEDS];
+    bool layout_active;
+
+    // client layers, bottom to top
+    struct list_head layers;
+
+    // scratch space for run-length encoded writes
+    struct ws2812_rle_run runs[WS2812_MAX_LEDS];
+
+    // set by ws2812_composite(); the layer is only valid for FRAME_RUNS/INDEXED
+    ws2812_frame_source_t frame_source;
+    struct ws2812_layer *frame_layer;
+
+    // output mode and the encoder for pixel mode
+    ws2812_mode_t mode;
+    struct ws2812_encoder encoder;
+
+    // attached LEDs; only these are streamed, followed by latch_words LOW bits
+    const struct ws2812_chip_profile *chip;
+    unsigned int num_leds;
+    unsigned int latch_words;
+
+    // frame-rate up-conversion
+    struct ws2812_fade fade;
+
+    // parallel output; strips is 0 when the PWM drives a single strip. num_leds is
+    // then the total over every strip, which the frame holds strip after strip
+    struct ws2812_parallel parallel;
+
+    // one-shot transmission: each rendered frame is sent once and the channel
+    // idles; with gate set the PWM and its clock are stopped in between
+    bool oneshot;
+    bool gate;
+    bool gated;
+    ktime_t started;
+    struct delayed_work gate_work;
+
+    // achieved frame rate; frames rendered in the current window, and the rate
+    // measured over the last complete one
+    ktime_t fps_window_start;
+    unsigned int fps_window_frames;
+    u32 achieved_fps_milli;
+
+    // serializes writers and protects the layer list
+    struct mutex lock;
+
+    // GPIO/PWM/CM register shadows
+    struct ws2812_hw hw;
+
+    // pwm mode waveforms; the DMA plays buffer and control block set wave_active
+    // while the other is free for the next upload. wave_cbs is how many blocks of
+    // each set the current chain uses, wave_samples how long each block's pass is
+    int wave_active;
+    unsigned int wave_cbs[2];
+    unsigned int wave_samples[2];
+
+    // frame sequences (boot animation, WS2812_IOC_PLAY_SEQUENCE); the ring the DMA
+    // is playing on its own, and the one it is leaving, which seq_work frees once
+    // the DMA is out of it. rendered is set by the first frame from userspace
+    struct ws2812_seq *seq;
+    struct ws2812_seq *seq_retired;
+    bool rendered;
+    struct delayed_work seq_work;
+    struct completion anim_loaded;
+
+    // dma buffer and physical handle; in pixel mode this holds two frames of
+    // frame_words (every segment's two buffers, sized to the attached LEDs), then
+    // latch_words zero words (the raw latch block repeats the first; dmaengine
+    // frames send them all). Parallel output keeps a chain's clear words in each
+    // frame, followed by the pin mask and one zero word
     uint32_t *dma_buffer;
     dma_addr_t dma_buffer_phys;
-
-    // dma control block
+    size_t dma_buffer_len;
+    unsigned int frame_words;
+    ws2812_dma_mem_t dma_mem;
+
+    // DMA memory; the pool short control block chains come from, and how many pool
+    // chains, coherent (or write-combined) allocations and streaming mappings are
+    // live, for leak checking (debugfs)
+    struct dma_pool *cb_pool;
+    u32 cb_pool_live;
+    u32 coherent_live;
+    size_t coherent_bytes;
+    u32 streaming_live;
+
+    // frame segments (pixel mode)
+    struct ws2812_segment *segments;
+    unsigned int num_segments;
+
+    // dma control blocks; one per segment plus the latch block, chained in a loop
     dma_cb_t *dma_cb;
     dma_addr_t cb_phys;
+    unsigned int num_cbs;
+
+    // dmaengine backend; when chan is NULL the raw channel registers are used.
+    // Each frame is a slave_sg descriptor over the active segment buffers and the
+    // latch words; its completion callback submits the next one
+    struct dma_chan *chan;
+    struct scatterlist *sg;
+    spinlock_t submit_lock;
+    wait_queue_head_t dma_wait;
+    u64 submitted;
+    u64 completed;
+    bool in_flight;
+    bool streaming;
+
+    // frame slot readiness for O_NONBLOCK writers and poll(); a slot is free once
+    // no segment's idle buffer can still be read. dmaengine completions wake
+    // dma_wait directly; on the raw channel ready_timer does it a frame later
+    struct hrtimer ready_timer;
+
+    // resets and re-arms an errored or stalled channel
+    struct ws2812_watchdog watchdog;
 
     // misc device
     struct miscdevice mdev;
 
+    // debugfs directory
+    struct dentry *debugfs;
+
     // device
     struct device *device;
 };
@@ -351,29 +603,8 @@ static volatile unsigned int *pwm_registers = NULL;
 static volatile unsigned int *cm_registers = NULL;
 static volatile unsigned int *dma_registers = NULL;
 
-// for breathing animation; pre-computed table for a sine wave
-static const uint8_t breathing_table[200] = {
-    0,  0,  0,  0,  0,  0,  0,  1,  1,  1,
-    2,  2,  3,  4,  4,  5,  6,  6,  7,  8,
-    9, 10, 11, 12, 13, 14, 15, 16, 18, 19,
-   20, 21, 23, 24, 25, 27, 28, 30, 31, 33,
-   34, 36, 37, 39, 40, 42, 43, 45, 46, 48,
-   49, 51, 53, 54, 56, 57, 59, 60, 62, 63,
-   65, 66, 68, 69, 71, 72, 74, 75, 76, 78,
-   79, 80, 81, 83, 84, 85, 86, 87, 88, 89,
-   90, 91, 92, 93, 93, 94, 95, 95, 96, 97,
-   97, 98, 98, 98, 99, 99, 99, 99, 99, 99,
-  100, 99, 99, 99, 99, 99, 99, 98, 98, 98,
-   97, 97, 96, 95, 95, 94, 93, 93, 92, 91,
-   90, 89, 88, 87, 86, 85, 84, 83, 81, 80,
-   79, 78, 76, 75, 74, 72, 71, 69, 68, 66,
-   65, 63, 62, 60, 59, 57, 56, 54, 53, 51,
-   49, 48, 46, 45, 43, 42, 40, 39, 37, 36,
-   34, 33, 31, 30, 28, 27, 25, 24, 23, 21,
-   20, 19, 18, 16, 15, 14, 13, 12, 11, 10,
-    9,  8,  7,  6,  6,  5,  4,  4,  3,  2,
-    2,  1,  1,  1,  0,  0,  0,  0,  0,  0
-  };
+// clock dividers, breathing waveform, gamma curves, encoder tables and chip profiles
+#include "ws2812_tables.h"
 
 /**************************************************************************************
  * FUNCTION PROTOTYPES
@@ -385,9 +616,75 @@ static int ws2812_remove(struct platform_device *pdev);
 
 // file operations
 static int ws2812_open(struct inode *inode, struct file *file);
+static int ws2812_release(struct inode *inode, struct file *file);
 static ssize_t ws2812_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos);
-
-// module functions
-static int pwm_setduty(int duty);
+static long ws2812_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+static int ws2812_mmap(struct file *file, struct vm_area_struct *vma);
+static __poll_t ws2812_poll(struct file *file, poll_table *wait);
+static int ws2812_commit(struct ws2812_layer *layer);
+static ssize_t ws2812_write_pixels(struct ws2812_layer *layer, const char __user *buf, size_t count);
+static ssize_t ws2812_write_rle(struct ws2812_layer *layer, const char __user *buf, size_t count);
+static ssize_t ws2812_write_indexed(struct ws2812_layer *layer, const char __user *buf, size_t count);
+static ssize_t ws2812_write_duty(struct ws2812_dev *dev, const char __user *buf, size_t count);
+
+// layers
+static unsigned int ws2812_layer_span(const struct ws2812_layer *layer);
+static void ws2812_layer_insert(struct ws2812_dev *dev, struct ws2812_layer *layer);
+static int ws2812_layer_alloc_palette(struct ws2812_layer *layer);
+static void ws2812_layer_resolve(struct ws2812_layer *layer);
+static int ws2812_layer_set_palette(struct ws2812_layer *layer, const struct ws2812_palette *palette);
+static void ws2812_composite(struct ws2812_dev *dev);
+
+// frame rendering
+static void ws2812_show(struct ws2812_dev *dev);
+static void ws2812_render(struct ws2812_dev *dev);
+static int ws2812_layout_set(struct ws2812_dev *dev, const struct ws2812_layout *cfg, const u16 *table);
+static bool ws2812_frame_ready(struct ws2812_dev *dev);
+static void ws2812_get_timing(struct ws2812_dev *dev, struct ws2812_timing *timing);
+
+// parallel output
+static void ws2812_parallel_build(struct ws2812_dev *dev, int chain);
+static bool ws2812_parallel_busy(struct ws2812_dev *dev, int chain);
+static void ws2812_parallel_render(struct ws2812_dev *dev);
+
+// crossfade
+static void ws2812_fade_set(struct ws2812_dev *dev, u32 duration_us);
+static void ws2812_fade_start(struct ws2812_dev *dev);
+static void ws2812_fade_work(struct work_struct *work);
+static enum hrtimer_restart ws2812_fade_timer(struct hrtimer *timer);
+
+// waveform playback
+static int ws2812_waveform_play(struct ws2812_dev *dev, const u32 *samples, unsigned int n, unsigned int loops,
+    u32 divider);
+
+// frame sequences
+static int ws2812_seq_play(struct ws2812_dev *dev, const void *data, size_t size);
+static void ws2812_seq_stop(struct ws2812_dev *dev);
+static bool ws2812_seq_busy(struct ws2812_dev *dev, struct ws2812_seq *seq);
+static void ws2812_seq_free(struct ws2812_dev *dev, struct ws2812_seq **seq);
+static void ws2812_anim_loaded(const struct firmware *fw, void *context);
+
+// watchdog
+static void ws2812_watchdog_work(struct work_struct *work);
+
+// debugfs
+static void ws2812_debugfs_init(struct ws2812_dev *dev);
+
+// dma memory
+static void *ws2812_dma_alloc(struct ws2812_dev *dev, size_t size, dma_addr_t *phys);
+static void ws2812_dma_free(struct ws2812_dev *dev, size_t size, void *mem, dma_addr_t phys);
+static dma_cb_t *ws2812_cb_alloc(struct ws2812_dev *dev, unsigned int n, dma_addr_t *phys);
+static void ws2812_cb_free(struct ws2812_dev *dev, dma_cb_t *cbs, unsigned int n, dma_addr_t phys);
+static void *ws2812_buffer_alloc(struct ws2812_dev *dev, ws2812_dma_mem_t mem, size_t size, dma_addr_t *phys);
+static void ws2812_buffer_free(struct ws2812_dev *dev, ws2812_dma_mem_t mem, size_t size, void *buffer,
+    dma_addr_t phys);
+static void ws2812_buffer_sync(struct ws2812_dev *dev, const void *start, size_t len);
+
+// dmaengine backend
+static int ws2812_dmaengine_request(struct ws2812_dev *dev, struct platform_device *pdev);
+static int ws2812_dmaengine_configure(struct ws2812_dev *dev);
+static int ws2812_dmaengine_cyclic(struct ws2812_dev *dev, dma_addr_t addr, size_t len);
+static int ws2812_dmaengine_submit(struct ws2812_dev *dev, bool resubmit);
+static void ws2812_dmaengine_cleanup(struct ws2812_dev *dev);
 
 # endif /* _WS2812_H_ */
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef _WS2812_DUMP_H_
+#define _WS2812_DUMP_H_
+
+/**
+ * ws2812 DMA dump format
+ *
+ * Snapshot of everything the DMA streams to the PWM, read from debugfs
+ * (ws2812/dma) or built by a host tool, so the output waveform can be replayed and
+ * checked without a logic analyzer. Layout:
+ *
+ *      struct ws2812_dump_header
+ *      struct ws2812_dump_cb[num_cbs]      control blocks, as the DMA sees them
+ *      buffer_len bytes                    the DMA buffer the blocks point into
+ *
+ * Addresses inside the control blocks are DMA addresses; cb_addr and buffer_addr
+ * give the DMA addresses of the first block and the start of the buffer, so a
+ * reader can translate them into offsets. All fields are little-endian
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#include <linux/types.h>
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define WS2812_DUMP_MAGIC                   0x31445357  // "WSD1"
+#define WS2812_DUMP_VERSION                 1
+
+// control block TI bits a reader needs
+#define WS2812_DUMP_TI_SRCINC               (1 << 8)
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+/**
+ * struct ws2812_dump_header
+ *
+ * PWM timing and chip timing in effect, and where the chain and buffer live. The
+ * DMA starts at first_cb and follows nextconbk; a nextconbk of 0 ends the chain
+ */
+struct ws2812_dump_header {
+    __u32 magic;
+    __u32 version;
+
+    // PWM clock after the divider, and the range (ticks per bit)
+    __u32 pwm_clock_hz;
+    __u32 pwm_range;
+
+    // chip timing the words were encoded for
+    __u32 t0h_ns;
+    __u32 t1h_ns;
+    __u32 reset_ns;
+    __u32 num_leds;
+
+    // control blocks and buffer
+    __u32 cb_addr;
+    __u32 num_cbs;
+    __u32 first_cb;
+    __u32 buffer_addr;
+    __u32 buffer_len;
+};
+
+/**
+ * struct ws2812_dump_cb
+ *
+ * A BCM2837 DMA control block (same layout as the driver's dma_cb_t)
+ */
+struct ws2812_dump_cb {
+    __u32 ti;
+    __u32 source_ad;
+    __u32 dest_ad;
+    __u32 txfr_len;
+    __u32 stride;
+    __u32 nextconbk;
+    __u32 _reserved[2];
+};
+
+#endif /* _WS2812_DUMP_H_ */
@@ -0,0 +1,424 @@
+#include "ws2812_encode.h"
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/timekeeping.h>
+#ifdef WS2812_ENCODE_HAVE_NEON
+#include <asm/neon.h>
+#endif
+#else
+#include <string.h>
+#include <time.h>
+#endif
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+// LEDs ws2812_encode_remap() gathers per block
+#define REMAP_BLOCK_LEDS                    32
+
+// calibration workload used to pick an implementation at init
+#define CALIBRATE_LEDS                      32
+#define CALIBRATE_ENCODES                   8
+#define CALIBRATE_RUNS                      4
+
+/**************************************************************************************
+ * GLOBALS
+ **************************************************************************************/
+// calibration buffers; only touched while an encoder is initialized
+static led_t calibrate_leds[CALIBRATE_LEDS];
+static uint32_t calibrate_out[CALIBRATE_LEDS * WS2812_WORDS_PER_LED];
+
+/**************************************************************************************
+ * ENCODER IMPLEMENTATIONS
+ **************************************************************************************/
+
+/**
+ * ws2812_encode_scalar()
+ *
+ * Reference implementation; walks every bit of every byte. All other implementations
+ * must produce exactly the same words as this one
+ */
+void ws2812_encode_scalar(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n) {
+    // function setup
+    uint8_t grb[WS2812_BYTES_PER_LED];
+
+    for (size_t i = 0; i < n; ++i) {
+        // the WS2812 latches green first
+        grb[0] = leds[i].green;
+        grb[1] = leds[i].red;
+        grb[2] = leds[i].blue;
+
+        // MSB first
+        for (int byte = 0; byte < WS2812_BYTES_PER_LED; ++byte) {
+            for (int bit = WS2812_BITS_PER_BYTE - 1; bit >= 0; --bit) {
+                *out++ = (grb[byte] & (1 << bit)) ? enc->t1h : enc->t0h;
+            }
+        }
+    }
+}
+
+/**
+ * ws2812_encode_lut()
+ *
+ * Portable fast path; copies one pre-expanded row of 8 words per color byte
+ */
+void ws2812_encode_lut(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(out, enc->lut[leds[i].green], sizeof(enc->lut[0]));
+        memcpy(out + 8, enc->lut[leds[i].red], sizeof(enc->lut[0]));
+        memcpy(out + 16, enc->lut[leds[i].blue], sizeof(enc->lut[0]));
+        out += WS2812_WORDS_PER_LED;
+    }
+}
+
+/**
+ * ws2812_encode_runs()
+ *
+ * For frames made of long runs of one color (fills, bars, backgrounds): each run is
+ * encoded once into a cached pattern and the pattern is copied for the rest of the
+ * run, so the output buffer is only ever written, never read back. Not part of the
+ * implementation table; it is slower than the others on frames without runs
+ */
+void ws2812_encode_runs(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n) {
+    // function setup
+    uint32_t pattern[WS2812_WORDS_PER_LED];
+    size_t i = 0;
+
+    while (i < n) {
+        ws2812_encode_lut(enc, pattern, &leds[i], 1);
+        do {
+            memcpy(out, pattern, sizeof(pattern));
+            out += WS2812_WORDS_PER_LED;
+            ++i;
+        } while (i < n && !memcmp(&leds[i], &leds[i - 1], sizeof(led_t)));
+    }
+}
+
+/**
+ * ws2812_encode_indexed()
+ *
+ * Palette-indexed frames; the palette is encoded once (with ws2812_encode()) and
+ * each LED is a copy of its palette entry's words
+ */
+void ws2812_encode_indexed(const ws2812_encoded_led_t *palette, uint32_t *out, const uint8_t *indices, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(out, palette[indices[i]], sizeof(palette[0]));
+        out += WS2812_WORDS_PER_LED;
+    }
+}
+
+/**
+ * ws2812_encode_remap()
+ *
+ * For LEDs wired in a different order than the frame (serpentine or tiled
+ * matrices): output LED i shows leds[map[i]]. A block of LEDs at a time is gathered
+ * into a buffer that stays in L1 and encoded with the selected implementation, so
+ * the remap rides along with the encode instead of costing a pass over the frame
+ */
+void ws2812_encode_remap(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, const uint16_t *map,
+    size_t n) {
+    // function setup
+    led_t block[REMAP_BLOCK_LEDS];
+    size_t count;
+
+    for (size_t i = 0; i < n; i += count) {
+        count = n - i < REMAP_BLOCK_LEDS ? n - i : REMAP_BLOCK_LEDS;
+        for (size_t j = 0; j < count; ++j) {
+            block[j] = leds[map[i + j]];
+        }
+        ws2812_encode(enc, out, block, count);
+        out += count * WS2812_WORDS_PER_LED;
+    }
+}
+
+/**************************************************************************************
+ * TRANSPOSE IMPLEMENTATIONS
+ **************************************************************************************/
+
+/**
+ * ws2812_transpose_scalar()
+ *
+ * Reference multi-strip transpose; one strip, one bit at a time. All other
+ * transpose implementations must produce exactly the same words as this one
+ */
+void ws2812_transpose_scalar(uint32_t *out, const led_t *leds, size_t stride, unsigned int strips, size_t n,
+    unsigned int shift) {
+    // function setup
+    uint8_t grb[WS2812_BYTES_PER_LED];
+    uint32_t *word;
+
+    memset(out, 0, n * WS2812_WORDS_PER_LED * sizeof(*out));
+    for (unsigned int s = 0; s < strips; ++s) {
+        word = out;
+        for (size_t i = 0; i < n; ++i) {
+            grb[0] = leds[s * stride + i].green;
+            grb[1] = leds[s * stride + i].red;
+            grb[2] = leds[s * stride + i].blue;
+            for (int byte = 0; byte < WS2812_BYTES_PER_LED; ++byte) {
+                for (int bit = WS2812_BITS_PER_BYTE - 1; bit >= 0; --bit) {
+                    if (!(grb[byte] & (1 << bit))) {
+                        *word |= 1u << (shift + s);
+                    }
+                    ++word;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * transpose8()
+ *
+ * Transpose an 8x8 bit matrix held one row per byte: afterwards byte c holds bit c
+ * of every input byte. Three delta swaps exchange 1x1, 2x2 and 4x4 blocks across
+ * the diagonal (Hacker's Delight, 7-3)
+ */
+static inline uint64_t transpose8(uint64_t x) {
+    // function setup
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+/**
+ * transpose_byte()
+ *
+ * Bit-slice one color byte of up to 16 strips (lo: strips 0-7, hi: strips 8-15,
+ * one byte per strip) into 8 clear words, MSB first
+ */
+static inline void transpose_byte(uint32_t *out, uint64_t lo, uint64_t hi, uint32_t mask, unsigned int shift) {
+    // function setup
+    uint32_t ones;
+
+    lo = transpose8(lo);
+    hi = transpose8(hi);
+    for (int bit = 0; bit < WS2812_BITS_PER_BYTE; ++bit) {
+        ones = (uint32_t)((lo >> (8 * (7 - bit))) & 0xFF) | (uint32_t)((hi >> (8 * (7 - bit))) & 0xFF) << 8;
+        out[bit] = (~ones & mask) << shift;
+    }
+}
+
+/**
+ * ws2812_transpose_swar()
+ *
+ * Portable fast path, and the one the kernel uses: gathers one color byte of every
+ * strip into a 64-bit word per 8 strips and transposes them in-register, so each
+ * color byte costs two 8x8 transposes instead of strips * 8 bit tests. Needs no
+ * FPU/NEON context, so the render path can call it without kernel_neon_begin()
+ */
+void ws2812_transpose_swar(uint32_t *out, const led_t *leds, size_t stride, unsigned int strips, size_t n,
+    unsigned int shift) {
+    // function setup
+    const uint32_t mask = (1u << strips) - 1;
+    uint64_t g[2], r[2], b[2];
+    const led_t *led;
+
+    for (size_t i = 0; i < n; ++i) {
+        g[0] = g[1] = r[0] = r[1] = b[0] = b[1] = 0;
+        for (unsigned int s = 0; s < strips; ++s) {
+            led = &leds[s * stride + i];
+            g[s >> 3] |= (uint64_t)led->green << (8 * (s & 7));
+            r[s >> 3] |= (uint64_t)led->red << (8 * (s & 7));
+            b[s >> 3] |= (uint64_t)led->blue << (8 * (s & 7));
+        }
+        transpose_byte(out + 0, g[0], g[1], mask, shift);
+        transpose_byte(out + 8, r[0], r[1], mask, shift);
+        transpose_byte(out + 16, b[0], b[1], mask, shift);
+        out += WS2812_WORDS_PER_LED;
+    }
+}
+
+#if defined(__KERNEL__) && defined(WS2812_ENCODE_HAVE_NEON)
+/**
+ * ws2812_encode_neon_kernel()
+ *
+ * The NEON object can only run between kernel_neon_begin()/kernel_neon_end(), so
+ * the kernel dispatches through this wrapper instead
+ */
+static void ws2812_encode_neon_kernel(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n) {
+    kernel_neon_begin();
+    ws2812_encode_neon(enc, out, leds, n);
+    kernel_neon_end();
+}
+
+static bool ws2812_encode_neon_usable(void) {
+#ifdef CONFIG_ARM
+    return cpu_has_neon();
+#else
+    return true;
+#endif
+}
+#endif
+
+/**************************************************************************************
+ * IMPLEMENTATION TABLE
+ **************************************************************************************/
+const struct ws2812_encode_impl ws2812_encode_impls[] = {
+    { .name = "scalar", .encode = ws2812_encode_scalar },
+    { .name = "lut", .encode = ws2812_encode_lut },
+#ifdef WS2812_ENCODE_HAVE_NEON
+#ifdef __KERNEL__
+    { .name = "neon", .encode = ws2812_encode_neon_kernel, .usable = ws2812_encode_neon_usable },
+#else
+    { .name = "neon", .encode = ws2812_encode_neon },
+#endif
+#endif
+#ifdef WS2812_ENCODE_HAVE_SSE2
+    { .name = "sse2", .encode = ws2812_encode_sse2 },
+#endif
+#ifdef WS2812_ENCODE_HAVE_AVX2
+    { .name = "avx2", .encode = ws2812_encode_avx2, .usable = ws2812_encode_avx2_usable },
+#endif
+    { .name = NULL },
+};
+
+const struct ws2812_transpose_impl ws2812_transpose_impls[] = {
+    { .name = "scalar", .transpose = ws2812_transpose_scalar },
+    { .name = "swar", .transpose = ws2812_transpose_swar },
+#ifdef WS2812_ENCODE_HAVE_SSE2
+    { .name = "sse2", .transpose = ws2812_transpose_sse2 },
+#endif
+    { .name = NULL },
+};
+
+/**
+ * ws2812_encode_impl_usable()
+ *
+ * Check whether an implementation can run on this CPU
+ */
+bool ws2812_encode_impl_usable(const struct ws2812_encode_impl *impl) {
+    return !impl->usable || impl->usable();
+}
+
+/**
+ * now_ns()
+ *
+ * Monotonic timestamp in nanoseconds
+ */
+static uint64_t now_ns(void) {
+#ifdef __KERNEL__
+    return ktime_get_ns();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * calibrate()
+ *
+ * Time an implementation on the calibration workload; best of CALIBRATE_RUNS
+ */
+static uint64_t calibrate(const struct ws2812_encoder *enc, ws2812_encode_fn encode) {
+    // function setup
+    uint64_t best = ~0ull;
+    uint64_t start, elapsed;
+
+    for (int run = 0; run < CALIBRATE_RUNS; ++run) {
+        start = now_ns();
+        for (int i = 0; i < CALIBRATE_ENCODES; ++i) {
+            encode(enc, calibrate_out, calibrate_leds, CALIBRATE_LEDS);
+        }
+        elapsed = now_ns() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * encoder_select()
+ *
+ * Pick the implementation to use. Which one wins depends on the core (the lookup
+ * table is hard to beat on big x86 cores with fast L1), so like the kernel's
+ * xor/raid6 code every usable implementation is timed once and the fastest is kept
+ */
+static void encoder_select(struct ws2812_encoder *enc) {
+    // function setup
+    const struct ws2812_encode_impl *impl;
+    uint64_t elapsed, best = ~0ull;
+
+    // mixed pattern, so no implementation gets a branch-prediction advantage
+    for (int i = 0; i < CALIBRATE_LEDS; ++i) {
+        calibrate_leds[i].red = (uint8_t)(i * 37);
+        calibrate_leds[i].green = (uint8_t)(i * 91 + 7);
+        calibrate_leds[i].blue = (uint8_t)(i * 53 + 101);
+    }
+
+    enc->encode = ws2812_encode_lut;
+    enc->name = "lut";
+    for (impl = &ws2812_encode_impls[0]; impl->name; ++impl) {
+        if (!ws2812_encode_impl_usable(impl)) {
+            continue;
+        }
+        elapsed = calibrate(enc, impl->encode);
+        if (elapsed < best) {
+            best = elapsed;
+            enc->encode = impl->encode;
+            enc->name = impl->name;
+        }
+    }
+}
+
+/**
+ * fill_table()
+ *
+ * Build the lookup table for the current bit words into enc->table, row v holding
+ * the bits of value[v], MSB first
+ */
+static void fill_table(struct ws2812_encoder *enc, const uint8_t *value) {
+    for (int v = 0; v < 256; ++v) {
+        for (int bit = 0; bit < WS2812_BITS_PER_BYTE; ++bit) {
+            enc->table[v][bit] = ((value ? value[v] : v) & (0x80 >> bit)) ? enc->t1h : enc->t0h;
+        }
+    }
+    enc->lut = enc->table;
+}
+
+/**
+ * ws2812_encoder_init()
+ *
+ * Build the lookup table for the given bit words and pick the implementation to use
+ */
+void ws2812_encoder_init(struct ws2812_encoder *enc, uint32_t t0h, uint32_t t1h) {
+    enc->t0h = t0h;
+    enc->t1h = t1h;
+    fill_table(enc, NULL);
+    encoder_select(enc);
+}
+
+/**
+ * ws2812_encoder_init_lut()
+ *
+ * Use a lookup table generated at build time (ws2812_tables.h) instead of building
+ * one; the bit words are read back from it, so they always agree
+ */
+void ws2812_encoder_init_lut(struct ws2812_encoder *enc, const uint32_t (*lut)[WS2812_BITS_PER_BYTE]) {
+    enc->t0h = lut[0x00][0];
+    enc->t1h = lut[0xff][0];
+    enc->lut = lut;
+    encoder_select(enc);
+}
+
+/**
+ * ws2812_encoder_set_gamma()
+ *
+ * Fold a gamma curve into the lookup table, so every byte is corrected as it is
+ * encoded at no extra cost. Only the lookup table implementation (and the run and
+ * remap encoders built on it) read the table, so it is selected from here on
+ */
+void ws2812_encoder_set_gamma(struct ws2812_encoder *enc, const uint8_t *gamma) {
+    fill_table(enc, gamma);
+    enc->encode = ws2812_encode_lut;
+    enc->name = "lut";
+}
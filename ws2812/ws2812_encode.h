@@ -0,0 +1,199 @@
+#ifndef _WS2812_ENCODE_H_
+#define _WS2812_ENCODE_H_
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stddef.h> // size_t
+#include <stdint.h> // uintx_t
+#include <stdbool.h>
+#endif
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+/**
+ * WS2812 ENCODING
+ *
+ * The PWM runs in M/S mode with RNG1 = WS2812_TICKS_PER_BIT, so every word pushed into
+ * the FIFO is one WS2812 data bit: the value of the word is the number of ticks the
+ * line is held HIGH before dropping LOW for the rest of the bit period.
+ *
+ * Each LED is 24 bits sent in G, R, B order (MSB first), so each LED expands into 24
+ * FIFO words. At 12.5ns/tick:
+ *
+ *      T0H = 0.40us = 32 ticks
+ *      T1H = 0.80us = 64 ticks
+ */
+#define WS2812_TICKS_PER_BIT                100
+#define WS2812_T0H_TICKS                    32
+#define WS2812_T1H_TICKS                    64
+
+#define WS2812_BITS_PER_BYTE                8
+#define WS2812_BYTES_PER_LED                3
+#define WS2812_WORDS_PER_LED                (WS2812_BYTES_PER_LED * WS2812_BITS_PER_BYTE)
+
+// parallel output; strips per bit-sliced GPIO word
+#define WS2812_MAX_STRIPS                   16
+
+// the NEON encoder is built as its own object with NEON enabled
+#ifdef __KERNEL__
+    #ifdef CONFIG_KERNEL_MODE_NEON
+        #define WS2812_ENCODE_HAVE_NEON     1
+    #endif
+#else
+    #if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        #define WS2812_ENCODE_HAVE_NEON     1
+    #endif
+    // x86 variants only exist for host builds; AVX2 is picked at runtime
+    #if defined(__SSE2__)
+        #define WS2812_ENCODE_HAVE_SSE2     1
+    #endif
+    #if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+        #define WS2812_ENCODE_HAVE_AVX2     1
+    #endif
+#endif
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+/**
+ * led_t
+ *
+ * Defines an LED struct representing a single RGB led
+ */
+typedef struct led {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} led_t;
+
+/**
+ * ws2812_encoded_led_t
+ *
+ * The PWM words for one LED; used for pre-encoded palettes
+ */
+typedef uint32_t ws2812_encoded_led_t[WS2812_WORDS_PER_LED];
+
+/**
+ * ws2812_encode_fn
+ *
+ * Signature shared by every encoder implementation; expands n LEDs into
+ * n * WS2812_WORDS_PER_LED PWM words at out
+ */
+struct ws2812_encoder;
+typedef void (*ws2812_encode_fn)(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n);
+
+/**
+ * struct ws2812_encoder
+ *
+ * Holds the PWM words for a 0 and a 1 bit, the byte -> 8 word lookup table for
+ * them, and the implementation picked for this CPU. The table is either a const one
+ * generated at build time (ws2812_encoder_init_lut()) or built into table
+ */
+struct ws2812_encoder {
+    // lookup table in use; one row of 8 PWM words per byte value, MSB first
+    const uint32_t (*lut)[WS2812_BITS_PER_BYTE];
+    uint32_t table[256][WS2812_BITS_PER_BYTE] __attribute__((aligned(64)));
+
+    // PWM words for each bit value
+    uint32_t t0h;
+    uint32_t t1h;
+
+    // selected implementation
+    ws2812_encode_fn encode;
+    const char *name;
+};
+
+/**
+ * struct ws2812_encode_impl
+ *
+ * Names an encoder implementation; used by ws2812_encode_impls[] so benchmarks can
+ * walk every implementation built for this CPU
+ */
+struct ws2812_encode_impl {
+    const char *name;
+    ws2812_encode_fn encode;
+    bool (*usable)(void); // NULL if the implementation runs on any CPU it was built for
+};
+
+/**
+ * ws2812_transpose_fn
+ *
+ * Signature shared by every transpose implementation, for driving several strips
+ * from one GPIO bank. Strip s is the n LEDs at leds[s * stride]; the output is
+ * n * WS2812_WORDS_PER_LED words, one per wire bit, where word j has bit
+ * (shift + s) set if strip s sends a 0 at bit j. That is the GPCLR0 word that
+ * drops those lines a third of the way into the bit
+ */
+typedef void (*ws2812_transpose_fn)(uint32_t *out, const led_t *leds, size_t stride, unsigned int strips, size_t n,
+    unsigned int shift);
+
+/**
+ * struct ws2812_transpose_impl
+ *
+ * Names a transpose implementation; used by ws2812_transpose_impls[]
+ */
+struct ws2812_transpose_impl {
+    const char *name;
+    ws2812_transpose_fn transpose;
+};
+
+/**************************************************************************************
+ * GLOBALS
+ **************************************************************************************/
+// every implementation compiled in, reference first; terminated by a NULL entry
+extern const struct ws2812_encode_impl ws2812_encode_impls[];
+extern const struct ws2812_transpose_impl ws2812_transpose_impls[];
+
+/**************************************************************************************
+ * FUNCTION PROTOTYPES
+ **************************************************************************************/
+// setup
+void ws2812_encoder_init(struct ws2812_encoder *enc, uint32_t t0h, uint32_t t1h);
+void ws2812_encoder_init_lut(struct ws2812_encoder *enc, const uint32_t (*lut)[WS2812_BITS_PER_BYTE]);
+void ws2812_encoder_set_gamma(struct ws2812_encoder *enc, const uint8_t *gamma);
+bool ws2812_encode_impl_usable(const struct ws2812_encode_impl *impl);
+
+// implementations
+void ws2812_encode_scalar(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n);
+void ws2812_encode_lut(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n);
+void ws2812_encode_runs(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n);
+void ws2812_encode_indexed(const ws2812_encoded_led_t *palette, uint32_t *out, const uint8_t *indices, size_t n);
+void ws2812_encode_remap(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, const uint16_t *map,
+    size_t n);
+
+// multi-strip transpose
+void ws2812_transpose_scalar(uint32_t *out, const led_t *leds, size_t stride, unsigned int strips, size_t n,
+    unsigned int shift);
+void ws2812_transpose_swar(uint32_t *out, const led_t *leds, size_t stride, unsigned int strips, size_t n,
+    unsigned int shift);
+#ifdef WS2812_ENCODE_HAVE_SSE2
+void ws2812_transpose_sse2(uint32_t *out, const led_t *leds, size_t stride, unsigned int strips, size_t n,
+    unsigned int shift);
+#endif
+
+#ifdef WS2812_ENCODE_HAVE_NEON
+void ws2812_encode_neon(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n);
+#endif
+#ifdef WS2812_ENCODE_HAVE_SSE2
+void ws2812_encode_sse2(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n);
+#endif
+#ifdef WS2812_ENCODE_HAVE_AVX2
+void ws2812_encode_avx2(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n);
+bool ws2812_encode_avx2_usable(void);
+#endif
+
+/**
+ * ws2812_encode()
+ *
+ * Encode n LEDs with the implementation selected by ws2812_encoder_init()
+ */
+static inline void ws2812_encode(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n) {
+    enc->encode(enc, out, leds, n);
+}
+
+#endif /* _WS2812_ENCODE_H_ */
@@ -0,0 +1,105 @@
+#include "ws2812_encode.h"
+
+#ifdef WS2812_ENCODE_HAVE_NEON
+
+#if defined(__KERNEL__) && defined(CONFIG_ARM64)
+#include <asm/neon-intrinsics.h>
+#else
+#include <arm_neon.h>
+#endif
+
+/**************************************************************************************
+ * HELPER FUNCTIONS
+ **************************************************************************************/
+
+/**
+ * spread_pair()
+ *
+ * Expand a vector holding two bytes, each replicated 8 times, into 16 PWM words.
+ * vtst against the MSB-first bit selectors gives a 0xFF/0x00 mask per bit, which is
+ * sign-extended out to 32 bits and used to pick between the T1H and T0H words
+ */
+static inline void spread_pair(uint32_t *out, uint8x16_t rep, uint8x16_t sel, uint32x4_t t0, uint32x4_t t1) {
+    // function setup
+    int8x16_t mask = vreinterpretq_s8_u8(vtstq_u8(rep, sel));
+    int16x8_t lo = vmovl_s8(vget_low_s8(mask));
+    int16x8_t hi = vmovl_s8(vget_high_s8(mask));
+
+    // widen masks and select
+    vst1q_u32(out + 0, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(lo))), t1, t0));
+    vst1q_u32(out + 4, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(lo))), t1, t0));
+    vst1q_u32(out + 8, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(hi))), t1, t0));
+    vst1q_u32(out + 12, vbslq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(hi))), t1, t0));
+}
+
+/**
+ * spread_bytes()
+ *
+ * Expand 16 consecutive color bytes into 128 PWM words. Three rounds of zipping a
+ * vector with itself replicate every byte 8 times, two bytes per vector, in order
+ */
+static inline void spread_bytes(uint32_t *out, uint8x16_t v, uint8x16_t sel, uint32x4_t t0, uint32x4_t t1) {
+    // function setup
+    uint8x16x2_t x2 = vzipq_u8(v, v);                       // b0 b0 b1 b1 ...
+    uint8x16x2_t x4lo = vzipq_u8(x2.val[0], x2.val[0]);     // b0 x4 ... b7 x4
+    uint8x16x2_t x4hi = vzipq_u8(x2.val[1], x2.val[1]);     // b8 x4 ... b15 x4
+    uint8x16x2_t x8;
+
+    x8 = vzipq_u8(x4lo.val[0], x4lo.val[0]);
+    spread_pair(out + 0, x8.val[0], sel, t0, t1);
+    spread_pair(out + 16, x8.val[1], sel, t0, t1);
+    x8 = vzipq_u8(x4lo.val[1], x4lo.val[1]);
+    spread_pair(out + 32, x8.val[0], sel, t0, t1);
+    spread_pair(out + 48, x8.val[1], sel, t0, t1);
+    x8 = vzipq_u8(x4hi.val[0], x4hi.val[0]);
+    spread_pair(out + 64, x8.val[0], sel, t0, t1);
+    spread_pair(out + 80, x8.val[1], sel, t0, t1);
+    x8 = vzipq_u8(x4hi.val[1], x4hi.val[1]);
+    spread_pair(out + 96, x8.val[0], sel, t0, t1);
+    spread_pair(out + 112, x8.val[1], sel, t0, t1);
+}
+
+/**************************************************************************************
+ * ENCODER IMPLEMENTATION
+ **************************************************************************************/
+
+/**
+ * ws2812_encode_neon()
+ *
+ * NEON encoder; handles 16 LEDs (48 bytes, 384 words) per iteration. vld3 splits the
+ * LEDs into red/green/blue planes, and vst3 re-interleaves them in wire (GRB) order
+ * before the bytes are spread. Leftover LEDs go through the lookup table
+ */
+void ws2812_encode_neon(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n) {
+    // function setup
+    static const uint8_t bit_select[16] = {
+        0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    };
+    const uint8x16_t sel = vld1q_u8(bit_select);
+    const uint32x4_t t0 = vdupq_n_u32(enc->t0h);
+    const uint32x4_t t1 = vdupq_n_u32(enc->t1h);
+    uint8_t grb_bytes[16 * WS2812_BYTES_PER_LED] __attribute__((aligned(16)));
+    uint8x16x3_t rgb, grb;
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        // swap red and green planes into wire order
+        rgb = vld3q_u8((const uint8_t *)&leds[i]);
+        grb.val[0] = rgb.val[1];
+        grb.val[1] = rgb.val[0];
+        grb.val[2] = rgb.val[2];
+        vst3q_u8(grb_bytes, grb);
+
+        // spread 48 bytes
+        spread_bytes(out + 0, vld1q_u8(grb_bytes + 0), sel, t0, t1);
+        spread_bytes(out + 128, vld1q_u8(grb_bytes + 16), sel, t0, t1);
+        spread_bytes(out + 256, vld1q_u8(grb_bytes + 32), sel, t0, t1);
+        out += 16 * WS2812_WORDS_PER_LED;
+    }
+
+    // tail
+    ws2812_encode_lut(enc, out, leds + i, n - i);
+}
+
+#endif /* WS2812_ENCODE_HAVE_NEON */
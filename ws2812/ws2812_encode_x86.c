@@ -0,0 +1,184 @@
+#include "ws2812_encode.h"
+
+/**
+ * x86 encoders
+ *
+ * These never run on the Pi; they let the encoder benchmark and the waveform tools
+ * exercise a vectorized path on x86 build hosts. SSE2 is part of the x86-64 baseline,
+ * AVX2 is compiled with a target attribute and picked at runtime
+ */
+#if defined(WS2812_ENCODE_HAVE_SSE2) || defined(WS2812_ENCODE_HAVE_AVX2)
+
+#include <immintrin.h>
+
+/**************************************************************************************
+ * HELPER FUNCTIONS
+ **************************************************************************************/
+
+#ifdef WS2812_ENCODE_HAVE_SSE2
+/**
+ * reorder_grb()
+ *
+ * Copy n LEDs into a flat byte array in wire (GRB) order
+ */
+static inline void reorder_grb(uint8_t *grb, const led_t *leds, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        grb[3 * i + 0] = leds[i].green;
+        grb[3 * i + 1] = leds[i].red;
+        grb[3 * i + 2] = leds[i].blue;
+    }
+}
+
+/**
+ * spread_pair_sse2()
+ *
+ * Expand a vector holding two bytes, each replicated 8 times, into 16 PWM words
+ */
+static inline void spread_pair_sse2(uint32_t *out, __m128i rep, __m128i sel, __m128i t0, __m128i diff) {
+    // function setup
+    __m128i mask = _mm_cmpeq_epi8(_mm_and_si128(rep, sel), sel);
+    __m128i lo = _mm_unpacklo_epi8(mask, mask);
+    __m128i hi = _mm_unpackhi_epi8(mask, mask);
+
+    // widen masks and select; t0 ^ ((t0 ^ t1) & mask) picks t1 where the bit is set
+    _mm_storeu_si128((__m128i *)(out + 0), _mm_xor_si128(t0, _mm_and_si128(diff, _mm_unpacklo_epi16(lo, lo))));
+    _mm_storeu_si128((__m128i *)(out + 4), _mm_xor_si128(t0, _mm_and_si128(diff, _mm_unpackhi_epi16(lo, lo))));
+    _mm_storeu_si128((__m128i *)(out + 8), _mm_xor_si128(t0, _mm_and_si128(diff, _mm_unpacklo_epi16(hi, hi))));
+    _mm_storeu_si128((__m128i *)(out + 12), _mm_xor_si128(t0, _mm_and_si128(diff, _mm_unpackhi_epi16(hi, hi))));
+}
+
+/**
+ * spread_bytes_sse2()
+ *
+ * Expand 16 consecutive color bytes into 128 PWM words
+ */
+static inline void spread_bytes_sse2(uint32_t *out, __m128i v, __m128i sel, __m128i t0, __m128i diff) {
+    // function setup
+    __m128i x2lo = _mm_unpacklo_epi8(v, v);
+    __m128i x2hi = _mm_unpackhi_epi8(v, v);
+    __m128i x4;
+
+    x4 = _mm_unpacklo_epi8(x2lo, x2lo);
+    spread_pair_sse2(out + 0, _mm_unpacklo_epi8(x4, x4), sel, t0, diff);
+    spread_pair_sse2(out + 16, _mm_unpackhi_epi8(x4, x4), sel, t0, diff);
+    x4 = _mm_unpackhi_epi8(x2lo, x2lo);
+    spread_pair_sse2(out + 32, _mm_unpacklo_epi8(x4, x4), sel, t0, diff);
+    spread_pair_sse2(out + 48, _mm_unpackhi_epi8(x4, x4), sel, t0, diff);
+    x4 = _mm_unpacklo_epi8(x2hi, x2hi);
+    spread_pair_sse2(out + 64, _mm_unpacklo_epi8(x4, x4), sel, t0, diff);
+    spread_pair_sse2(out + 80, _mm_unpackhi_epi8(x4, x4), sel, t0, diff);
+    x4 = _mm_unpackhi_epi8(x2hi, x2hi);
+    spread_pair_sse2(out + 96, _mm_unpacklo_epi8(x4, x4), sel, t0, diff);
+    spread_pair_sse2(out + 112, _mm_unpackhi_epi8(x4, x4), sel, t0, diff);
+}
+#endif
+
+/**************************************************************************************
+ * ENCODER IMPLEMENTATIONS
+ **************************************************************************************/
+
+#ifdef WS2812_ENCODE_HAVE_SSE2
+/**
+ * ws2812_encode_sse2()
+ *
+ * SSE2 encoder; same byte replication scheme as the NEON encoder, 16 LEDs per
+ * iteration. SSE2 has no byte shuffle, so the GRB reorder is done in scalar code
+ */
+void ws2812_encode_sse2(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n) {
+    // function setup
+    const __m128i sel = _mm_set_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80
+    );
+    const __m128i t0 = _mm_set1_epi32((int)enc->t0h);
+    const __m128i diff = _mm_set1_epi32((int)(enc->t0h ^ enc->t1h));
+    uint8_t grb[16 * WS2812_BYTES_PER_LED] __attribute__((aligned(16)));
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        reorder_grb(grb, &leds[i], 16);
+        spread_bytes_sse2(out + 0, _mm_load_si128((const __m128i *)(grb + 0)), sel, t0, diff);
+        spread_bytes_sse2(out + 128, _mm_load_si128((const __m128i *)(grb + 16)), sel, t0, diff);
+        spread_bytes_sse2(out + 256, _mm_load_si128((const __m128i *)(grb + 32)), sel, t0, diff);
+        out += 16 * WS2812_WORDS_PER_LED;
+    }
+
+    // tail
+    ws2812_encode_lut(enc, out, leds + i, n - i);
+}
+
+/**
+ * ws2812_transpose_sse2()
+ *
+ * SSE2 multi-strip transpose: one color byte of each strip per vector lane.
+ * movemask collects the top bit of all 16 lanes at once and adding the vector to
+ * itself moves the next bit up, so each color byte is 8 movemask/add pairs
+ */
+void ws2812_transpose_sse2(uint32_t *out, const led_t *leds, size_t stride, unsigned int strips, size_t n,
+    unsigned int shift) {
+    // function setup
+    const uint32_t mask = (1u << strips) - 1;
+    uint8_t grb[WS2812_BYTES_PER_LED][16] __attribute__((aligned(16))) = { { 0 } };
+    __m128i v;
+
+    for (size_t i = 0; i < n; ++i) {
+        for (unsigned int s = 0; s < strips; ++s) {
+            grb[0][s] = leds[s * stride + i].green;
+            grb[1][s] = leds[s * stride + i].red;
+            grb[2][s] = leds[s * stride + i].blue;
+        }
+        for (int byte = 0; byte < WS2812_BYTES_PER_LED; ++byte) {
+            v = _mm_load_si128((const __m128i *)grb[byte]);
+            for (int bit = 0; bit < WS2812_BITS_PER_BYTE; ++bit) {
+                *out++ = (~(uint32_t)_mm_movemask_epi8(v) & mask) << shift;
+                v = _mm_add_epi8(v, v);
+            }
+        }
+    }
+}
+#endif
+
+#ifdef WS2812_ENCODE_HAVE_AVX2
+/**
+ * spread_byte_avx2()
+ *
+ * Broadcast one color byte across eight 32-bit lanes, test one bit per lane and
+ * blend, so each byte becomes a single 256-bit store
+ */
+__attribute__((target("avx2")))
+static inline void spread_byte_avx2(uint32_t *out, uint8_t byte, __m256i sel, __m256i t0, __m256i t1) {
+    __m256i bits = _mm256_and_si256(_mm256_set1_epi32(byte), sel);
+    _mm256_storeu_si256((__m256i *)out, _mm256_blendv_epi8(t0, t1, _mm256_cmpeq_epi32(bits, sel)));
+}
+
+/**
+ * ws2812_encode_avx2()
+ *
+ * AVX2 encoder; one 256-bit store per color byte, so no reorder pass is needed
+ */
+__attribute__((target("avx2")))
+void ws2812_encode_avx2(const struct ws2812_encoder *enc, uint32_t *out, const led_t *leds, size_t n) {
+    // function setup
+    const __m256i sel = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m256i t0 = _mm256_set1_epi32((int)enc->t0h);
+    const __m256i t1 = _mm256_set1_epi32((int)enc->t1h);
+
+    for (size_t i = 0; i < n; ++i) {
+        spread_byte_avx2(out + 0, leds[i].green, sel, t0, t1);
+        spread_byte_avx2(out + 8, leds[i].red, sel, t0, t1);
+        spread_byte_avx2(out + 16, leds[i].blue, sel, t0, t1);
+        out += WS2812_WORDS_PER_LED;
+    }
+}
+
+/**
+ * ws2812_encode_avx2_usable()
+ *
+ * Check the running CPU for AVX2
+ */
+bool ws2812_encode_avx2_usable(void) {
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#endif /* WS2812_ENCODE_HAVE_SSE2 || WS2812_ENCODE_HAVE_AVX2 */
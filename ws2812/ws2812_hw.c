@@ -0,0 +1,301 @@
+#include "ws2812_hw.h"
+
+#ifdef __KERNEL__
+#include <linux/errno.h>
+#include <linux/io.h>
+#include <linux/delay.h>
+#include "log.h"
+#else
+#include <errno.h>
+#include <stdio.h>
+#endif
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+// register accessors; relaxed, so ordering is only what the barriers below ask for
+#ifdef __KERNEL__
+#define hw_read(reg)                        readl_relaxed(reg)
+#define hw_write(reg, val)                  writel_relaxed((val), (reg))
+#define hw_barrier()                        mb()
+#define hw_udelay(us)                       udelay(us)
+#else
+#define hw_read(reg)                        ws2812_hw_trace_read(reg)
+#define hw_write(reg, val)                  ws2812_hw_trace_write((reg), (val))
+#define hw_barrier()                        ws2812_hw_trace_barrier()
+#define hw_udelay(us)                       ws2812_hw_trace_udelay(us)
+#define LOG(fmt, args...)
+#define LOGE(fmt, args...)                  fprintf(stderr, "ws2812 [E]: " fmt "\n", ## args)
+#endif
+
+// register within a mapped block
+#define HW_REG(base, offset)                ((volatile uint32_t *)((volatile char *)(base) + (offset)))
+
+// how many times to poll CM BUSY before giving up
+#define HW_BUSY_TIMEOUT                     100000
+
+// settle time after PWM reconfiguration, in microseconds
+#define HW_SETTLE_US                        10
+
+/**************************************************************************************
+ * CM HELPERS
+ **************************************************************************************/
+
+/**
+ * cm_write_pwmctl()
+ *
+ * Write the shadowed PWMCTL; the CM only accepts writes carrying its password
+ */
+static void cm_write_pwmctl(struct ws2812_hw *hw, uint32_t ctl) {
+    hw->cm_pwmctl = ctl & ~(CM_PASSWD_MASK | CM_PWMCTL_BUSY_MASK);
+    hw_write(HW_REG(hw->cm, CM_PWMCTL_OFFSET), CM_PASSWD | hw->cm_pwmctl);
+}
+
+/**
+ * cm_wait_busy()
+ *
+ * Poll BUSY until it follows ENAB; the only register read on the configuration path
+ */
+static int cm_wait_busy(struct ws2812_hw *hw, bool busy) {
+    // function setup
+    volatile uint32_t *cm_pwmctl = HW_REG(hw->cm, CM_PWMCTL_OFFSET);
+    int timeout = HW_BUSY_TIMEOUT;
+
+    while ((!!(hw_read(cm_pwmctl) & CM_PWMCTL_BUSY_MASK) != busy) && --timeout);
+    if (timeout == 0) {
+        LOGE("- CM BUSY flag never goes %s.", busy ? "high" : "low");
+        return -ETIMEDOUT;
+    }
+    return 0;
+}
+
+/**************************************************************************************
+ * SETUP
+ **************************************************************************************/
+
+/**
+ * ws2812_hw_init()
+ *
+ * Take over the mapped register blocks and load the PWM and CM shadows; this is the
+ * only time their control registers are read. GPFSEL registers are loaded on first use
+ */
+void ws2812_hw_init(struct ws2812_hw *hw, volatile uint32_t *gpio, volatile uint32_t *pwm, volatile uint32_t *cm) {
+    hw->gpio = gpio;
+    hw->pwm = pwm;
+    hw->cm = cm;
+    hw->gpfsel_valid = 0;
+
+    hw->pwm_ctl = hw_read(HW_REG(pwm, PWM_CTL_OFFSET));
+    hw->pwm_dmac = hw_read(HW_REG(pwm, PWM_DMAC_OFFSET));
+    hw->pwm_rng1 = hw_read(HW_REG(pwm, PWM_RNG1_OFFSET));
+    hw->pwm_dat1 = hw_read(HW_REG(pwm, PWM_DAT1_OFFSET));
+    hw->cm_pwmctl = hw_read(HW_REG(cm, CM_PWMCTL_OFFSET)) & ~(CM_PASSWD_MASK | CM_PWMCTL_BUSY_MASK);
+    hw->cm_pwmdiv = hw_read(HW_REG(cm, CM_PWMDIV_OFFSET)) & CM_PWMDIV_MASK;
+}
+
+/**************************************************************************************
+ * GPIO
+ **************************************************************************************/
+
+/**
+ * ws2812_hw_gpio_configure()
+ *
+ * Set a pin's function in its GPFSEL register
+ */
+int ws2812_hw_gpio_configure(struct ws2812_hw *hw, unsigned int pin, gpfsel_mode_t mode) {
+    // function setup
+    unsigned int n = pin / 10;
+    volatile uint32_t *gpio_gpfseln;
+
+    // check that pins are within bounds
+    if (n >= GPIO_GPFSEL_COUNT) {
+        LOGE("Error; cannot use GPIO pin %u", pin);
+        return -EINVAL;
+    }
+    gpio_gpfseln = HW_REG(hw->gpio, GPIO_GPFSEL0_OFFSET + n * sizeof(uint32_t));
+
+    // other pins in the register belong to other drivers; load it once
+    if (!(hw->gpfsel_valid & (1u << n))) {
+        hw->gpfsel[n] = hw_read(gpio_gpfseln);
+        hw->gpfsel_valid |= 1u << n;
+    }
+
+    hw->gpfsel[n] = (hw->gpfsel[n] & ~GPIO_GPFSEL_MASK(pin)) | GPIO_GPFSEL(pin, mode);
+    hw_write(gpio_gpfseln, hw->gpfsel[n]);
+    LOG("+ GPIO_GPFSEL%u: 0x%08X", n, hw->gpfsel[n]);
+    return 0;
+}
+
+/**
+ * ws2812_hw_gpio_set()
+ *
+ * Set a GPIO pin; GPSET is write-1-to-set, so no read is needed
+ */
+int ws2812_hw_gpio_set(struct ws2812_hw *hw, unsigned int pin) {
+    if (pin / 10 >= GPIO_GPFSEL_COUNT) {
+        LOGE("Error; cannot use GPIO pin %u", pin);
+        return -EINVAL;
+    }
+
+    hw_write(HW_REG(hw->gpio, pin < 32 ? GPIO_GPSET0_OFFSET : GPIO_GPSET1_OFFSET), GPIO_GPSETN(pin % 32));
+    return 0;
+}
+
+/**
+ * ws2812_hw_gpio_clear()
+ *
+ * Clear a GPIO pin; GPCLR is write-1-to-clear, so no read is needed
+ */
+int ws2812_hw_gpio_clear(struct ws2812_hw *hw, unsigned int pin) {
+    if (pin / 10 >= GPIO_GPFSEL_COUNT) {
+        LOGE("Error; cannot use GPIO pin %u", pin);
+        return -EINVAL;
+    }
+
+    hw_write(HW_REG(hw->gpio, pin < 32 ? GPIO_GPCLR0_OFFSET : GPIO_GPCLR1_OFFSET), GPIO_GPCLRN(pin % 32));
+    return 0;
+}
+
+/**************************************************************************************
+ * CM/PWM
+ **************************************************************************************/
+
+/**
+ * ws2812_hw_cm_configure()
+ *
+ * Stop the PWM clock, set its divider, source and MASH, then start it again. SRC and
+ * MASH must not change while BUSY or together with ENAB, hence the separate writes
+ */
+int ws2812_hw_cm_configure(struct ws2812_hw *hw, pwmctl_src_t src, uint32_t div, pwmctl_mash_t mash) {
+    // function setup
+    uint32_t ctl;
+    int retval;
+
+    // disable clocks and wait until the busy flag is cleared
+    LOG("+ Disabling CM for configuration.");
+    cm_write_pwmctl(hw, hw->cm_pwmctl & ~CM_PWMCTL_ENAB_MASK);
+    cm_wait_busy(hw, false);
+
+    // configure the clock divider
+    hw->cm_pwmdiv = CM_PWMDIV(div);
+    hw_write(HW_REG(hw->cm, CM_PWMDIV_OFFSET), CM_PASSWD | hw->cm_pwmdiv);
+    LOG("+ CM_PWMDIV: 0x%08X", hw->cm_pwmdiv);
+
+    // configure the clock source and MASH in one write
+    ctl = hw->cm_pwmctl & ~(CM_PWMCTL_SRC_MASK | CM_PWMCTL_MASH_MASK);
+    ctl |= CM_PWMCTL_SRC(src) | CM_PWMCTL_MASH(mash);
+    cm_write_pwmctl(hw, ctl);
+    LOG("+ CM_PWMCTL: 0x%08X", hw->cm_pwmctl);
+
+    // enable clocks and wait until the busy flag turns on
+    LOG("+ CM Configuration Complete! Enabling peripheral.");
+    cm_write_pwmctl(hw, ctl | CM_PWMCTL_ENAB(1));
+    retval = cm_wait_busy(hw, true);
+
+    // the PWM must not be touched before its clock is running
+    hw_barrier();
+    return retval;
+}
+
+/**
+ * ws2812_hw_pwm_configure()
+ *
+ * Put channel 1 in FIFO-fed M/S mode with DMA requests on, idling LOW (the WS2812
+ * latch level) if the FIFO runs dry. Stopping the channel and setting up CTL is a
+ * single write
+ */
+void ws2812_hw_pwm_configure(struct ws2812_hw *hw, uint32_t range, uint32_t data) {
+    // function setup
+    volatile uint32_t *pwm_ctl = HW_REG(hw->pwm, PWM_CTL_OFFSET);
+
+    // disable PWM and configure the CTL register
+    LOG("+ Configuring CTL register with the channel disabled.");
+    hw->pwm_ctl &= ~(PWM_CTL_PWEN1_MASK | PWM_CTL_MODE1_MASK | PWM_CTL_SBIT1_MASK);
+    hw->pwm_ctl |= PWM_CTL_USEF1(1) | PWM_CTL_MSEN1(1);
+    hw_write(pwm_ctl, hw->pwm_ctl);
+    hw_udelay(HW_SETTLE_US);
+
+    // enable DMA requests; thresholds keep their current values
+    hw->pwm_dmac |= PWM_DMAC_ENAB(1);
+    hw_write(HW_REG(hw->pwm, PWM_DMAC_OFFSET), hw->pwm_dmac);
+
+    // range (ticks per bit) and the initial duty cycle
+    hw->pwm_rng1 = PWM_RNG1(range);
+    hw_write(HW_REG(hw->pwm, PWM_RNG1_OFFSET), hw->pwm_rng1);
+    hw->pwm_dat1 = PWM_DAT1(data);
+    hw_write(HW_REG(hw->pwm, PWM_DAT1_OFFSET), hw->pwm_dat1);
+    hw_udelay(HW_SETTLE_US);
+    LOG("+ PWM_CTL: 0x%08X, PWM_DMAC: 0x%08X, PWM_RNG1: %u, PWM_DAT1: %u",
+        hw->pwm_ctl, hw->pwm_dmac, hw->pwm_rng1, hw->pwm_dat1);
+
+    // configuration complete; enable PWM
+    LOG("+ PWM Configuration Complete! Enabling peripheral.");
+    hw->pwm_ctl |= PWM_CTL_PWEN1(1);
+    hw_write(pwm_ctl, hw->pwm_ctl);
+}
+
+/**
+ * ws2812_hw_pwm_setduty()
+ *
+ * Change the DAT1 duty cycle; the PWM picks it up at the end of the current period,
+ * so the channel keeps running. Only used when the FIFO is not feeding the PWM
+ */
+void ws2812_hw_pwm_setduty(struct ws2812_hw *hw, uint32_t duty) {
+    LOG("+ Changing duty cycle to %u", duty);
+    hw->pwm_dat1 = PWM_DAT1(duty);
+    hw_write(HW_REG(hw->pwm, PWM_DAT1_OFFSET), hw->pwm_dat1);
+}
+
+/**
+ * ws2812_hw_pwm_gate()
+ *
+ * Stop the PWM and its clock, or start them again. The line idles LOW (SBIT1) while
+ * stopped. The PWM stops before its clock does and starts after it is running again
+ */
+int ws2812_hw_pwm_gate(struct ws2812_hw *hw, bool gate) {
+    // function setup
+    volatile uint32_t *pwm_ctl = HW_REG(hw->pwm, PWM_CTL_OFFSET);
+    int retval;
+
+    if (gate) {
+        hw->pwm_ctl &= ~PWM_CTL_PWEN1_MASK;
+        hw_write(pwm_ctl, hw->pwm_ctl);
+        hw_barrier();
+        cm_write_pwmctl(hw, hw->cm_pwmctl & ~CM_PWMCTL_ENAB_MASK);
+        return cm_wait_busy(hw, false);
+    }
+
+    cm_write_pwmctl(hw, hw->cm_pwmctl | CM_PWMCTL_ENAB(1));
+    retval = cm_wait_busy(hw, true);
+    hw_barrier();
+    hw->pwm_ctl |= PWM_CTL_PWEN1(1);
+    hw_write(pwm_ctl, hw->pwm_ctl);
+    return retval;
+}
+
+/**
+ * ws2812_hw_pwm_status()
+ *
+ * Read STA and clear the sticky flags it reports, so each call sees only what
+ * happened since the last one
+ */
+uint32_t ws2812_hw_pwm_status(struct ws2812_hw *hw) {
+    // function setup
+    volatile uint32_t *pwm_sta = HW_REG(hw->pwm, PWM_STA_OFFSET);
+    uint32_t sta = hw_read(pwm_sta);
+
+    if (sta & PWM_STA_STICKY_MASK) {
+        hw_write(pwm_sta, sta & PWM_STA_STICKY_MASK);
+    }
+    return sta;
+}
+
+/**
+ * ws2812_hw_pwm_clear_fifo()
+ *
+ * Drop whatever is queued in the FIFO; CLRF1 is single shot, so the shadow keeps it
+ * clear
+ */
+void ws2812_hw_pwm_clear_fifo(struct ws2812_hw *hw) {
+    hw_write(HW_REG(hw->pwm, PWM_CTL_OFFSET), hw->pwm_ctl | PWM_CTL_CLRF1(1));
+}
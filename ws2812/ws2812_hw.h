@@ -0,0 +1,258 @@
+#ifndef _WS2812_HW_H_
+#define _WS2812_HW_H_
+
+/**
+ * ws2812 register access layer
+ *
+ * GPIO, PWM and clock manager (CM) control registers are written through this layer
+ * rather than with `*reg &= ...; *reg |= ...` chains. Every uncached MMIO read costs
+ * a full bus round trip, so the layer keeps a shadow of each control register,
+ * composes the new value in a CPU register and issues one write per register, with
+ * explicit barriers where the order between peripherals matters. Only status bits
+ * (CM BUSY) are read back from hardware.
+ *
+ * Built without __KERNEL__, every access goes through the ws2812_hw_trace_*() hooks
+ * instead, so a host tool can count and check the register traffic (tools/ws2812_hwtrace)
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stddef.h> // size_t
+#include <stdint.h> // uintx_t
+#include <stdbool.h>
+#endif
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+// GPIO ====================================================================================
+// BCM GPIO offsets
+#define GPIO_GPFSEL0_OFFSET                 (0x00000000)
+#define GPIO_GPSET0_OFFSET                  (0x0000001C)
+#define GPIO_GPSET1_OFFSET                  (0x00000020)
+#define GPIO_GPCLR0_OFFSET                  (0x00000028)
+#define GPIO_GPCLR1_OFFSET                  (0x0000002C)
+
+// GPFSELn
+#define GPIO_GPFSEL_SHIFT(pin)              (((pin) % (10)) * (3))
+#define GPIO_GPFSEL_MASK(pin)               ((0x7) << (GPIO_GPFSEL_SHIFT(pin)))
+#define GPIO_GPFSEL_VALUE(pin, mode)        (((mode) & (0x7)) << (GPIO_GPFSEL_SHIFT(pin)))
+#define GPIO_GPFSEL(pin, mode)              ((GPIO_GPFSEL_MASK(pin)) & ((GPIO_GPFSEL_VALUE(pin, mode))))
+
+// BCM GPIO GPSET
+#define GPIO_GPSETN_SHIFT(pin)              (pin)
+#define GPIO_GPSETN_MASK(pin)               ((0x1) << (GPIO_GPSETN_SHIFT(pin)))
+#define GPIO_GPSETN(pin)                    ((0x1) << (pin))
+
+// BCM GPIO GPCLR
+#define GPIO_GPCLRN_SHIFT(pin)              (pin)
+#define GPIO_GPCLRN_MASK(pin)               ((0x1) << (GPIO_GPCLRN_SHIFT(pin)))
+#define GPIO_GPCLRN(pin)                    ((0x1) << (pin))
+
+// PWM =====================================================================================
+// BCM PWM offsets
+#define PWM_CTL_OFFSET                      (0x00000000)
+#define PWM_STA_OFFSET                      (0x00000004)
+#define PWM_DMAC_OFFSET                     (0x00000008)
+#define PWM_RNG1_OFFSET                     (0x00000010)
+#define PWM_DAT1_OFFSET                     (0x00000014)
+#define PWM_FIF1_OFFSET                     (0x00000018)
+
+// BCM PWM CTL
+#define PWM_CTL_PWEN1_SHIFT                 (0)
+#define PWM_CTL_PWEN1_MASK                  ((0x1) << (PWM_CTL_PWEN1_SHIFT))
+#define PWM_CTL_PWEN1(val)                  ((PWM_CTL_PWEN1_MASK) & ((val) << (PWM_CTL_PWEN1_SHIFT)))
+
+#define PWM_CTL_MODE1_SHIFT                 (1)
+#define PWM_CTL_MODE1_MASK                  ((0x1) << (PWM_CTL_MODE1_SHIFT))
+#define PWM_CTL_MODE1(val)                  ((PWM_CTL_MODE1_MASK) & ((val) << (PWM_CTL_MODE1_SHIFT)))
+
+#define PWM_CTL_SBIT1_SHIFT                 (3)
+#define PWM_CTL_SBIT1_MASK                  ((0x1) << (PWM_CTL_SBIT1_SHIFT))
+#define PWM_CTL_SBIT1(val)                  ((PWM_CTL_SBIT1_MASK) & ((val) << (PWM_CTL_SBIT1_SHIFT)))
+
+#define PWM_CTL_CLRF1_SHIFT                 (6)
+#define PWM_CTL_CLRF1_MASK                  ((0x1) << (PWM_CTL_CLRF1_SHIFT))
+#define PWM_CTL_CLRF1(val)                  ((PWM_CTL_CLRF1_MASK) & ((val) << (PWM_CTL_CLRF1_SHIFT)))
+
+#define PWM_CTL_USEF1_SHIFT                 (5)
+#define PWM_CTL_USEF1_MASK                  ((0x1) << (PWM_CTL_USEF1_SHIFT))
+#define PWM_CTL_USEF1(val)                  ((PWM_CTL_USEF1_MASK) & ((val) << (PWM_CTL_USEF1_SHIFT)))
+
+#define PWM_CTL_MSEN1_SHIFT                 (7)
+#define PWM_CTL_MSEN1_MASK                  ((0x1) << (PWM_CTL_MSEN1_SHIFT))
+#define PWM_CTL_MSEN1(val)                  ((PWM_CTL_MSEN1_MASK) & ((val) << (PWM_CTL_MSEN1_SHIFT)))
+
+// BCM PWM STA; the error and gap flags are sticky and cleared by writing 1
+#define PWM_STA_EMPT1_MASK                  ((0x1) << (1))
+#define PWM_STA_WERR1_MASK                  ((0x1) << (2))
+#define PWM_STA_RERR1_MASK                  ((0x1) << (3))
+#define PWM_STA_GAPO1_MASK                  ((0x1) << (4))
+#define PWM_STA_BERR_MASK                   ((0x1) << (8))
+#define PWM_STA_ERRORS_MASK                 (PWM_STA_WERR1_MASK | PWM_STA_RERR1_MASK | PWM_STA_BERR_MASK)
+#define PWM_STA_STICKY_MASK                 (PWM_STA_ERRORS_MASK | PWM_STA_GAPO1_MASK)
+
+// BCM PWM DMAC
+#define PWM_DMAC_ENAB_SHIFT                 (31)
+#define PWM_DMAC_ENAB_MASK                  ((0x1) << (PWM_DMAC_ENAB_SHIFT))
+#define PWM_DMAC_ENAB(val)                  ((PWM_DMAC_ENAB_MASK) & ((val) << (PWM_DMAC_ENAB_SHIFT)))
+
+// BCM PWM RNG1
+#define PWM_RNG1_SHIFT                      (0)
+#define PWM_RNG1_MASK                       ((0xFFFFFFFF) << (PWM_RNG1_SHIFT))
+#define PWM_RNG1(val)                       ((PWM_RNG1_MASK) & ((val) << (PWM_RNG1_SHIFT)))
+
+// BCM PWM DAT1
+#define PWM_DAT1_SHIFT                      (0)
+#define PWM_DAT1_MASK                       ((0xFFFFFFFF) << (PWM_DAT1_SHIFT))
+#define PWM_DAT1(val)                       ((PWM_DAT1_MASK) & ((val) << (PWM_DAT1_SHIFT)))
+
+// BCM PWM FIF1
+#define PWM_FIF1_PWM_FIFO_SHIFT             (0)
+#define PWM_FIF1_PWM_FIFO_MASK              ((0xFFFFFFF) << PWM_FIF1_PWM_FIFO_SHIFT)
+#define PWM_FIF1_PWM_FIFO(val)              ((PWM_FIF1_PWM_FIFO_MASK) & ((val) << (PWM_FIF1_PWM_FIFO_SHIFT)))
+
+// CM =====================================================================================
+// BCM CM constants
+#define CM_PASSWD                           (0x5A000000)
+#define CM_PASSWD_MASK                      (0xFF000000)
+
+// BCM CM offsets
+#define CM_PWMCTL_OFFSET                    (0x000000A0)
+#define CM_PWMDIV_OFFSET                   	(0x000000A4)
+
+// BCM CM PWMCTL_SRC
+#define CM_PWMCTL_SRC_SHIFT                 (0)
+#define CM_PWMCTL_SRC_MASK                  ((0xF) << (CM_PWMCTL_SRC_SHIFT))
+#define CM_PWMCTL_SRC(val)                  ((CM_PWMCTL_SRC_MASK) & ((val) << (CM_PWMCTL_SRC_SHIFT)))
+
+// BCM CM PWMCTL_ENAB
+#define CM_PWMCTL_ENAB_SHIFT                (4)
+#define CM_PWMCTL_ENAB_MASK                 ((0x1) << (CM_PWMCTL_ENAB_SHIFT))
+#define CM_PWMCTL_ENAB(val)                 ((CM_PWMCTL_ENAB_MASK) & ((val) << (CM_PWMCTL_ENAB_SHIFT)))
+
+// BCM CM PWMCTL_BUSY
+#define CM_PWMCTL_BUSY_SHIFT                (7)
+#define CM_PWMCTL_BUSY_MASK                 ((0x1) << (CM_PWMCTL_BUSY_SHIFT))
+#define CM_PWMCTL_BUSY(val)                 ((CM_PWMCTL_BUSY_MASK) & ((val) << (CM_PWMCTL_BUSY_SHIFT)))
+
+// BCM CM PWMCTL_MASH
+#define CM_PWMCTL_MASH_SHIFT                (9)
+#define CM_PWMCTL_MASH_MASK                 ((0x3) << (CM_PWMCTL_MASH_SHIFT))
+#define CM_PWMCTL_MASH(val)                 ((CM_PWMCTL_MASH_MASK) & ((val) << (CM_PWMCTL_MASH_SHIFT)))
+
+// BCM CM PWMDIV
+#define CM_PWMDIV_SHIFT                     (0)
+#define CM_PWMDIV_MASK                      ((0x00FFFFFF) << (CM_PWMDIV_SHIFT))
+#define CM_PWMDIV(val)                      ((CM_PWMDIV_MASK) & ((val) << (CM_PWMDIV_SHIFT)))
+
+// GPFSEL registers in the GPIO block, 10 pins each
+#define GPIO_GPFSEL_COUNT                   6
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+/**
+ * gpfsel_mode_t
+ * 
+ * Enumeration to control the GPFSEL registers
+ */
+ typedef enum {
+	GPFSEL_INPUT        = 0b000,
+	GPFSEL_OUTPUT       = 0b001,
+	GPFSEL_ALT0         = 0b100,
+	GPFSEL_ALT1         = 0b101,
+	GPFSEL_ALT2         = 0b110,
+	GPFSEL_ALT3         = 0b111,
+	GPFSEL_ALT4         = 0b011,
+	GPFSEL_ALT5         = 0b010,
+} gpfsel_mode_t;
+
+/**
+ * pwmctl_src_t
+ * 
+ * Enumeration to control the clock source of the CM (clock manager)
+ */
+typedef enum {
+	PWMCTL_GND          = 0b000,
+	PWMCTL_OSC          = 0b001,
+	PWMCTL_TESTDEBUG0   = 0B010,
+	PWMCTL_TESTDEBUG1   = 0b011,
+	PWMCTL_PLLA         = 0b100,
+	PWMCTL_PLLC         = 0b101,
+	PWMCTL_PLLD         = 0b110,
+	PWMCTL_HDMIAUX      = 0b111,
+} pwmctl_src_t;
+
+/**
+ * pwmctl_mash_t
+ * 
+ * Enumeration to determine the MASH algorithm
+ */
+typedef enum {
+	PWMCTL_MASHINT      = 0b000,
+	PWMCTL_MASH1STAGE   = 0b001,
+	PWMCTL_MASH2STAGE   = 0b010,
+	PWMCTL_MASH3STAGE   = 0b011,
+} pwmctl_mash_t;
+
+/**
+ * struct ws2812_hw
+ * 
+ * Mapped register blocks and shadows of their control registers. Shadows hold only
+ * control bits (no CM password, no BUSY) and are loaded once by ws2812_hw_init();
+ * after that this layer is the only writer of those registers
+ */
+struct ws2812_hw {
+    // mapped register blocks
+    volatile uint32_t *gpio;
+    volatile uint32_t *pwm;
+    volatile uint32_t *cm;
+
+    // GPIO function selects; bit n of gpfsel_valid is set once GPFSELn is loaded
+    uint32_t gpfsel[GPIO_GPFSEL_COUNT];
+    uint32_t gpfsel_valid;
+
+    // PWM
+    uint32_t pwm_ctl;
+    uint32_t pwm_dmac;
+    uint32_t pwm_rng1;
+    uint32_t pwm_dat1;
+
+    // CM
+    uint32_t cm_pwmctl;
+    uint32_t cm_pwmdiv;
+};
+
+/**************************************************************************************
+ * FUNCTION PROTOTYPES
+ **************************************************************************************/
+// setup
+void ws2812_hw_init(struct ws2812_hw *hw, volatile uint32_t *gpio, volatile uint32_t *pwm, volatile uint32_t *cm);
+
+// GPIO
+int ws2812_hw_gpio_configure(struct ws2812_hw *hw, unsigned int pin, gpfsel_mode_t mode);
+int ws2812_hw_gpio_set(struct ws2812_hw *hw, unsigned int pin);
+int ws2812_hw_gpio_clear(struct ws2812_hw *hw, unsigned int pin);
+
+// CM/PWM
+int ws2812_hw_cm_configure(struct ws2812_hw *hw, pwmctl_src_t src, uint32_t div, pwmctl_mash_t mash);
+void ws2812_hw_pwm_configure(struct ws2812_hw *hw, uint32_t range, uint32_t data);
+void ws2812_hw_pwm_setduty(struct ws2812_hw *hw, uint32_t duty);
+int ws2812_hw_pwm_gate(struct ws2812_hw *hw, bool gate);
+uint32_t ws2812_hw_pwm_status(struct ws2812_hw *hw);
+void ws2812_hw_pwm_clear_fifo(struct ws2812_hw *hw);
+
+#ifndef __KERNEL__
+// register trace hooks; provided by the host tool that links this layer
+uint32_t ws2812_hw_trace_read(const volatile uint32_t *reg);
+void ws2812_hw_trace_write(volatile uint32_t *reg, uint32_t val);
+void ws2812_hw_trace_barrier(void);
+void ws2812_hw_trace_udelay(unsigned long us);
+#endif
+
+#endif /* _WS2812_HW_H_ */
@@ -0,0 +1,218 @@
+#ifndef _WS2812_IOCTL_H_
+#define _WS2812_IOCTL_H_
+
+/**
+ * ws2812 userspace interface
+ *
+ * Shared between the driver and userspace programs; only uses the kernel's exported
+ * types so it can be included from either side
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define WS2812_IOC_MAGIC                    'W'
+
+// write formats
+#define WS2812_FORMAT_RGB                   0   // struct led (red, green, blue) per LED
+#define WS2812_FORMAT_RLE                   1   // struct ws2812_rle_run per run of equal LEDs
+#define WS2812_FORMAT_INDEXED               2   // one palette index (__u8) per LED
+
+// palette size for WS2812_FORMAT_INDEXED
+#define WS2812_PALETTE_SIZE                 256
+
+// pwm mode waveforms; duty values run 0 (LOW) to WS2812_WAVEFORM_RANGE (HIGH)
+#define WS2812_WAVEFORM_MAX_SAMPLES         4096
+#define WS2812_WAVEFORM_MAX_LOOPS           255
+#define WS2812_WAVEFORM_RANGE               100
+#define WS2812_WAVEFORM_CLOCK_HZ            19200000
+
+// matrix wiring (struct ws2812_layout flags); applied within each panel
+#define WS2812_LAYOUT_SERPENTINE            0x01    // every other row (or column) runs backwards
+#define WS2812_LAYOUT_COLUMNS               0x02    // LEDs are chained down columns instead of along rows
+#define WS2812_LAYOUT_FLIP_X                0x04    // the chain starts on the right
+#define WS2812_LAYOUT_FLIP_Y                0x08    // the chain starts at the bottom
+#define WS2812_LAYOUT_PANEL_SERPENTINE      0x10    // every other row of panels runs right to left
+#define WS2812_LAYOUT_FLAGS                 0x1f
+
+// frame-rate up-conversion (struct ws2812_crossfade); longest fixed fade, and the
+// duration that fades over the interval between the last two frames instead
+#define WS2812_CROSSFADE_MAX_US             1000000
+#define WS2812_CROSSFADE_AUTO               0xffffffff
+
+// layer blend modes
+#define WS2812_BLEND_OVER                   0   // alpha-blend over the layers below
+#define WS2812_BLEND_ADD                    1   // saturating add onto the layers below
+#define WS2812_BLEND_MAX                    2   // per-channel maximum (lighten)
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+/**
+ * struct ws2812_layer_config
+ *
+ * Every open file descriptor owns one layer. Layers are composited bottom to top in
+ * z order (ties keep open order); a layer covers num_leds LEDs starting at first_led,
+ * or the whole strip if num_leds is 0. Writes to the file fill the layer from its
+ * first LED.
+ */
+struct ws2812_layer_config {
+    __u32 z;
+    __u32 first_led;
+    __u32 num_leds;
+    __u8 alpha;         // 0 (transparent) - 255 (opaque); used by WS2812_BLEND_OVER
+    __u8 blend;         // WS2812_BLEND_*
+    __u8 _reserved[2];  // must be zero
+};
+
+/**
+ * struct ws2812_rle_run
+ *
+ * One run of a WS2812_FORMAT_RLE write: count (1-255) LEDs of the same color. Runs
+ * are expanded from the layer's first LED; longer runs are split
+ */
+struct ws2812_rle_run {
+    __u8 count;
+    __u8 red;
+    __u8 green;
+    __u8 blue;
+};
+
+/**
+ * struct ws2812_palette
+ *
+ * Palette update for WS2812_FORMAT_INDEXED; replaces count entries starting at
+ * first. Every LED of the layer is re-rendered through the new palette, so palette
+ * animation needs no pixel writes at all
+ */
+struct ws2812_palette_entry {
+    __u8 red;
+    __u8 green;
+    __u8 blue;
+};
+
+struct ws2812_palette {
+    __u16 first;
+    __u16 count;
+    struct ws2812_palette_entry entries[WS2812_PALETTE_SIZE];
+};
+
+/**
+ * struct ws2812_timing
+ *
+ * Frame timing for the attached strip. A frame is num_leds LEDs followed by the
+ * chip's reset (latch) time; max_fps is the refresh rate that implies, achieved_fps
+ * is the rate frames were actually rendered at over the last second. Rates are in
+ * thousandths of a frame per second
+ */
+struct ws2812_timing {
+    __u32 num_leds;
+    __u32 frame_ns;
+    __u32 latch_ns;
+    __u32 max_fps_milli;
+    __u32 achieved_fps_milli;
+};
+
+/**
+ * struct ws2812_waveform
+ *
+ * Duty-cycle waveform for pwm mode, played by the DMA with no CPU involvement.
+ * samples points at num_samples __u32 duty values; one is output per PWM period, so
+ * the sample rate is WS2812_WAVEFORM_CLOCK_HZ / (divider / 4096) / WS2812_WAVEFORM_RANGE.
+ * divider is the 12.12 fixed-point clock divider (integer part at least 2), or 0 to
+ * keep the current one. The waveform plays loops times and then holds its last
+ * sample, or repeats forever if loops is 0.
+ *
+ * A new waveform takes over when the current one finishes its pass, so the output
+ * never glitches; only a divider change briefly stops the clock
+ */
+struct ws2812_waveform {
+    __u64 samples;
+    __u32 num_samples;
+    __u32 divider;
+    __u32 loops;
+    __u32 _reserved;    // must be zero
+};
+
+/**
+ * struct ws2812_sequence
+ *
+ * Frame sequence for pixel mode, in the boot animation format (ws2812_anim.h): data
+ * points at size bytes of header and frames. Every frame is encoded once and the
+ * DMA then plays the sequence from a ring of control blocks, including each frame's
+ * delay, with no CPU or interrupt involvement. A new sequence takes over at the end
+ * of the current frame's delay; the next frame written or committed ends it, as does
+ * a sequence with size 0. Needs the raw DMA backend
+ */
+struct ws2812_sequence {
+    __u64 data;
+    __u32 size;
+    __u32 _reserved;    // must be zero
+};
+
+/**
+ * struct ws2812_layout
+ *
+ * How a width x height matrix is wired. Frames stay plain row-major, pixel
+ * (x, y) at LED index y * width + x as seen by layers and writes, and the driver
+ * reorders them into wiring order while encoding. The matrix is tiled from
+ * panel_width x panel_height panels (0: one panel covering it), chained across each
+ * row of panels, top row first; flags describe the wiring inside every panel.
+ *
+ * table, if set, points at width * height __u16 entries instead: entry i is the
+ * frame index the i-th wired LED shows. LEDs past the matrix are not remapped;
+ * width 0 removes the layout
+ */
+struct ws2812_layout {
+    __u32 width;
+    __u32 height;
+    __u32 panel_width;
+    __u32 panel_height;
+    __u32 flags;        // WS2812_LAYOUT_*
+    __u32 _reserved;    // must be zero
+    __u64 table;
+};
+
+/**
+ * struct ws2812_crossfade
+ *
+ * Frame-rate up-conversion (pixel mode). While duration_us is set, every new frame
+ * is reached by a linear fade from what the strip showed when it arrived, stepped
+ * at the output refresh rate until it completes or the next frame arrives. With
+ * WS2812_CROSSFADE_AUTO the fade lasts as long as the gap before this frame, so
+ * content at a steady rate blends continuously; 0 shows frames as they arrive
+ */
+struct ws2812_crossfade {
+    __u32 duration_us;  // 0, up to WS2812_CROSSFADE_MAX_US, or WS2812_CROSSFADE_AUTO
+    __u32 _reserved;    // must be zero
+};
+
+/**
+ * mmap
+ *
+ * Mapping the device at offset 0 gives the caller's layer a shared pixel buffer of
+ * WS2812_FORMAT_RGB triples (up to one page). Fill it in place, then issue
+ * WS2812_IOC_COMMIT to show it; the layer's write format does not apply
+ */
+
+/**************************************************************************************
+ * IOCTLS
+ **************************************************************************************/
+#define WS2812_IOC_SET_LAYER                _IOW(WS2812_IOC_MAGIC, 1, struct ws2812_layer_config)
+#define WS2812_IOC_GET_LAYER                _IOR(WS2812_IOC_MAGIC, 2, struct ws2812_layer_config)
+#define WS2812_IOC_SET_FORMAT               _IOW(WS2812_IOC_MAGIC, 3, __u32)
+#define WS2812_IOC_SET_PALETTE              _IOW(WS2812_IOC_MAGIC, 4, struct ws2812_palette)
+#define WS2812_IOC_GET_TIMING               _IOR(WS2812_IOC_MAGIC, 5, struct ws2812_timing)
+#define WS2812_IOC_COMMIT                   _IO(WS2812_IOC_MAGIC, 6)
+#define WS2812_IOC_SET_WAVEFORM             _IOW(WS2812_IOC_MAGIC, 7, struct ws2812_waveform)
+#define WS2812_IOC_PLAY_SEQUENCE            _IOW(WS2812_IOC_MAGIC, 8, struct ws2812_sequence)
+#define WS2812_IOC_SET_LAYOUT               _IOW(WS2812_IOC_MAGIC, 9, struct ws2812_layout)
+#define WS2812_IOC_SET_CROSSFADE            _IOW(WS2812_IOC_MAGIC, 10, struct ws2812_crossfade)
+
+#endif /* _WS2812_IOCTL_H_ */
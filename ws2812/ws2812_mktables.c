@@ -0,0 +1,253 @@
+/**
+ * ws2812_mktables
+ *
+ * Build-time generator for ws2812_tables.h (see the Makefile), in the spirit of the
+ * kernel's lib/raid6/mktables: every table the driver reads in a hot path is computed
+ * here once, exactly, instead of being pasted into the source or rebuilt at probe.
+ * Writes to stdout:
+ *
+ *      - the PWM clock dividers, from the bit time and the breathing period
+ *      - the breathing waveform, at any resolution
+ *      - a gamma curve per chip
+ *      - the byte -> 8 PWM word encoder table for each distinct chip timing
+ *      - the chip profiles that tie them together
+ *
+ * With -d only the clock settings are written, as ws2812_timing.h, so userspace tools
+ * can check against the same dividers as the module.
+ *
+ * usage: ws2812_mktables [-d] [-b bit_ns] [-s breath_steps] [-p breath_period_ms] [-g gamma]
+ *
+ *      -d          clock settings only
+ *      -b          duration of one encoded bit (default 1250)
+ *      -s, -p      breathing waveform samples and period (default 200, 400)
+ *      -g          gamma for every chip instead of each chip's own
+ */
+
+/**************************************************************************************
+ * INCLUDES
+ **************************************************************************************/
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ws2812_encode.h"
+#include "ws2812_ioctl.h"
+
+/**************************************************************************************
+ * MACROS/DEFINES
+ **************************************************************************************/
+#define DEFAULT_BIT_NS                      1250
+#define DEFAULT_BREATH_STEPS                200
+#define DEFAULT_BREATH_PERIOD_MS            400
+
+// PWM clock sources; pixel mode runs from PLLD, the breathing waveform from the oscillator
+#define PLLD_HZ                             500000000ull
+#define OSC_HZ                              WS2812_WAVEFORM_CLOCK_HZ
+
+// CM_PWMDIV is 12.12 fixed point; the integer part must be at least 2 with MASH
+#define DIV_FRAC_BITS                       12
+#define DIV_MIN                             (2 << DIV_FRAC_BITS)
+#define DIV_MAX                             0x00FFFFFF
+
+#define MAX_CHIPS                           8
+
+/**************************************************************************************
+ * TYPEDEFS
+ **************************************************************************************/
+struct chip {
+    const char *name;
+    unsigned int t0h_ns;
+    unsigned int t1h_ns;
+    unsigned int reset_ns;
+    double gamma;
+};
+
+/**************************************************************************************
+ * GLOBALS
+ **************************************************************************************/
+// supported LED parts (chip parameter); reset times are the datasheet minimums, and
+// the gammas are the usual perceptual corrections for each part's LEDs
+static const struct chip chips[] = {
+    { .name = "ws2812",  .t0h_ns = 400, .t1h_ns = 800, .reset_ns = 50000,  .gamma = 2.8 },
+    { .name = "ws2812b", .t0h_ns = 400, .t1h_ns = 800, .reset_ns = 280000, .gamma = 2.8 },
+    { .name = "ws2813",  .t0h_ns = 400, .t1h_ns = 800, .reset_ns = 280000, .gamma = 2.8 },
+    { .name = "sk6812",  .t0h_ns = 300, .t1h_ns = 600, .reset_ns = 80000,  .gamma = 2.5 },
+};
+
+#define NUM_CHIPS                           (sizeof(chips) / sizeof(chips[0]))
+
+/**************************************************************************************
+ * HELPER FUNCTIONS
+ **************************************************************************************/
+
+/**
+ * ticks()
+ *
+ * PWM ticks HIGH for a high time of ns, rounded to the nearest tick
+ */
+static unsigned int ticks(unsigned int ns, unsigned int bit_ns) {
+    return (ns * WS2812_TICKS_PER_BIT + bit_ns / 2) / bit_ns;
+}
+
+/**
+ * divider()
+ *
+ * CM_PWMDIV value that divides clock_hz down to out_hz, rounded to the nearest
+ * 1/4096; 0 if the register cannot hold it
+ */
+static uint32_t divider(unsigned long long clock_hz, double out_hz) {
+    // function setup
+    double div = (double)clock_hz / out_hz * (1 << DIV_FRAC_BITS);
+
+    if (div < DIV_MIN || div > DIV_MAX) {
+        return 0;
+    }
+    return (uint32_t)llround(div);
+}
+
+/**
+ * emit_bytes()
+ *
+ * A const byte table, 16 values per line
+ */
+static void emit_bytes(const char *decl, const uint8_t *values, unsigned int n) {
+    printf("%s __aligned(64) = {", decl);
+    for (unsigned int i = 0; i < n; ++i) {
+        printf("%s%3u,", i % 16 ? " " : "\n    ", values[i]);
+    }
+    printf("\n};\n\n");
+}
+
+/**************************************************************************************
+ * MAIN
+ **************************************************************************************/
+int main(int argc, char *argv[]) {
+    // function setup
+    unsigned int bit_ns = DEFAULT_BIT_NS, steps = DEFAULT_BREATH_STEPS, period_ms = DEFAULT_BREATH_PERIOD_MS;
+    unsigned int t0h[MAX_CHIPS], t1h[MAX_CHIPS];
+    uint32_t pwmdiv, breathe_div;
+    double gamma = 0, breathe_hz;
+    const char *guard = "_WS2812_TABLES_H_";
+    bool defines_only = false;
+    uint8_t table[WS2812_WAVEFORM_MAX_SAMPLES];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "db:s:p:g:")) != -1) {
+        switch (opt) {
+            case 'd': defines_only = true; guard = "_WS2812_TIMING_H_"; break;
+            case 'b': bit_ns = strtoul(optarg, NULL, 0); break;
+            case 's': steps = strtoul(optarg, NULL, 0); break;
+            case 'p': period_ms = strtoul(optarg, NULL, 0); break;
+            case 'g': gamma = strtod(optarg, NULL); break;
+            default: goto usage;
+        }
+    }
+    if (!bit_ns || !steps || steps > WS2812_WAVEFORM_MAX_SAMPLES || !period_ms || gamma < 0) {
+        goto usage;
+    }
+
+    // WS2812_TICKS_PER_BIT ticks per bit from PLLD; WS2812_WAVEFORM_RANGE ticks per
+    // breathing sample from the oscillator
+    pwmdiv = divider(PLLD_HZ, WS2812_TICKS_PER_BIT * 1e9 / bit_ns);
+    breathe_hz = steps * 1000.0 / period_ms;
+    breathe_div = divider(OSC_HZ, breathe_hz * WS2812_WAVEFORM_RANGE);
+    if (!pwmdiv || !breathe_div) {
+        fprintf(stderr, "no PWM divider for %u ns bits (0x%08X) or %.1f breathing samples/s (0x%08X)\n",
+            bit_ns, pwmdiv, breathe_hz, breathe_div);
+        return 1;
+    }
+    for (unsigned int c = 0; c < NUM_CHIPS; ++c) {
+        t0h[c] = ticks(chips[c].t0h_ns, bit_ns);
+        t1h[c] = ticks(chips[c].t1h_ns, bit_ns);
+        if (!t0h[c] || t0h[c] >= t1h[c] || t1h[c] >= WS2812_TICKS_PER_BIT) {
+            fprintf(stderr, "%s: %u ns bits leave no room for %u/%u ns high times\n", chips[c].name, bit_ns,
+                chips[c].t0h_ns, chips[c].t1h_ns);
+            return 1;
+        }
+    }
+
+    printf("#ifndef %s\n#define %s\n\n", guard, guard);
+    printf("/*\n * Generated by ws2812_mktables %s-b %u -s %u -p %u", defines_only ? "-d " : "", bit_ns, steps,
+        period_ms);
+    if (gamma) {
+        printf(" -g %g", gamma);
+    }
+    printf("; do not edit\n */\n\n");
+
+    // clock dividers, with the timing they actually give
+    printf("// duration of one encoded bit (one PWM FIFO word); PWMDIV_REGISTER runs PLLD at\n"
+        "// WS2812_TICKS_PER_BIT ticks per bit (%.3f ns per bit)\n", (double)pwmdiv * WS2812_TICKS_PER_BIT * 1e9 /
+        ((double)PLLD_HZ * (1 << DIV_FRAC_BITS)));
+    printf("#define PLLD_HZ                             %llu\n", PLLD_HZ);
+    printf("#define WS2812_BIT_NS                       %u\n", bit_ns);
+    printf("#define PWMDIV_REGISTER                     (0x%08X)\n\n", pwmdiv);
+    printf("// pwm mode breathing demo; BREATH_STEPS samples from the oscillator at\n"
+        "// PWMDIV_REGISTER_BREATHE (%.3f samples/s, %u ms per breath)\n", (double)OSC_HZ *
+        (1 << DIV_FRAC_BITS) / breathe_div / WS2812_WAVEFORM_RANGE, period_ms);
+    printf("#define BREATH_STEPS                        %u\n", steps);
+    printf("#define PWMDIV_REGISTER_BREATHE             (0x%08X)\n\n", breathe_div);
+    if (defines_only) {
+        printf("#endif /* %s */\n", guard);
+        return 0;
+    }
+
+    // one raised cosine per breath, 0 to WS2812_WAVEFORM_RANGE duty
+    for (unsigned int i = 0; i < steps; ++i) {
+        table[i] = (uint8_t)lround(WS2812_WAVEFORM_RANGE * (1.0 - cos(2.0 * M_PI * i / steps)) / 2.0);
+    }
+    emit_bytes("static const uint8_t breathing_table[BREATH_STEPS]", table, steps);
+
+    // gamma curves
+    for (unsigned int c = 0; c < NUM_CHIPS; ++c) {
+        char decl[64];
+
+        for (unsigned int v = 0; v < 256; ++v) {
+            table[v] = (uint8_t)lround(255.0 * pow(v / 255.0, gamma ? gamma : chips[c].gamma));
+        }
+        snprintf(decl, sizeof(decl), "static const uint8_t ws2812_gamma_%s[256]", chips[c].name);
+        emit_bytes(decl, table, 256);
+    }
+
+    // encoder tables, one per distinct timing; MSB first, like ws2812_encoder_init()
+    for (unsigned int c = 0; c < NUM_CHIPS; ++c) {
+        unsigned int prev = 0;
+
+        while (prev < c && (t0h[prev] != t0h[c] || t1h[prev] != t1h[c])) {
+            ++prev;
+        }
+        if (prev < c) {
+            continue;
+        }
+        printf("static const uint32_t ws2812_lut_%u_%u[256][WS2812_BITS_PER_BYTE] __aligned(64) = {\n",
+            t0h[c], t1h[c]);
+        for (unsigned int v = 0; v < 256; ++v) {
+            printf("    {");
+            for (unsigned int bit = 0; bit < WS2812_BITS_PER_BYTE; ++bit) {
+                printf("%s%u", bit ? ", " : " ", (v & (0x80 >> bit)) ? t1h[c] : t0h[c]);
+            }
+            printf(" },\n");
+        }
+        printf("};\n\n");
+    }
+
+    // chip profiles
+    printf("// supported LED parts (chip parameter); reset times are the datasheet minimums\n");
+    printf("static const struct ws2812_chip_profile ws2812_chip_profiles[] = {\n");
+    for (unsigned int c = 0; c < NUM_CHIPS; ++c) {
+        printf("    { .name = \"%s\", .t0h_ns = %u, .t1h_ns = %u, .reset_ns = %u,\n"
+            "      .gamma = ws2812_gamma_%s, .lut = ws2812_lut_%u_%u },\n", chips[c].name, chips[c].t0h_ns,
+            chips[c].t1h_ns, chips[c].reset_ns, chips[c].name, t0h[c], t1h[c]);
+    }
+    printf("    { .name = NULL },\n};\n\n");
+
+    printf("#endif /* %s */\n", guard);
+    return 0;
+
+usage:
+    fprintf(stderr, "usage: %s [-d] [-b bit_ns] [-s breath_steps (1-%d)] [-p breath_period_ms] [-g gamma]\n", argv[0],
+        WS2812_WAVEFORM_MAX_SAMPLES);
+    return 2;
+}